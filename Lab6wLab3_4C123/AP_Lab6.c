@@ -11,52 +11,20 @@
 #include "../inc/UART0.h"
 #include "../inc/UART1.h"
 #include "../inc/AP.h"
+#include "../inc/FCS.h"
 #include "AP_Lab6.h"
 
 //**debug macros**APDEBUG defined in AP.h********
 #ifdef APDEBUG
-#define OutString(STRING) UART0_OutString(STRING)
-#define OutUHex(NUM) UART0_OutUHex(NUM)
-#define OutUHex2(NUM) UART0_OutUHex2(NUM)
-#define OutChar(N) UART0_OutChar(N)
+#include "../inc/Log.h"
 #else
-#define OutString(STRING)
-#define OutUHex(NUM)
-#define OutUHex2(NUM)
-#define OutChar(N)
+#define Log_Event(ID)
 #endif
 
 //****links into AP.c**************
 extern const uint32_t RECVSIZE;
 extern uint8_t RecvBuf[];
 
-typedef struct characteristics
-{
-  uint16_t theHandle;          // each object has an ID
-  uint16_t size;               // number of bytes in user data (1,2,4,8)
-  uint8_t *pt;                 // pointer to user data, stored little endian
-  void (*callBackRead)(void);  // action if SNP Characteristic Read Indication
-  void (*callBackWrite)(void); // action if SNP Characteristic Write Indication
-} characteristic_t;
-
-extern const uint32_t MAXCHARACTERISTICS;
-extern uint32_t CharacteristicCount;
-extern characteristic_t CharacteristicList[];
-
-typedef struct NotifyCharacteristics
-{
-  uint16_t uuid;              // user defined
-  uint16_t theHandle;         // each object has an ID (used to notify)
-  uint16_t CCCDhandle;        // generated/assigned by SNP
-  uint16_t CCCDvalue;         // sent by phone to this object
-  uint16_t size;              // number of bytes in user data (1,2,4,8)
-  uint8_t *pt;                // pointer to user data array, stored little endian
-  void (*callBackCCCD)(void); // action if SNP CCCD Updated Indication
-} NotifyCharacteristic_t;
-
-extern const uint32_t NOTIFYMAXCHARACTERISTICS;
-extern uint32_t NotifyCharacteristicCount;
-extern NotifyCharacteristic_t NotifyCharacteristicList[];
 //**************Lab 6 routines*******************
 // **********SetFCS**************
 // helper function, add check byte to message
@@ -68,22 +36,9 @@ extern NotifyCharacteristic_t NotifyCharacteristicList[];
 // Outputs: none
 void SetFCS(uint8_t *msg)
 {
-  // read the length from the length field, the 2nd bytes
-  const uint32_t length = AP_GetSize(msg);
-
-  uint8_t fcs = 0;
-
-  // fcs starts from the 2-bytes length field, 2-bytes command field
-  // the N-bytes data field
-  uint8_t idx = 0;
-  for ( idx = 1; idx <= (4 + length); idx++)
-  {
-    // fcs is XOR
-    fcs = fcs ^ msg[idx];
-  }
-
-  // set the fcs
-  msg[idx] = fcs;
+  // fcs covers the 2-bytes length field, 2-bytes command field
+  // and the N-bytes data field, folded a word at a time by FCS.c
+  FCS_Set(msg);
 }
 //*************BuildGetStatusMsg**************
 // Create a Get Status message, used in Lab 6
@@ -111,7 +66,7 @@ uint32_t Lab6_GetStatus(void)
 {
   volatile int r;
   uint8_t sendMsg[8];
-  OutString("\n\rGet Status");
+  Log_Event(LOGGETSTATUS);
   BuildGetStatusMsg(sendMsg);
   r = AP_SendMessageResponse(sendMsg, RecvBuf, RECVSIZE);
   return (RecvBuf[4] << 24) + (RecvBuf[5] << 16) + (RecvBuf[6] << 8) + (RecvBuf[7]);
@@ -140,7 +95,7 @@ uint32_t Lab6_GetVersion(void)
 {
   volatile int r;
   uint8_t sendMsg[8];
-  OutString("\n\rGet Version");
+  Log_Event(LOGGETVERSION);
   BuildGetVersionMsg(sendMsg);
   r = AP_SendMessageResponse(sendMsg, RecvBuf, RECVSIZE);
   return (RecvBuf[5] << 8) + (RecvBuf[6]);
@@ -182,7 +137,7 @@ int Lab6_AddService(uint16_t uuid)
 {
   int r;
   uint8_t sendMsg[12];
-  OutString("\n\rAdd service");
+  Log_Event(LOGADDSERVICE);
   BuildAddServiceMsg(uuid, sendMsg);
   r = AP_SendMessageResponse(sendMsg, RecvBuf, RECVSIZE);
   return r;
@@ -215,7 +170,7 @@ int Lab6_RegisterService(void)
 {
   int r;
   uint8_t sendMsg[8];
-  OutString("\n\rRegister service");
+  Log_Event(LOGREGISTER);
   BuildRegisterServiceMsg(sendMsg);
   r = AP_SendMessageResponse(sendMsg, RecvBuf, RECVSIZE);
   return r;
@@ -225,7 +180,7 @@ int Lab6_RegisterService(void)
 // Create a Add Characteristic Value Declaration message, used in Lab 6
 // Inputs uuid is 0xFFF0, 0xFFF1, ...
 //        permission is GATT Permission, 0=none,1=read,2=write, 3=Read+write
-//        properties is GATT Properties, 2=read,8=write,0x0A=read+write, 0x10=notify
+//        properties is GATT Properties, 2=read,8=write,0x0A=read+write, 0x10=notify, 0x20=indicate
 //        pointer to empty buffer of at least 14 bytes
 // Output none
 // build the necessary NPI message that will add a characteristic value
@@ -264,7 +219,7 @@ void BuildAddCharValueMsg(uint16_t uuid,
 
   // set RFU to 0 and
   // set the maximum length of the attribute value=512
-  // for a hint see NPI_AddCharValue in AP.c
+  // for a hint see addCharValue and AP_AddCharacteristic in AP.c
   // for a hint see first half of AP_AddCharacteristic and first half of AP_AddNotifyCharacteristic
 }
 
@@ -307,7 +262,7 @@ void BuildAddCharDescriptorMsg(char name[], uint8_t *msg)
   SetFCS(msg);
 
   // set the permissions on the string to read
-  // for a hint see NPI_AddCharDescriptor in AP.c
+  // for a hint see the descriptor header in AP_AddCharacteristic in AP.c
   // for a hint see second half of AP_AddCharacteristic
 }
 
@@ -315,7 +270,7 @@ void BuildAddCharDescriptorMsg(char name[], uint8_t *msg)
 // Add a read, write, or read/write characteristic, used in Lab 6
 //        for notify properties, call AP_AddNotifyCharacteristic
 // Inputs uuid is 0xFFF0, 0xFFF1, ...
-//        thesize is the number of bytes in the user data 1,2,4, or 8
+//        thesize is the number of bytes in the user data, 1 to APMAXVALUESIZE
 //        pt is a pointer to the user data, stored little endian
 //        permission is GATT Permission, 0=none,1=read,2=write, 3=Read+write
 //        properties is GATT Properties, 2=read,8=write,0x0A=read+write
@@ -323,37 +278,31 @@ void BuildAddCharDescriptorMsg(char name[], uint8_t *msg)
 //        (*ReadFunc) called before it responses with data from internal structure
 //        (*WriteFunc) called after it accepts data into internal structure
 // Output APOK if successful,
-//        APFAIL if name is empty, more than 8 characteristics, or if SNP failure
+//        APFAIL if name is empty, more than MAXCHARACTERISTICS characteristics, or if SNP failure
 int Lab6_AddCharacteristic(uint16_t uuid, uint16_t thesize, void *pt, uint8_t permission,
                            uint8_t properties, char name[], void (*ReadFunc)(void), void (*WriteFunc)(void))
 {
   int r;
   uint16_t handle;
   uint8_t sendMsg[32];
-  if (thesize > 8)
+  if ((thesize == 0) || (thesize > APMAXVALUESIZE))
     return APFAIL;
   if (name[0] == 0)
     return APFAIL; // empty name
   if (CharacteristicCount >= MAXCHARACTERISTICS)
     return APFAIL; // error
   BuildAddCharValueMsg(uuid, permission, properties, sendMsg);
-  OutString("\n\rAdd CharValue");
+  Log_Event(LOGADDCHARVALUE);
   r = AP_SendMessageResponse(sendMsg, RecvBuf, RECVSIZE);
   if (r == APFAIL)
     return APFAIL;
   handle = (RecvBuf[7] << 8) + RecvBuf[6]; // handle for this characteristic
-  OutString("\n\rAdd CharDescriptor");
+  Log_Event(LOGADDCHARDESC);
   BuildAddCharDescriptorMsg(name, sendMsg);
   r = AP_SendMessageResponse(sendMsg, RecvBuf, RECVSIZE);
   if (r == APFAIL)
     return APFAIL;
-  CharacteristicList[CharacteristicCount].theHandle = handle;
-  CharacteristicList[CharacteristicCount].size = thesize;
-  CharacteristicList[CharacteristicCount].pt = (uint8_t *)pt;
-  CharacteristicList[CharacteristicCount].callBackRead = ReadFunc;
-  CharacteristicList[CharacteristicCount].callBackWrite = WriteFunc;
-  CharacteristicCount++;
-  return APOK; // OK
+  return AP_SaveCharacteristic(handle, thesize, pt, ReadFunc, WriteFunc);
 }
 
 //*************BuildAddNotifyCharDescriptorMsg**************
@@ -408,42 +357,35 @@ void BuildAddNotifyCharDescriptorMsg(char name[], uint8_t *msg)
 // Add a notify characteristic, used in Lab 6
 //        for read, write, or read/write characteristic, call AP_AddCharacteristic
 // Inputs uuid is 0xFFF0, 0xFFF1, ...
-//        thesize is the number of bytes in the user data 1,2,4, or 8
+//        thesize is the number of bytes in the user data, 1 to APMAXVALUESIZE
 //        pt is a pointer to the user data, stored little endian
 //        name is a null-terminated string, maximum length of name is 20 bytes
 //        (*CCCDfunc) called after it accepts , changing CCCDvalue
 // Output APOK if successful,
-//        APFAIL if name is empty, more than 4 notify characteristics, or if SNP failure
+//        APFAIL if name is empty, more than NOTIFYMAXCHARACTERISTICS notify characteristics, or if SNP failure
 int Lab6_AddNotifyCharacteristic(uint16_t uuid, uint16_t thesize, void *pt,
                                  char name[], void (*CCCDfunc)(void))
 {
   int r;
   uint16_t handle;
   uint8_t sendMsg[36];
-  if (thesize > 8)
+  if ((thesize == 0) || (thesize > APMAXVALUESIZE))
     return APFAIL;
   if (NotifyCharacteristicCount >= NOTIFYMAXCHARACTERISTICS)
     return APFAIL; // error
-  BuildAddCharValueMsg(uuid, 0, 0x10, sendMsg);
-  OutString("\n\rAdd Notify CharValue");
+  BuildAddCharValueMsg(uuid, 0, 0x30, sendMsg); // 0x10=notify, 0x20=indicate, as AP_AddNotifyCharacteristic
+  Log_Event(LOGADDNOTIFY);
   r = AP_SendMessageResponse(sendMsg, RecvBuf, RECVSIZE);
   if (r == APFAIL)
     return APFAIL;
   handle = (RecvBuf[7] << 8) + RecvBuf[6]; // handle for this characteristic
-  OutString("\n\rAdd CharDescriptor");
+  Log_Event(LOGADDCHARDESC);
   BuildAddNotifyCharDescriptorMsg(name, sendMsg);
   r = AP_SendMessageResponse(sendMsg, RecvBuf, RECVSIZE);
   if (r == APFAIL)
     return APFAIL;
-  NotifyCharacteristicList[NotifyCharacteristicCount].uuid = uuid;
-  NotifyCharacteristicList[NotifyCharacteristicCount].theHandle = handle;
-  NotifyCharacteristicList[NotifyCharacteristicCount].CCCDhandle = (RecvBuf[8] << 8) + RecvBuf[7]; // handle for this CCCD
-  NotifyCharacteristicList[NotifyCharacteristicCount].CCCDvalue = 0;                               // notify initially off
-  NotifyCharacteristicList[NotifyCharacteristicCount].size = thesize;
-  NotifyCharacteristicList[NotifyCharacteristicCount].pt = (uint8_t *)pt;
-  NotifyCharacteristicList[NotifyCharacteristicCount].callBackCCCD = CCCDfunc;
-  NotifyCharacteristicCount++;
-  return APOK; // OK
+  return AP_SaveNotifyCharacteristic(uuid, handle, (RecvBuf[8] << 8) + RecvBuf[7], // handle for this CCCD
+                                     thesize, pt, CCCDfunc);
 }
 
 //*************BuildSetDeviceNameMsg**************
@@ -646,16 +588,16 @@ int Lab6_StartAdvertisement(void)
 {
   volatile int r;
   uint8_t sendMsg[40];
-  OutString("\n\rSet Device name");
+  Log_Event(LOGDEVICENAME);
   BuildSetDeviceNameMsg("Shape the World", sendMsg);
   r = AP_SendMessageResponse(sendMsg, RecvBuf, RECVSIZE);
-  OutString("\n\rSetAdvertisement1");
+  Log_Event(LOGADVERTISEMENT1);
   BuildSetAdvertisementData1Msg(sendMsg);
   r = AP_SendMessageResponse(sendMsg, RecvBuf, RECVSIZE);
-  OutString("\n\rSetAdvertisement Data");
+  Log_Event(LOGADVERTISEDATA);
   BuildSetAdvertisementDataMsg("Shape the World", sendMsg);
   r = AP_SendMessageResponse(sendMsg, RecvBuf, RECVSIZE);
-  OutString("\n\rStartAdvertisement");
+  Log_Event(LOGSTARTADVERTISE);
   BuildStartAdvertisementMsg(100, sendMsg);
   r = AP_SendMessageResponse(sendMsg, RecvBuf, RECVSIZE);
   return r;
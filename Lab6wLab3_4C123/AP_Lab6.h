@@ -37,7 +37,7 @@ int Lab6_RegisterService(void);
 // Add a read, write, or read/write characteristic, used in Lab 6
 //        for notify properties, call AP_AddNotifyCharacteristic 
 // Inputs uuid is 0xFFF0, 0xFFF1, ...
-//        thesize is the number of bytes in the user data 1,2,4, or 8 
+//        thesize is the number of bytes in the user data, 1 to APMAXVALUESIZE 
 //        pt is a pointer to the user data, stored little endian
 //        permission is GATT Permission, 0=none,1=read,2=write, 3=Read+write 
 //        properties is GATT Properties, 2=read,8=write,0x0A=read+write
@@ -45,7 +45,7 @@ int Lab6_RegisterService(void);
 //        (*ReadFunc) called before it responses with data from internal structure
 //        (*WriteFunc) called after it accepts data into internal structure
 // Output APOK if successful,
-//        APFAIL if name is empty, more than 8 characteristics, or if SNP failure
+//        APFAIL if name is empty, more than MAXCHARACTERISTICS characteristics, or if SNP failure
 int Lab6_AddCharacteristic(uint16_t uuid, uint16_t thesize, void *pt, uint8_t permission,
   uint8_t properties, char name[], void(*ReadFunc)(void), void(*WriteFunc)(void));
 
@@ -53,12 +53,12 @@ int Lab6_AddCharacteristic(uint16_t uuid, uint16_t thesize, void *pt, uint8_t pe
 // Add a notify characteristic, used in Lab 6
 //        for read, write, or read/write characteristic, call AP_AddCharacteristic 
 // Inputs uuid is 0xFFF0, 0xFFF1, ...
-//        thesize is the number of bytes in the user data 1,2,4, or 8 
+//        thesize is the number of bytes in the user data, 1 to APMAXVALUESIZE 
 //        pt is a pointer to the user data, stored little endian
 //        name is a null-terminated string, maximum length of name is 20 bytes
 //        (*CCCDfunc) called after it accepts , changing CCCDvalue
 // Output APOK if successful,
-//        APFAIL if name is empty, more than 4 notify characteristics, or if SNP failure
+//        APFAIL if name is empty, more than NOTIFYMAXCHARACTERISTICS notify characteristics, or if SNP failure
 int Lab6_AddNotifyCharacteristic(uint16_t uuid, uint16_t thesize, void *pt,   
   char name[], void(*CCCDfunc)(void));
 
@@ -0,0 +1,128 @@
+// Boot.c
+// Runs on TM4C123
+// Start-up framework for Lab 6, see Boot.h
+// stages are run by the main threads, so a stage waiting on SPI or
+// on the SNP only costs its own thread, the others keep running
+// the critical path is the chain of stages that decided when the
+// last stage finished, it is where a shorter init would pay off
+
+#include <stdint.h>
+#include "../inc/BSP.h"
+#include "../inc/CortexM.h"
+#include "../inc/UART0.h"
+#include "os.h"
+#include "Boot.h"
+
+volatile uint32_t BootDone;           // stage bits finished
+uint32_t BootMain;                    // BSP_Time_Get at Boot_Init, us
+uint32_t BootLaunched;                // BSP_Time_Get at Boot_Launch, us
+const char *BootName[BOOTSTAGES];     // name of each stage, 0 if not run
+uint32_t BootNeeds[BOOTSTAGES];       // stages it waited for
+uint32_t BootBegin[BOOTSTAGES];       // init function called, us
+uint32_t BootEnd[BOOTSTAGES];         // init function returned, us
+
+//*************Boot_Init**************
+// Clear all stages, call early in main after BSP_Time_Init
+// Inputs: none
+// Output: none
+void Boot_Init(void){ uint32_t i;
+  BootDone = 0;
+  for(i=0; i<BOOTSTAGES; i++){
+    BootName[i] = 0;
+    BootNeeds[i] = BootBegin[i] = BootEnd[i] = 0;
+  }
+  BootMain = BSP_Time_Get();
+  BootLaunched = BootMain;
+}
+
+//*************Boot_Launch**************
+// Record the end of the serial part of main
+// Inputs: none
+// Output: none
+void Boot_Launch(void){
+  BootLaunched = BSP_Time_Get();
+}
+
+// ****bootIndex****
+// bit number of a stage
+uint32_t static bootIndex(uint32_t stage){ uint32_t i;
+  i = 0;
+  while((stage > 1)&&(i < BOOTSTAGES-1)){
+    stage = stage>>1;
+    i++;
+  }
+  return i;
+}
+
+//*************Boot_Wait**************
+// Wait, yielding to the other threads, until stages are done
+// Inputs: stages to wait for
+// Output: none
+void Boot_Wait(uint32_t stages){
+  while((BootDone&stages) != stages){
+    OS_Suspend();
+  }
+}
+
+//*************Boot_Run**************
+// Run one start-up stage from a main thread
+// Inputs: stage, needs, name, init function
+// Output: none
+void Boot_Run(uint32_t stage, uint32_t needs, const char *name, void(*init)(void)){
+  uint32_t i; long sr;
+  i = bootIndex(stage);
+  BootName[i] = name;
+  BootNeeds[i] = needs;
+  Boot_Wait(needs);
+  BootBegin[i] = BSP_Time_Get();
+  (*init)();
+  BootEnd[i] = BSP_Time_Get();
+  sr = StartCritical();   // other threads set their bits too
+  BootDone = BootDone|stage;
+  EndCritical(sr);
+}
+
+// ****bootOut****
+// one number in us relative to main
+void static bootOut(char *label, uint32_t time){
+  UART0_OutString(label);
+  UART0_OutUDec(time-BootMain);
+}
+
+//*************Boot_Report**************
+// Send the stage timing and the critical path to UART0
+// Inputs: none
+// Output: none
+void Boot_Report(void){ uint32_t i,j,last,end;
+  bootOut("\n\rBoot: main done ",BootLaunched);
+  last = BOOTSTAGES;
+  for(i=0; i<BOOTSTAGES; i++){
+    if(BootName[i]){
+      UART0_OutString("\n\rBoot: "); UART0_OutString((char *)BootName[i]);
+      bootOut(" start ",BootBegin[i]);
+      bootOut(" end ",BootEnd[i]);
+      UART0_OutString(" took "); UART0_OutUDec(BootEnd[i]-BootBegin[i]);
+      if((last == BOOTSTAGES)||(BootEnd[i] > BootEnd[last])){
+        last = i;
+      }
+    }
+  }
+  if(last == BOOTSTAGES) return;   // no stages run
+  // walk back from the last stage to finish, through the stage it waited on longest
+  UART0_OutString("\n\rBoot: critical path ");
+  i = last;
+  while(1){
+    UART0_OutString((char *)BootName[i]); UART0_OutString(" <- ");
+    end = BootLaunched;  // waited for the kernel to start
+    last = BOOTSTAGES;
+    for(j=0; j<BOOTSTAGES; j++){
+      if((BootNeeds[i]&(1<<j))&&BootName[j]&&(BootEnd[j] > end)){
+        end = BootEnd[j];
+        last = j;
+      }
+    }
+    if(last == BOOTSTAGES) break;
+    i = last;
+  }
+  UART0_OutString("main");
+}
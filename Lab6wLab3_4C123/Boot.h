@@ -0,0 +1,56 @@
+// Boot.h
+// Runs on TM4C123
+// Start-up framework for Lab 6
+// main only does the quick register setup, then the slow parts of
+// starting a subsystem (LCD SPI transfers, SNP reset waits) run at the
+// top of the main thread that uses it, so they overlap after OS_Launch
+// each stage has a bit number; a stage waits until the stages it
+// needs are done, and the start and end of each stage are timestamped
+
+#ifndef __BOOT_H
+#define __BOOT_H  1
+
+// stage bits
+#define BOOTTEMP      0x01  // temperature sensor, Task4
+#define BOOTLIGHT     0x02  // light sensor, Task6
+#define BOOTLCD       0x04  // LCD controller and blank screen, Task2
+#define BOOTBLUETOOTH 0x08  // SNP up, services added, advertising, Task7
+#define BOOTALL       0x0F
+#define BOOTSTAGES    4
+
+//*************Boot_Init**************
+// Clear all stages, call early in main after BSP_Time_Init
+// Inputs: none
+// Output: none
+void Boot_Init(void);
+
+//*************Boot_Launch**************
+// Record the end of the serial part of main, call just before OS_Launch
+// Inputs: none
+// Output: none
+void Boot_Launch(void);
+
+//*************Boot_Run**************
+// Run one start-up stage from a main thread
+// waits, yielding to the other threads, until the needed stages are done
+// Inputs: stage one of BOOTTEMP ... BOOTBLUETOOTH
+//         needs stages that must be done first, 0 for none
+//         name for Boot_Report
+//         init function to run
+// Output: none
+void Boot_Run(uint32_t stage, uint32_t needs, const char *name, void(*init)(void));
+
+//*************Boot_Wait**************
+// Wait, yielding to the other threads, until stages are done
+// Inputs: stages to wait for
+// Output: none
+void Boot_Wait(uint32_t stages);
+
+//*************Boot_Report**************
+// Send the stage timing and the critical path to UART0
+// times are us since BSP_Time_Init in main
+// Inputs: none
+// Output: none
+void Boot_Report(void);
+
+#endif
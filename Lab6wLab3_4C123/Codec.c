@@ -0,0 +1,220 @@
+// Codec.c
+// Runs on TM4C123, decoder also compiles on the PC
+// Payload codec for streamed sensor samples
+// accelerometer readings change little from one sample to the next,
+// so the differences are sent as zigzag varints, mostly 1 byte each
+// microphone samples are sent as 4-bit IMA-ADPCM codes
+// a 9-byte accelerometer record shrinks to about 4 bytes,
+// a 5-byte microphone record to half a byte
+
+#include <stdint.h>
+#include "Codec.h"
+
+//*************Codec_PutVarint**************
+// Write an unsigned number, 7 bits per byte, least significant first
+// Inputs: value to write
+//         pt points to at least 5 free bytes
+// Output: number of bytes written, 1 to 5
+uint32_t Codec_PutVarint(uint32_t value, uint8_t *pt){ uint32_t n;
+  n = 0;
+  while(value >= 0x80){
+    pt[n] = (value&0x7F)|0x80;  // more bytes follow
+    value = value>>7;
+    n++;
+  }
+  pt[n] = value;
+  return n+1;
+}
+
+//*************Codec_GetVarint**************
+// Read an unsigned number written by Codec_PutVarint
+// Inputs: pt points to the first byte
+//         max is the number of bytes available
+//         value is where the number is stored
+// Output: number of bytes read, 0 if truncated or longer than 5 bytes
+uint32_t Codec_GetVarint(const uint8_t *pt, uint32_t max, uint32_t *value){
+  uint32_t n,v;
+  v = 0;
+  for(n=0; (n<max)&&(n<5); n++){
+    v = v|((uint32_t)(pt[n]&0x7F)<<(7*n));
+    if((pt[n]&0x80) == 0){
+      *value = v;
+      return n+1;
+    }
+  }
+  return 0;   // ran off the end
+}
+
+//*************Codec_ZigZag**************
+// Map a signed difference onto an unsigned number
+// Inputs: signed difference
+// Output: unsigned code
+uint32_t Codec_ZigZag(int32_t d){
+  return ((uint32_t)d<<1)^(uint32_t)(d>>31);
+}
+
+//*************Codec_UnZigZag**************
+// Inverse of Codec_ZigZag
+// Inputs: unsigned code
+// Output: signed difference
+int32_t Codec_UnZigZag(uint32_t u){
+  return (int32_t)(u>>1)^-(int32_t)(u&1);
+}
+
+// IMA-ADPCM tables
+const int8_t AdpcmIndexTable[16] = {
+  -1, -1, -1, -1, 2, 4, 6, 8,
+  -1, -1, -1, -1, 2, 4, 6, 8};
+const uint16_t AdpcmStepTable[89] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+  19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+  130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+  337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+  876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+  2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+  5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+  15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+
+// ****adpcmStep****
+// reconstruct a sample from a code, shared by encoder and decoder
+// so both sides follow exactly the same predictor
+int16_t static adpcmStep(adpcm_t *state, uint8_t code){
+  int32_t step,diff,sample,index;
+  step = AdpcmStepTable[state->index];
+  diff = step>>3;
+  if(code&4) diff = diff+step;
+  if(code&2) diff = diff+(step>>1);
+  if(code&1) diff = diff+(step>>2);
+  sample = state->predicted;
+  if(code&8){
+    sample = sample-diff;
+  }else{
+    sample = sample+diff;
+  }
+  if(sample > 32767) sample = 32767;
+  if(sample < -32768) sample = -32768;
+  index = state->index+AdpcmIndexTable[code&0x0F];
+  if(index < 0) index = 0;
+  if(index > 88) index = 88;
+  state->predicted = sample;
+  state->index = index;
+  return sample;
+}
+
+//*************Codec_AdpcmEncode**************
+// Compress one 16-bit sample into a 4-bit code
+// Inputs: state, updated to follow the decoder
+//         sample 16-bit signed
+// Output: 4-bit code, 0 to 15
+uint8_t Codec_AdpcmEncode(adpcm_t *state, int16_t sample){
+  int32_t step,diff; uint8_t code;
+  step = AdpcmStepTable[state->index];
+  diff = sample-state->predicted;
+  code = 0;
+  if(diff < 0){
+    code = 8;
+    diff = -diff;
+  }
+  if(diff >= step){
+    code = code|4;
+    diff = diff-step;
+  }
+  step = step>>1;
+  if(diff >= step){
+    code = code|2;
+    diff = diff-step;
+  }
+  step = step>>1;
+  if(diff >= step){
+    code = code|1;
+  }
+  adpcmStep(state,code);
+  return code;
+}
+
+//*************Codec_AdpcmDecode**************
+// Expand one 4-bit code into a 16-bit sample
+// Inputs: state, updated
+//         code 4-bit code from Codec_AdpcmEncode
+// Output: 16-bit signed sample
+int16_t Codec_AdpcmDecode(adpcm_t *state, uint8_t code){
+  return adpcmStep(state,code&0x0F);
+}
+
+//*************Codec_SoundToPCM**************
+// 10-bit microphone reading to 16-bit signed sample
+// Inputs: data 0 to 1023
+// Output: -32768 to 32704
+int16_t Codec_SoundToPCM(uint16_t data){
+  return ((int32_t)(data&0x3FF)-512)*64;
+}
+
+//*************Codec_PCMToSound**************
+// 16-bit signed sample back to a 10-bit reading
+// Inputs: sample 16-bit signed
+// Output: 0 to 1023
+uint16_t Codec_PCMToSound(int16_t sample){ int32_t data;
+  data = (sample+32768+32)>>6;  // round to nearest
+  if(data > 1023) data = 1023;
+  return data;
+}
+
+//*************Codec_DecodeFrame**************
+// Decode one Stream notification frame, see Stream.h for the format
+// Inputs: frame points to the notification data
+//         length is the number of bytes in the notification
+//         (*AccFunc) called with time (ms) and AccX, AccY, AccZ
+//         (*SoundFunc) called with time (ms) and SoundData
+// Output: number of samples decoded, -1 if the frame is malformed
+int Codec_DecodeFrame(const uint8_t *frame, uint32_t length,
+  void(*AccFunc)(uint16_t time, uint16_t x, uint16_t y, uint16_t z),
+  void(*SoundFunc)(uint16_t time, uint16_t data)){
+  uint32_t n,k,j,u,header,count,decimation; int samples;
+  uint16_t time; int32_t acc[3]; adpcm_t state; uint8_t code;
+  if(length < 6) return -1;
+  decimation = frame[3];
+  time = frame[4]+(frame[5]<<8);
+  acc[0] = acc[1] = acc[2] = 0;
+  samples = 0;
+  n = 6;
+  while(n < length){
+    k = Codec_GetVarint(&frame[n],length-n,&header);
+    if(k == 0) return -1;
+    n = n+k;
+    time = time+(header>>1);
+    if((header&1) == 0){          // accelerometer record
+      for(j=0; j<3; j++){
+        k = Codec_GetVarint(&frame[n],length-n,&u);
+        if(k == 0) return -1;
+        n = n+k;
+        acc[j] = acc[j]+Codec_UnZigZag(u);
+      }
+      if(AccFunc) AccFunc(time,acc[0],acc[1],acc[2]);
+      samples++;
+    }else{                        // microphone run
+      if(n+4 > length) return -1;
+      count = frame[n];
+      state.predicted = Codec_SoundToPCM(frame[n+1]+(frame[n+2]<<8));
+      state.index = frame[n+3];
+      if((count == 0)||(state.index > 88)) return -1;
+      n = n+4;
+      if(n+(count/2) > length) return -1;  // (count-1) codes, 2 per byte
+      if(SoundFunc) SoundFunc(time,Codec_PCMToSound(state.predicted));
+      for(j=1; j<count; j++){
+        code = frame[n+(j-1)/2];
+        if(j&1){
+          code = code&0x0F;      // low nibble first
+        }else{
+          code = code>>4;
+        }
+        time = time+decimation;
+        Codec_AdpcmDecode(&state,code);
+        if(SoundFunc) SoundFunc(time,Codec_PCMToSound(state.predicted));
+      }
+      n = n+(count/2);
+      samples = samples+count;
+    }
+  }
+  return samples;
+}
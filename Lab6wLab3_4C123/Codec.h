@@ -0,0 +1,84 @@
+// Codec.h
+// Runs on TM4C123, decoder also compiles on the PC
+// Payload codec for streamed sensor samples
+// accelerometer triples as zigzag varint deltas,
+// microphone samples as 4-bit IMA-ADPCM
+// Codec_DecodeFrame turns a Stream notification back into samples
+
+#ifndef __CODEC_H
+#define __CODEC_H  1
+
+// IMA-ADPCM state, one per direction
+typedef struct{
+  int16_t predicted;  // last reconstructed sample, 16-bit signed
+  uint8_t index;      // 0 to 88 into the step size table
+} adpcm_t;
+
+//*************Codec_PutVarint**************
+// Write an unsigned number, 7 bits per byte, least significant first
+// bit 7 is set in every byte but the last
+// Inputs: value to write
+//         pt points to at least 5 free bytes
+// Output: number of bytes written, 1 to 5
+uint32_t Codec_PutVarint(uint32_t value, uint8_t *pt);
+
+//*************Codec_GetVarint**************
+// Read an unsigned number written by Codec_PutVarint
+// Inputs: pt points to the first byte
+//         max is the number of bytes available
+//         value is where the number is stored
+// Output: number of bytes read, 0 if truncated or longer than 5 bytes
+uint32_t Codec_GetVarint(const uint8_t *pt, uint32_t max, uint32_t *value);
+
+//*************Codec_ZigZag**************
+// Map a signed difference onto an unsigned number, small magnitudes stay small
+// 0,-1,1,-2,2 become 0,1,2,3,4
+// Inputs: signed difference
+// Output: unsigned code
+uint32_t Codec_ZigZag(int32_t d);
+
+//*************Codec_UnZigZag**************
+// Inverse of Codec_ZigZag
+// Inputs: unsigned code
+// Output: signed difference
+int32_t Codec_UnZigZag(uint32_t u);
+
+//*************Codec_AdpcmEncode**************
+// Compress one 16-bit sample into a 4-bit code
+// Inputs: state, updated to follow the decoder
+//         sample 16-bit signed
+// Output: 4-bit code, 0 to 15
+uint8_t Codec_AdpcmEncode(adpcm_t *state, int16_t sample);
+
+//*************Codec_AdpcmDecode**************
+// Expand one 4-bit code into a 16-bit sample
+// Inputs: state, updated
+//         code 4-bit code from Codec_AdpcmEncode
+// Output: 16-bit signed sample
+int16_t Codec_AdpcmDecode(adpcm_t *state, uint8_t code);
+
+//*************Codec_SoundToPCM**************
+// 10-bit microphone reading to 16-bit signed sample
+// Inputs: data 0 to 1023
+// Output: -32768 to 32704
+int16_t Codec_SoundToPCM(uint16_t data);
+
+//*************Codec_PCMToSound**************
+// 16-bit signed sample back to a 10-bit reading
+// Inputs: sample 16-bit signed
+// Output: 0 to 1023
+uint16_t Codec_PCMToSound(int16_t sample);
+
+//*************Codec_DecodeFrame**************
+// Decode one Stream notification frame, see Stream.h for the format
+// each record is passed to a user function, either may be 0
+// Inputs: frame points to the notification data
+//         length is the number of bytes in the notification
+//         (*AccFunc) called with time (ms) and AccX, AccY, AccZ
+//         (*SoundFunc) called with time (ms) and SoundData
+// Output: number of samples decoded, -1 if the frame is malformed
+int Codec_DecodeFrame(const uint8_t *frame, uint32_t length,
+  void(*AccFunc)(uint16_t time, uint16_t x, uint16_t y, uint16_t z),
+  void(*SoundFunc)(uint16_t time, uint16_t data));
+
+#endif
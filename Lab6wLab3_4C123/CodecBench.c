@@ -0,0 +1,256 @@
+// CodecBench.c
+// Runs on the PC, not part of the Keil project
+// Self-test and benchmark of the Stream payload codec
+// the real Stream.c encoder is compiled with the AP and BSP calls stubbed below,
+// every frame it sends is decoded with Codec_DecodeFrame and compared with
+// the samples that went in
+// gcc -O2 -I../inc -o CodecBench CodecBench.c Stream.c Codec.c -lm
+// CodecBench          (prints the results, exit code 0 if every check passed)
+// 1) varint and zigzag round trips, truncated varints are rejected
+// 2) 10 s of synthetic samples, accelerometer at 10 Hz, microphone at 1 kHz
+//    decimated to 100 Hz, streamed at MTU 23 and at MTU 247
+//    accelerometer values must come back exactly, microphone values within
+//    MAXSOUNDERR once ADPCM has grown its step size from the smallest one,
+//    bytes per sample compared with the fixed records
+//    (9 bytes accelerometer, 5 bytes microphone) the codec replaced
+// 3) host time per sample of the encoder and of the decoder
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "../inc/AP.h"
+#include "../inc/Diag.h"
+#include "Stream.h"
+#include "Codec.h"
+
+#define BENCHMS 10000        // ms of samples per run
+#define BENCHACCMS 100       // Task1 accelerometer period, ms
+#define BENCHSEND 100        // ms between Stream_Send calls, Task1 wakes Task7
+#define FIXEDACC 9           // bytes of the old accelerometer record
+#define FIXEDSOUND 5         // bytes of the old microphone record
+#define BENCHSETTLE 10       // microphone samples for ADPCM to grow from the smallest step
+#define MAXSOUNDERR 24       // largest ADPCM error allowed after that, in 10-bit counts
+
+extern uint8_t StreamFrame[];
+extern volatile uint32_t StreamPutI,StreamGetI;
+
+//*************stubs for Stream.c**************
+uint32_t NotifyCharacteristicCount;
+uint32_t BenchTime;          // us, returned by BSP_Time_Get
+uint16_t BenchMTU;
+uint16_t BenchLength;        // set by AP_SetNotifyLength
+uint32_t BenchBytes;         // notification bytes sent
+uint32_t BenchDecode;        // 1 to decode each frame as it is sent
+uint32_t BenchCheck;         // 1 to compare the decoded samples with Expected
+uint32_t BenchErrors;
+uint32_t BenchFrames;
+uint32_t BenchMaxSoundErr;    // after the first BENCHSETTLE microphone samples
+uint32_t BenchStartSoundErr;  // during the first BENCHSETTLE
+double BenchSoundErr2;       // sum of squared microphone errors
+uint32_t BenchSoundCount;
+uint32_t BenchFrameTicks;    // clock() spent in Codec_DecodeFrame
+uint32_t BenchDecoded;       // samples decoded
+
+uint32_t BSP_Time_Get(void){ return BenchTime; }
+uint16_t AP_GetNotifyCCCD(uint32_t i){ return 1; }
+uint16_t AP_GetMTU(void){ return BenchMTU; }
+uint32_t AP_IsConnected(void){ return 1; }
+int AP_SetNotifyLength(uint32_t i, uint16_t length){
+  BenchLength = length;
+  return APOK;
+}
+int AP_AddServiceTable(uint16_t uuid, const gatt_t *table, uint32_t count){ return APOK; }
+int AP_SetNotifyType(uint32_t i, uint8_t type){ return APOK; }
+void Diag_Register(uint32_t id, volatile uint32_t *counter){}
+
+// samples put into the stream, in order, checked off as they are decoded
+#define BENCHMAX 20000
+struct{
+  uint16_t type;
+  uint16_t time;
+  uint16_t data[3];
+}Expected[BENCHMAX];
+uint32_t ExpectedPut,ExpectedGet;
+
+// ****expect****
+// remember a sample that went into the stream
+void static expect(uint16_t type, uint16_t d0, uint16_t d1, uint16_t d2){
+  if(ExpectedPut >= BENCHMAX) return;
+  Expected[ExpectedPut].type = type;
+  Expected[ExpectedPut].time = (BenchTime/1000)&0xFFFF;
+  Expected[ExpectedPut].data[0] = d0;
+  Expected[ExpectedPut].data[1] = d1;
+  Expected[ExpectedPut].data[2] = d2;
+  ExpectedPut++;
+}
+// ****benchAcc****
+// Codec_DecodeFrame callback, must match the next sample exactly
+void static benchAcc(uint16_t time, uint16_t x, uint16_t y, uint16_t z){
+  BenchDecoded++;
+  if(BenchCheck == 0) return;
+  if((ExpectedGet >= ExpectedPut)||(Expected[ExpectedGet].type != STREAMACC)
+    ||(Expected[ExpectedGet].time != time)||(Expected[ExpectedGet].data[0] != x)
+    ||(Expected[ExpectedGet].data[1] != y)||(Expected[ExpectedGet].data[2] != z)){
+    if(BenchErrors < 10) printf("  accelerometer sample %u wrong\n",(unsigned)ExpectedGet);
+    BenchErrors++;
+  }
+  ExpectedGet++;
+}
+// ****benchSound****
+// Codec_DecodeFrame callback, ADPCM is lossy, so only the error is bounded
+void static benchSound(uint16_t time, uint16_t data){ uint32_t err;
+  BenchDecoded++;
+  if(BenchCheck == 0) return;
+  if((ExpectedGet >= ExpectedPut)||(Expected[ExpectedGet].type != STREAMSOUND)
+    ||(Expected[ExpectedGet].time != time)){
+    if(BenchErrors < 10) printf("  microphone sample %u out of place\n",(unsigned)ExpectedGet);
+    BenchErrors++;
+  }else{
+    err = abs((int)data-(int)Expected[ExpectedGet].data[0]);
+    if(BenchSoundCount < BENCHSETTLE){
+      if(err > BenchStartSoundErr) BenchStartSoundErr = err;
+    }else{
+      if(err > BenchMaxSoundErr) BenchMaxSoundErr = err;
+      BenchSoundErr2 += (double)err*err;
+    }
+    BenchSoundCount++;
+  }
+  ExpectedGet++;
+}
+int AP_SendNotification(uint32_t i){ clock_t start;
+  BenchBytes += BenchLength;
+  BenchFrames++;
+  if(BenchDecode){
+    start = clock();
+    if(Codec_DecodeFrame(StreamFrame,BenchLength,&benchAcc,&benchSound) < 0){
+      printf("  frame %u malformed\n",(unsigned)BenchFrames);
+      BenchErrors++;
+    }
+    BenchFrameTicks += clock()-start;
+  }
+  return APOK;
+}
+
+// ****testVarint****
+// round trips of varints and zigzag, truncation detected
+// Output: number of failures
+int static testVarint(void){ uint8_t buf[5]; uint32_t k,n,value,got; int32_t d; int errors;
+  errors = 0;
+  for(d=-70000; d<=70000; d++){
+    if(Codec_UnZigZag(Codec_ZigZag(d)) != d) errors++;
+  }
+  for(value=0; value<0x400000; value=value*3+1){
+    k = Codec_PutVarint(value,buf);
+    n = Codec_GetVarint(buf,k,&got);
+    if((n != k)||(got != value)||(Codec_GetVarint(buf,k-1,&got) != 0)) errors++;
+  }
+  k = Codec_PutVarint(0xFFFFFFFF,buf);
+  if((k != 5)||(Codec_GetVarint(buf,5,&got) != 5)||(got != 0xFFFFFFFF)) errors++;
+  printf("varint and zigzag: %d failures\n",errors);
+  return errors;
+}
+
+// ****run****
+// stream BENCHMS ms of synthetic samples at one MTU
+// Output: number of failures
+int static run(uint16_t mtu){ uint32_t ms,acc,sound; uint32_t accSamples,soundSamples;
+  uint16_t x,y,z,mic; double fixed,rms;
+  BenchMTU = mtu;
+  BenchDecode = 1;
+  BenchCheck = 1;
+  BenchBytes = BenchFrames = BenchErrors = BenchMaxSoundErr = BenchDecoded = 0;
+  BenchSoundErr2 = 0;
+  BenchSoundCount = BenchStartSoundErr = 0;
+  ExpectedPut = ExpectedGet = 0;
+  accSamples = soundSamples = 0;
+  srand(mtu);
+  Stream_Init();
+  StreamControl = STREAMACC|STREAMSOUND;   // decimation STREAMDECIMATE
+  for(ms=0; ms<BENCHMS; ms++){
+    BenchTime = 1000*ms+7;
+    sound = 512+300*sin(2*M_PI*3*ms/1000.0)+(rand()%9)-4;   // 3 Hz tone and noise
+    mic = sound;
+    if((ms%STREAMDECIMATE) == STREAMDECIMATE-1){            // the one Stream_PutSound keeps
+      expect(STREAMSOUND,mic,0,0);
+      soundSamples++;
+    }
+    Stream_PutSound(mic);
+    if((ms%BENCHACCMS) == 0){
+      acc = 512+60*sin(2*M_PI*ms/1500.0);                   // walking, about 0.7 Hz
+      x = acc+(rand()%5)-2;
+      y = 1024-acc+(rand()%5)-2;
+      z = 700+(rand()%7)-3;
+      expect(STREAMACC,x,y,z);
+      accSamples++;
+      Stream_PutAcc(x,y,z);
+    }
+    if((ms%BENCHSEND) == 0){
+      Stream_Send();
+    }
+  }
+  Stream_Send();
+  if(StreamDrops){
+    printf("  %u samples dropped\n",(unsigned)StreamDrops);
+    BenchErrors++;
+  }
+  if(ExpectedGet != ExpectedPut){
+    printf("  %u samples sent, %u decoded\n",(unsigned)ExpectedPut,(unsigned)ExpectedGet);
+    BenchErrors++;
+  }
+  rms = sqrt(BenchSoundErr2/(BenchSoundCount > BENCHSETTLE ? BenchSoundCount-BENCHSETTLE : 1));
+  if(BenchMaxSoundErr > MAXSOUNDERR){
+    BenchErrors++;
+  }
+  fixed = FIXEDACC*accSamples+FIXEDSOUND*soundSamples;
+  printf("MTU %3u: %u samples in %u frames, %.2f bytes/sample, %.1f times smaller than fixed records\n",
+    (unsigned)mtu,(unsigned)(accSamples+soundSamples),(unsigned)BenchFrames,
+    (double)BenchBytes/(accSamples+soundSamples),fixed/BenchBytes);
+  printf("         microphone error %.1f RMS, at most %u of 1023 (%u while ADPCM starts), %u failures\n",
+    rms,(unsigned)BenchMaxSoundErr,(unsigned)BenchStartSoundErr,(unsigned)BenchErrors);
+  return BenchErrors;
+}
+
+// ****timing****
+// host time per sample, encoder and decoder, averaged over many runs
+void static timing(void){ uint32_t i,ms,samples; clock_t start,total;
+  samples = 0;
+  total = 0;
+  BenchFrameTicks = 0;
+  BenchDecoded = 0;
+  BenchCheck = 0;
+  for(i=0; i<20; i++){
+    BenchMTU = 247;
+    BenchDecode = (i&1);          // odd runs decode, for the decoder time
+    ExpectedPut = ExpectedGet = 0;
+    Stream_Init();
+    StreamControl = STREAMACC|STREAMSOUND;
+    for(ms=0; ms<BENCHMS; ms++){
+      BenchTime = 1000*ms;
+      Stream_PutSound(512+(ms&0x3F));
+      if((ms%BENCHACCMS) == 0) Stream_PutAcc(500,520,700+(ms&3));
+      if((ms%BENCHSEND) == 0){
+        if(BenchDecode == 0){
+          start = clock();
+          samples += StreamPutI-StreamGetI;
+          Stream_Send();
+          total += clock()-start;
+        }else{
+          Stream_Send();
+        }
+      }
+    }
+  }
+  printf("host encoder %.1f ns/sample, decoder %.1f ns/sample\n",
+    1e9*total/CLOCKS_PER_SEC/samples,1e9*BenchFrameTicks/CLOCKS_PER_SEC/BenchDecoded);
+}
+
+int main(void){ int errors;
+  errors = testVarint();
+  errors += run(23);
+  errors += run(247);
+  timing();
+  printf("%s\n",errors ? "FAIL" : "pass");
+  return errors != 0;
+}
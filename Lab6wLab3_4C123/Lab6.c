@@ -45,6 +45,16 @@
 #include "Texas.h"
 #include "../inc/AP.h"
 #include "AP_Lab6.h"
+#include "Stream.h"
+#include "Telemetry.h"
+#include "../inc/Diag.h"
+#include "Boot.h"
+#include "../inc/GPIO.h"
+#ifdef SNPEMULATOR
+#include "../inc/UART1.h"
+#include "../inc/SNP_Emulator.h"
+#include "PhoneScript.h"
+#endif
 
 
 uint32_t sqrt32(uint32_t s);
@@ -67,8 +77,8 @@ uint8_t  TemperatureByteData; // 1C
 int32_t NewData;  // true when new numbers to display on top of LCD
 int32_t LCDmutex; // exclusive access to LCD
 int32_t I2Cmutex; // exclusive access to I2C
+int32_t BluetoothEvent; // SRDY fell, or 100 ms passed, Task7 has work
 int ReDrawAxes = 0;         // non-zero means redraw axes on next display task
-int Send0Flag=0;
 
 enum plotstate{
   Accelerometer,
@@ -116,6 +126,7 @@ void Task0(void){
   BSP_Microphone_Input(&SoundData);
   soundSum = soundSum + (int32_t)SoundData;
   SoundArray[time] = SoundData;
+  Stream_PutSound(SoundData);
   time = time + 1;
   if(time == SOUNDRMSLENGTH){
     SoundAvg = soundSum/SOUNDRMSLENGTH;
@@ -157,6 +168,7 @@ void Task1_Init(void){
   EWMA = Magnitude;                // this is a guess; there are many options
   Steps = 0;
   LostTask1Data = 0;
+  Diag_Register(DIAGLOSTTASK1DATA, &LostTask1Data);
 }
 // *********Task1*********
 // collects data from accelerometer
@@ -167,11 +179,13 @@ void Task1(void){uint32_t squared;
   Profile_Toggle1(); // viewed by a real logic analyzer to know Task1 started
 
   BSP_Accelerometer_Input(&AccX, &AccY, &AccZ);
+  Stream_PutAcc(AccX, AccY, AccZ);
   squared = AccX*AccX + AccY*AccY + AccZ*AccZ;
   if(OS_FIFO_Put(squared) == -1){  // makes Task2 run every 100ms
     LostTask1Data = LostTask1Data + 1;
   }
   Time++; // in 100ms units
+  OS_Signal(&BluetoothEvent); // Task7 sends queued samples and checks the link
 }
 /* ****************************************** */
 /*          End of Task1 Section              */
@@ -203,10 +217,34 @@ void drawaxes(void){
   }
   OS_Signal(&LCDmutex);  ReDrawAxes = 0;
 }
+// ****lcdInit****
+// LCD start-up stage, about 70 ms of SPI to blank the screen
+void static lcdInit(void){
+  BSP_LCD_Init();
+  BSP_LCD_FillScreen(BSP_LCD_Color565(0, 0, 0));
+}
+#ifdef TELEMETRY
+// ****telemetrySample****
+// every sensor value and lost counter, once per accelerometer reading
+void static telemetrySample(void){ telemetry_t sample;
+  sample.magnitude = Magnitude;
+  sample.ewma = EWMA;
+  sample.soundRMS = SoundRMS;
+  sample.lightData = LightData;
+  sample.temperature = TemperatureData;
+  sample.steps = Steps;
+  sample.lostData = LostData;
+  sample.lostTask1Data = LostTask1Data;
+  sample.streamDrops = StreamDrops;
+  Telemetry_Put(&sample);
+}
+#endif
 void Task2(void){uint32_t data;
   uint32_t localMin;   // smallest measured magnitude since odd-numbered step detected
   uint32_t localMax;   // largest measured magnitude since even-numbered step detected
   uint32_t localCount; // number of measured magnitudes above local min or below local max
+  // the sensor inits also change Port A registers, let them finish first
+  Boot_Run(BOOTLCD, BOOTTEMP|BOOTLIGHT, "LCD", &lcdInit);
   localMin = 1024;
   localMax = 0;
   localCount = 0;
@@ -266,6 +304,9 @@ void Task2(void){uint32_t data;
         AlgorithmState = LookingForMax;
       }
     }
+#ifdef TELEMETRY
+    telemetrySample();
+#endif
     if(ReDrawAxes){
       drawaxes();
       ReDrawAxes = 0;
@@ -291,6 +332,21 @@ void Task2(void){uint32_t data;
 
 
 //------------Task3 handles switch input, buzzer output, LED output-------
+// ****diagReport****
+// print the drop and error counters on UART0 every DIAGPERIOD,
+// only when one of them went up since the last report
+#define DIAGPERIOD 10000000 // us
+uint32_t DiagTime;   // BSP_Time_Get of the last check
+uint32_t DiagSum;    // sum of the counters at the last report
+void static diagReport(void){ uint32_t sum;
+  if((BSP_Time_Get()-DiagTime) < DIAGPERIOD) return;
+  DiagTime = BSP_Time_Get();
+  sum = Diag_Snapshot();
+  if(sum != DiagSum){
+    DiagSum = sum;
+    Diag_Dump();
+  }
+}
 // *********Task3*********
 // Main thread scheduled by OS round robin preemptive scheduler
 // non-real-time task
@@ -344,6 +400,10 @@ void Task3(void){
       case LookingForCross2: BSP_RGB_Set(0, 0, 500); break;
       default: BSP_RGB_Set(0, 0, 0);
     }
+#ifdef TELEMETRY
+    Telemetry_Send(); // low-priority work, Task3 has time to spare
+#endif
+    diagReport();
     OS_Sleep(10); // debounce the switches
   }
 }
@@ -358,8 +418,16 @@ void Task3(void){
 // measures temperature
 // Inputs:  none
 // Outputs: none
+// ****tempInit****
+// temperature sensor start-up stage
+void static tempInit(void){
+  OS_Wait(&I2Cmutex);
+  BSP_TempSensor_Init();
+  OS_Signal(&I2Cmutex);
+}
 void Task4(void){int32_t voltData,tempData;
   int done;
+  Boot_Run(BOOTTEMP, 0, "Temperature", &tempInit);
   while(1){
     TExaS_Task4();     // records system time in array, toggles virtual logic analyzer
     Profile_Toggle4(); // viewed by a real logic analyzer to know Task4 started
@@ -392,7 +460,8 @@ void Task4(void){int32_t voltData,tempData;
 // updates the text at the top and bottom of the LCD
 // Inputs:  none
 // Outputs: none
-void Task5(void){int32_t soundSum; int count=0;
+void Task5(void){int32_t soundSum;
+  Boot_Wait(BOOTLCD);
   OS_Wait(&LCDmutex);
   BSP_LCD_DrawString(0,  0, "Temp=",  TOPTXTCOLOR);
   BSP_LCD_DrawString(0,  1, "Step=",  TOPTXTCOLOR);
@@ -420,11 +489,6 @@ void Task5(void){int32_t soundSum; int count=0;
     }
 //end of debug code
     OS_Signal(&LCDmutex);
-    count++;
-    if(count==5){
-      Send0Flag=1;
-      count=0;
-    }
   }
 }
 /* ****************************************** */
@@ -437,8 +501,16 @@ void Task5(void){int32_t soundSum; int count=0;
 // Task6 measures light intensity
 // Inputs:  none
 // Outputs: none
+// ****lightInit****
+// light sensor start-up stage
+void static lightInit(void){
+  OS_Wait(&I2Cmutex);
+  BSP_LightSensor_Init();
+  OS_Signal(&I2Cmutex);
+}
 void Task6(void){ uint32_t lightData;
   int done;
+  Boot_Run(BOOTLIGHT, 0, "Light", &lightInit);
   while(1){
     TExaS_Task6();     // records system time in array, toggles virtual logic analyzer
 //    Profile_Toggle6(); // viewed by a real logic analyzer to know Task6 started
@@ -463,20 +535,42 @@ void Task6(void){ uint32_t lightData;
 //---------------- Task7 dummy function ----------------
 // *********Task7*********
 // Main thread scheduled by OS round robin preemptive scheduler
-// Task7 checks for Bluetooth incoming frames but never blocks or sleeps
+// Task7 brings up the Bluetooth module, yielding while it waits,
+// then blocks until SRDY falls (the SNP has a frame) or Task1 signals,
+// so it is not in the round robin while there is nothing to do
+// AP.c masks the SRDY interrupt during each exchange, so the thread
+// does not wake itself; it takes the frames that came in meanwhile
+// and arms the interrupt again before it blocks
 // Inputs:  none
 // Outputs: none
 uint32_t Count7;
-void Task7(void){
+#define BLUETOOTHFRAMES 8  // SNP frames handled before blocking again, a wedged SNP holds SRDY low
+void Bluetooth_Init(void);
+// ****bluetoothSRDY****
+// runs in the SRDY falling edge ISR
+void static bluetoothSRDY(void){
+  OS_Signal(&BluetoothEvent);
+}
+void Task7(void){ uint32_t i;
   Count7 = 0;
+  Boot_Run(BOOTBLUETOOTH, 0, "Bluetooth", &Bluetooth_Init);
+  Boot_Wait(BOOTALL);
+  Boot_Report();
+  OS_InitSemaphore(&BluetoothEvent, 0); // forget the signals from Task1 during boot
+  GPIO_SRDYInterrupt(&bluetoothSRDY, 3);
   while(1){
+    GPIO_SRDYArm();  // forget the edges of our own exchanges, signals if SRDY is low
+    OS_Wait(&BluetoothEvent);
     Count7++;
+    while(AP_Supervise() == APBUSY){ // resets and rebuilds a wedged SNP
+      OS_Suspend();      // let the other threads run while the SNP resets
+    }
     AP_BackgroundProcess();
-    if(Send0Flag){
-      AP_SendNotification(0);
-      Send0Flag=0;
+    AP_NotifyProcess();  // Steps, when it changes
+    Stream_Send();   // raw samples, if the phone started the stream
+    for(i=0; (i<BLUETOOTHFRAMES)&&AP_RecvStatus(); i++){
+      AP_BackgroundProcess();  // frames that came while the edge interrupt was masked
     }
-    WaitForInterrupt();
   }
 }
 /* ****************************************** */
@@ -487,11 +581,11 @@ void Task7(void){
 // ********OutValue**********
 // Debugging dump of a data value to virtual serial port to PC
 // data shown as 1 to 8 hexadecimal characters
+// runs in the SNP read and write callbacks, so it queues the text without waiting
 // Inputs:  response (number returned by last AP call)
 // Outputs: none
 void OutValue(char *label,uint32_t value){ 
-  UART0_OutString(label);
-  UART0_OutUHex(value);
+  UART0_Printf("%s%X",label,value);
 }
 void Bluetooth_ReadTime(void){ // called on a SNP Characteristic Read Indication for characteristic Time
   OutValue("\n\rRead Time=",Time);
@@ -518,25 +612,84 @@ void Bluetooth_WritePlotState(void){ // called on a SNP Characteristic Write Ind
 void Bluetooth_Steps(void){ // called on SNP CCCD Updated Indication
   OutValue("\n\rCCCD=",AP_GetNotifyCCCD(0));
 }
+void Bluetooth_ReadDiagnostics(void){ // called on a SNP Characteristic Read Indication for characteristic Diagnostics
+  Diag_Snapshot();   // the phone reads all the counters from one instant
+}
+void Bluetooth_Event(uint16_t event){ // called on SNP Event Indication
+  if(event == SNP_CONN_EST_EVT){
+    OutValue("\n\rConnected, interval=",AP_GetConnInterval());
+  }else if(event == SNP_CONN_TERM_EVT){
+    UART0_Printf("\n\rDisconnected");
+  }else if(event == SNP_CONN_PARAM_UPDATED_EVT){
+    OutValue("\n\rInterval=",AP_GetConnInterval());
+  }
+}
 extern uint16_t edXNum; // actual variable within TExaS
-void Bluetooth_Init(void){volatile int r;
-  EnableInterrupts();
+// service 0xFFF0, added to the SNP in this order
+const gatt_t Lab6Gatt[] = {
+// uuid  size pt                   perm  prop  name               read                        write or CCCD
+  {0xFFF1,1,&PlotState,           0x03, 0x0A, "PlotState",       &Bluetooth_ReadPlotState,   &Bluetooth_WritePlotState},
+  {0xFFF2,4,&Time,                0x01, 0x02, "Time",            &Bluetooth_ReadTime,        0},
+  {0xFFF3,4,&SoundRMS,            0x01, 0x02, "Sound",           &Bluetooth_ReadSound,       0},
+  {0xFFF4,1,&TemperatureByteData, 0x01, 0x02, "Temperature",     &Bluetooth_ReadTemperature, 0},
+  {0xFFF5,4,&LightData,           0x01, 0x02, "Light",           &Bluetooth_ReadLight,       0},
+  {0xFFF6,2,&edXNum,              0x02, 0x08, "edXNum",          0,                          &TExaS_Grade},
+  {0xFFF7,2,&Steps,               0x00, 0x10, "Number of Steps", 0,                          &Bluetooth_Steps},
+  {0xFFF8,4*DIAGCOUNT,DiagSnapshot,0x01, 0x02, "Diagnostics",     &Bluetooth_ReadDiagnostics, 0}
+};
+#ifdef SNPEMULATOR
+// CPU time the AP and the SNP emulator spend per Get Status exchange,
+// at each rate the emulated link is switched to; this is not throughput:
+// the emulator hands bytes over in software, so no byte crosses a wire
+// and the rate only changes the bookkeeping, SNPStats.wireTime has the
+// time the frames would take on the wire; with a real CC2650 AP_SetBaud
+// returns APUNSUPPORTED, SimpleNP 2.2 stays at 115,200, and NPI throughput
+// at higher rates has never been measured on hardware
+#define COSTEXCHANGES 50
+const uint32_t CostBaud[] = {115200,230400,460800,921600,2000000,3000000};
+uint32_t ExchangeCost[sizeof(CostBaud)/sizeof(uint32_t)]; // us per exchange, 0 if the rate failed
+void Bluetooth_EmulatorCost(void){ uint32_t i,j,start;
+  for(i=0; i<sizeof(CostBaud)/sizeof(uint32_t); i++){
+    ExchangeCost[i] = 0;
+    OutValue("\n\rEmulated baud=",CostBaud[i]);
+    if(AP_SetBaud(CostBaud[i]) != APOK){
+      UART0_OutString(" not supported");
+      continue;
+    }
+    start = BSP_Time_Get();
+    for(j=0; j<COSTEXCHANGES; j++){
+      AP_GetStatus();
+    }
+    ExchangeCost[i] = (BSP_Time_Get()-start)/COSTEXCHANGES;
+    OutValue(" AP+emulator us/exchange=",ExchangeCost[i]);
+  }
+  AP_SetBaud(UART1BAUD);
+}
+#endif
+// Bluetooth start-up stage, runs at the start of Task7 after OS_Launch,
+// the SNP reset and power up waits are spent running the other threads
+void Bluetooth_Init(void){int r;
   UART0_OutString("\n\rLab 6 Application Processor\n\r");
-  r = AP_Init(); 
+  while((r = AP_InitRun()) == APBUSY){   // AP_InitStart called in main
+    OS_Suspend();    // let the other threads run while the SNP resets
+  }
+  if(r == APFAIL){
+    UART0_OutString("\n\rSNP not responding");
+    return;
+  }
+  AP_SetEventCallback(&Bluetooth_Event);
   Lab6_GetStatus();  // optional
   Lab6_GetVersion(); // optional
-  Lab6_AddService(0xFFF0); 
-  Lab6_AddCharacteristic(0xFFF1,1,&PlotState,0x03,0x0A,"PlotState",&Bluetooth_ReadPlotState,&Bluetooth_WritePlotState);
-  Lab6_AddCharacteristic(0xFFF2,4,&Time,0x01,0x02,"Time",&Bluetooth_ReadTime,0);
-  Lab6_AddCharacteristic(0xFFF3,4,&SoundRMS,0x01,0x02,"Sound",&Bluetooth_ReadSound,0);
-  Lab6_AddCharacteristic(0xFFF4,1,&TemperatureByteData,0x01,0x02,"Temperature",&Bluetooth_ReadTemperature,0);
-  Lab6_AddCharacteristic(0xFFF5,4,&LightData,0x01,0x02,"Light",&Bluetooth_ReadLight,0);
-  Lab6_AddCharacteristic(0xFFF6,2,&edXNum,0x02,0x08,"edXNum",0,&TExaS_Grade);
-  Lab6_AddNotifyCharacteristic(0xFFF7,2,&Steps,"Number of Steps",&Bluetooth_Steps);
-  Lab6_RegisterService();
-  Lab6_StartAdvertisement();
+#ifdef SNPEMULATOR
+  Bluetooth_EmulatorCost();
+#endif
+  AP_AddServiceTable(0xFFF0,Lab6Gatt,sizeof(Lab6Gatt)/sizeof(gatt_t));
+  AP_SetNotifyPolicy(0,APPOLICYCHANGE,0,100,5000); // on change, at most 10/s, at least every 5 s
+  Stream_AddService();
+  AP_StartAdvertisement();
+  OutValue("\n\rBoot to advertising (us)=",AP_GetBootTime());
+  OutValue("\n\rmain to advertising (us)=",APBootAdvertising);
   Lab6_GetStatus();
-  DisableInterrupts(); // optional
 }
 //---------------- Step 6 ----------------
 // Step 6 is to implement the fitness device by combining the
@@ -552,12 +705,14 @@ void Bluetooth_Init(void){volatile int r;
 // Task4  temperature    periodically every 1 sec
 // Task5  numbers on LCD after Task0 runs SOUNDRMSLENGTH times
 // Task6  light          periodically every 800 ms
-// Task7  dummy          no timing requirement
+// Task7  Bluetooth      no timing requirement, streams raw samples
 // Remember that you must have exactly one main() function, so
 // to work on this step, you must rename all other main()
 // functions in this file.
 int main(void){
   OS_Init();
+  BSP_Time_Init(); // us since reset, for the boot time report
+  Boot_Init();
   Profile_Init();  // initialize the 7 hardware profiling pins
   Task0_Init();    // microphone init
   Task1_Init();    // accelerometer init
@@ -565,15 +720,16 @@ int main(void){
   BSP_Button2_Init();
   BSP_RGB_Init(0, 0, 0);
   BSP_Buzzer_Init(0);
-  BSP_LCD_Init();
-  BSP_LCD_FillScreen(BSP_LCD_Color565(0, 0, 0));
-
-  BSP_LightSensor_Init();
-  BSP_TempSensor_Init();
+  // LCD in Task2, sensors in Task4 and Task6, Bluetooth in Task7
+  Stream_Init();   // raw data streaming, initially stopped
+#ifdef TELEMETRY
+  Telemetry_Init();
+#endif
   Time = 0;
   OS_InitSemaphore(&NewData, 0);  // 0 means no data
   OS_InitSemaphore(&LCDmutex, 1); // 1 means free
   OS_InitSemaphore(&I2Cmutex, 1); // 1 means free
+  OS_InitSemaphore(&BluetoothEvent, 0); // 0 means nothing to do
   OS_FIFO_Init();                 // initialize FIFO used to send data between Task1 and Task2
   // Task 0 should run every 1ms
   OS_AddPeriodicEventThread(&Task0, 1);
@@ -582,12 +738,16 @@ int main(void){
   // Task2, Task3, Task4, Task5, Task6, Task7 are main threads
   OS_AddThreads(&Task2, &Task3, &Task4, &Task5, &Task6, &Task7);
   // when grading change 1000 to 4-digit number from edX
-  BSP_LCD_FillScreen(BSP_LCD_Color565(0, 0, 0));
   UART0_Init();
   TExaS_Init(GRADER);          // initialize the Lab 6 grader
   // if you hold either switch down, it will pause so you can see grader output
   while((BSP_Button1_Input()==0)||(BSP_Button2_Input())==0){}; 
-  Bluetooth_Init();
+  AP_InitStart();  // pins and reset now, the rest of Bluetooth_Init runs in Task7
+#ifdef SNPEMULATOR
+  SNP_Script(PhoneScript,PhoneScriptSteps);
+#endif
+  Boot_Launch();
+  DisableInterrupts();  // no ISR may signal a thread before the kernel runs
   OS_Launch(BSP_Clock_GetFreq()/THREADFREQ); // doesn't return, interrupts enabled in here
   return 0;             // this never executes
 }
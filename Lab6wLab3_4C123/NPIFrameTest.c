@@ -0,0 +1,118 @@
+// NPIFrameTest.c
+// Runs on the PC, not part of the Keil project
+// Compares every constant NPI frame in AP.c, built at compile time by NPI_FRAME,
+// byte for byte with the frame the runtime builder makes with SetFCS
+// the Build*Msg functions of AP_Lab6.c are the builders where there is one,
+// the others are typed in below the way AP_Lab6.c builds its frames
+// gcc -O2 -Wall -Wno-unused-but-set-variable -DSNPEMULATOR -I../inc -o NPIFrameTest NPIFrameTest.c
+//   AP_Lab6.c ../inc/SNPHost.c ../inc/SNP_Emulator.c ../inc/FCS.c ../inc/Capture.c ../inc/Log.c ../inc/Diag.c
+// NPIFrameTest        (prints each frame that differs, exit code 0 if all match)
+// -Wno-unused-but-set-variable: AP.c and AP_Lab6.c keep "volatile int r" for the debugger
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "../inc/AP.h"
+
+// constant frames in AP.c not declared in AP.h
+extern const uint8_t HCI_EXT_ResetSystemCmd[];
+extern const uint8_t NPI_SetAdvertisementSAP[];
+extern const uint8_t NPI_GATTSetDeviceName[];
+extern const uint8_t NPI_SetAdvertisementData[];
+extern const uint8_t NPI_StartAdvertisement[];
+extern const uint8_t NPI_WriteConfirmation[];
+extern const uint8_t NPI_CCCDUpdatedConfirmation[];
+
+// runtime builders in AP_Lab6.c
+void SetFCS(uint8_t *msg);
+void BuildGetStatusMsg(uint8_t *msg);
+void BuildGetVersionMsg(uint8_t *msg);
+void BuildRegisterServiceMsg(uint8_t *msg);
+void BuildSetAdvertisementData1Msg(uint8_t *msg);
+void BuildSetDeviceNameMsg(char name[], uint8_t *msg);
+void BuildSetAdvertisementDataMsg(char name[], uint8_t *msg);
+void BuildStartAdvertisementMsg(uint16_t interval, uint8_t *msg);
+
+#define TESTMAX 64        // larger than any constant frame
+
+// ****buildFrame****
+// SOF, length, command and payload, then SetFCS, as AP_Lab6.c does
+void static buildFrame(uint8_t *msg, uint8_t cmd0, uint8_t cmd1, const uint8_t *payload, uint32_t size){
+  msg[0] = SOF;
+  msg[1] = size&0xFF;
+  msg[2] = size>>8;
+  msg[3] = cmd0;
+  msg[4] = cmd1;
+  memcpy(&msg[5],payload,size);
+  SetFCS(msg);
+}
+void static buildResetSystem(uint8_t *msg){
+  const uint8_t payload[] = {0x1D,0xFC,0x01};     // HCI_EXT_ResetSystemCmd opcode 0xFC1D
+  buildFrame(msg,0x55,0x04,payload,sizeof(payload));
+}
+void static buildAdvertisementSAP(uint8_t *msg){
+  BuildSetAdvertisementDataMsg("Shape the World SAP",msg);
+}
+void static buildDeviceName(uint8_t *msg){
+  BuildSetDeviceNameMsg("Shape the World 001",msg);
+}
+void static buildAdvertisementData(uint8_t *msg){
+  BuildSetAdvertisementDataMsg("Shape the World 001",msg);
+}
+void static buildStartAdvertisement(uint8_t *msg){
+  BuildStartAdvertisementMsg(100,msg);         // 100*0.625 ms
+}
+void static buildWriteConfirmation(uint8_t *msg){
+  const uint8_t payload[] = {0x00,0x00,0x00};     // success, connection handle 0
+  buildFrame(msg,0x55,0x88,payload,sizeof(payload));
+}
+void static buildCCCDConfirmation(uint8_t *msg){
+  const uint8_t payload[] = {0x00,0x00,0x00};     // success, connection handle 0
+  buildFrame(msg,0x55,0x8B,payload,sizeof(payload));
+}
+
+const struct{
+  const char *name;
+  const uint8_t *frame;
+  void (*build)(uint8_t *msg);
+}Frames[] = {
+  {"HCI_EXT_ResetSystemCmd",      HCI_EXT_ResetSystemCmd,      &buildResetSystem},
+  {"NPI_GetStatus",               NPI_GetStatus,               &BuildGetStatusMsg},
+  {"NPI_GetVersion",              NPI_GetVersion,              &BuildGetVersionMsg},
+  {"NPI_Register",                NPI_Register,                &BuildRegisterServiceMsg},
+  {"NPI_SetAdvertisement1",       NPI_SetAdvertisement1,       &BuildSetAdvertisementData1Msg},
+  {"NPI_SetAdvertisementSAP",     NPI_SetAdvertisementSAP,     &buildAdvertisementSAP},
+  {"NPI_GATTSetDeviceName",       NPI_GATTSetDeviceName,       &buildDeviceName},
+  {"NPI_SetAdvertisementData",    NPI_SetAdvertisementData,    &buildAdvertisementData},
+  {"NPI_StartAdvertisement",      NPI_StartAdvertisement,      &buildStartAdvertisement},
+  {"NPI_WriteConfirmation",       NPI_WriteConfirmation,       &buildWriteConfirmation},
+  {"NPI_CCCDUpdatedConfirmation", NPI_CCCDUpdatedConfirmation, &buildCCCDConfirmation}
+};
+#define FRAMES (sizeof(Frames)/sizeof(Frames[0]))
+
+// ****dump****
+void static dump(const char *label, const uint8_t *pt, uint32_t size){ uint32_t i;
+  printf("  %-9s",label);
+  for(i=0; i<size; i++){
+    printf(" %02X",pt[i]);
+  }
+  printf("\n");
+}
+
+int main(void){ uint8_t msg[TESTMAX]; uint32_t i,size,built,fails;
+  fails = 0;
+  for(i=0; i<FRAMES; i++){
+    memset(msg,0xA5,TESTMAX);             // a byte the builder skips shows up
+    (*Frames[i].build)(msg);
+    size = NPI_FRAMESIZE(AP_GetSize((uint8_t *)Frames[i].frame));
+    built = NPI_FRAMESIZE(AP_GetSize(msg));
+    if((size != built)||(size > TESTMAX)||memcmp(msg,Frames[i].frame,size)){
+      printf("%s differs\n",Frames[i].name);
+      dump("constant",Frames[i].frame,size);
+      dump("built",msg,built < TESTMAX ? built : TESTMAX);
+      fails++;
+    }
+  }
+  printf("%u frames, %u differ\n",(unsigned)FRAMES,(unsigned)fails);
+  return fails != 0;
+}
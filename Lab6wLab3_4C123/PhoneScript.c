@@ -0,0 +1,27 @@
+// PhoneScript.c
+// Runs on TM4C123, also compiles on the PC
+// Phone session the SNP emulator plays against Lab 6, see PhoneScript.h
+// empty unless SNPEMULATOR is defined in AP.h
+
+#include <stdint.h>
+#include "../inc/AP.h"
+#ifdef SNPEMULATOR
+#include "../inc/SNP_Emulator.h"
+#include "PhoneScript.h"
+
+const snpstep_t PhoneScript[] = {
+  {500000, SNPCONNECT,    0,      24},     // 30 ms connection interval
+  { 10000, SNPMTU,        0,      247},
+  { 10000, SNPREAD,       0xFFF2, 0},      // Time
+  { 10000, SNPWRITE,      0xFFF1, 1},      // PlotState
+  { 10000, SNPCCCD,       0xFFF7, 1},      // notify Steps
+  { 10000, SNPCCCD,       0xFFE1, 1},      // notify Stream
+  { 10000, SNPWRITE,      0xFFE2, 0x0A03}, // stream both, decimation 10
+  {2000000,SNPFAULTBUSY,  0,      3},
+  {2000000,SNPFAULTFCS,   0,      1},
+  {2000000,SNPFAULTPARTIAL,0,     1},
+  {2000000,SNPREAD,       0xFFF4, 0},      // Temperature
+  {2000000,SNPDISCONNECT, 0,      0}
+};
+const uint32_t PhoneScriptSteps = sizeof(PhoneScript)/sizeof(snpstep_t);
+#endif
@@ -0,0 +1,13 @@
+// PhoneScript.h
+// Runs on TM4C123, also compiles on the PC
+// Phone session the SNP emulator plays against Lab 6, see SNP_Emulator.h
+// Lab6.c starts it when SNPEMULATOR is defined, SNPTest.c runs it on the PC
+
+#ifndef __PHONESCRIPT_H
+#define __PHONESCRIPT_H  1
+
+// steps, times in us after the previous step
+extern const snpstep_t PhoneScript[];
+extern const uint32_t PhoneScriptSteps;  // number of steps in PhoneScript
+
+#endif
@@ -0,0 +1,193 @@
+// SNPTest.c
+// Runs on the PC, not part of the Keil project
+// Host test of AP.c against the SNP emulator, Lab 6 phone sessions
+// AP.c, Stream.c and Codec.c are compiled unchanged with SNPEMULATOR defined,
+// SNPHost.c stubs the board; the service has the uuids, sizes and properties
+// of Lab6Gatt in Lab6.c, with test variables and callbacks that log each call
+// gcc -O2 -Wall -Wno-unused-but-set-variable -DSNPEMULATOR -I../inc -o SNPTest SNPTest.c
+//   PhoneScript.c Stream.c Codec.c ../inc/SNPHost.c ../inc/SNP_Emulator.c
+//   ../inc/FCS.c ../inc/Capture.c ../inc/Log.c ../inc/Diag.c
+// SNPTest             (prints the results, exit code 0 if every check passed)
+// -Wno-unused-but-set-variable: AP.c keeps "volatile int r" for the debugger
+// 1) PhoneScript, as Lab6.c plays it, with Task7 and the sample threads
+//    running: every step runs, the reads and writes reach the callbacks,
+//    Stream and Steps notifications go out, the busy, bad FCS and cut short
+//    faults are counted, and the link is still up at the end
+// 2) a capture of a short session, played back into a freshly booted AP with
+//    SNP_Replay: the callbacks run in the same order, with the same values
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "../inc/AP.h"
+#include "../inc/SNP_Emulator.h"
+#include "../inc/SNPHost.h"
+#include "../inc/Capture.h"
+#include "../inc/Diag.h"
+#include "PhoneScript.h"
+#include "Stream.h"
+
+#define TESTMS 12000         // ms PhoneScript runs, it disconnects after 8.55 s
+#define TESTEVENTS 32        // callbacks logged per session
+
+// Lab 6 characteristics, values are only checked, never computed
+uint8_t PlotState;
+uint32_t Time,SoundRMS,LightData,Steps;
+uint8_t TemperatureByteData;
+uint16_t edXNum;
+
+// callback log, one entry per call
+typedef struct{
+  uint16_t uuid;
+  uint8_t write;             // 1 for a write or CCCD callback
+  uint8_t value;             // PlotState after the call
+}event_t;
+event_t Events[TESTEVENTS];
+uint32_t EventCount;
+
+// ****logEvent****
+void static logEvent(uint16_t uuid, uint8_t write){
+  if(EventCount < TESTEVENTS){
+    Events[EventCount].uuid = uuid;
+    Events[EventCount].write = write;
+    Events[EventCount].value = PlotState;
+  }
+  EventCount++;
+}
+void static readPlotState(void){   logEvent(0xFFF1,0); }
+void static writePlotState(void){  logEvent(0xFFF1,1); }
+void static readTime(void){        logEvent(0xFFF2,0); }
+void static readSound(void){       logEvent(0xFFF3,0); }
+void static readTemperature(void){ logEvent(0xFFF4,0); }
+void static readLight(void){       logEvent(0xFFF5,0); }
+void static writeEdXNum(void){     logEvent(0xFFF6,1); }
+void static cccdSteps(void){       logEvent(0xFFF7,1); }
+void static readDiagnostics(void){ logEvent(0xFFF8,0); }
+
+// same uuids, sizes, permissions and properties as Lab6Gatt
+const gatt_t TestGatt[] = {
+  {0xFFF1,1,&PlotState,           0x03, 0x0A, "PlotState",       &readPlotState,   &writePlotState},
+  {0xFFF2,4,&Time,                0x01, 0x02, "Time",            &readTime,        0},
+  {0xFFF3,4,&SoundRMS,            0x01, 0x02, "Sound",           &readSound,       0},
+  {0xFFF4,1,&TemperatureByteData, 0x01, 0x02, "Temperature",     &readTemperature, 0},
+  {0xFFF5,4,&LightData,           0x01, 0x02, "Light",           &readLight,       0},
+  {0xFFF6,2,&edXNum,              0x02, 0x08, "edXNum",          0,                &writeEdXNum},
+  {0xFFF7,2,&Steps,               0x00, 0x10, "Number of Steps", 0,                &cccdSteps},
+  {0xFFF8,4*DIAGCOUNT,DiagSnapshot,0x01, 0x02, "Diagnostics",    &readDiagnostics, 0}
+};
+
+// short session for the capture, no notifications, so it fits in CAPTURESIZE
+const snpstep_t SessionScript[] = {
+  {100000, SNPCONNECT,    0,      40},     // 50 ms connection interval
+  { 10000, SNPMTU,        0,      100},
+  { 10000, SNPREAD,       0xFFF2, 0},      // Time
+  { 10000, SNPWRITE,      0xFFF1, 2},      // PlotState
+  { 10000, SNPCCCD,       0xFFF7, 1},      // notify Steps
+  { 10000, SNPREAD,       0xFFF5, 0},      // Light
+  { 10000, SNPWRITE,      0xFFF1, 3},      // PlotState
+  { 10000, SNPREAD,       0xFFF1, 0},      // PlotState
+  { 10000, SNPDISCONNECT, 0,      0}
+};
+#define SESSIONMS 1000       // ms SessionScript takes, with room to spare
+
+// ****boot****
+// AP_InitStart, AP_InitRun, the services, then the script or replay and advertising
+// Output: APOK or APFAIL
+int static boot(const snpstep_t *script, uint32_t steps, const uint8_t *log, uint32_t size){ int r;
+  AP_InitStart();
+  while((r = AP_InitRun()) == APBUSY){}
+  if(r != APOK) return APFAIL;
+  PlotState = 0;
+  EventCount = 0;
+  if(AP_AddServiceTable(0xFFF0,TestGatt,sizeof(TestGatt)/sizeof(gatt_t)) != APOK) return APFAIL;
+  AP_SetNotifyPolicy(0,APPOLICYCHANGE,0,100,5000); // as Bluetooth_Init
+  Stream_Init();
+  if(Stream_AddService() != APOK) return APFAIL;
+  Capture_Init();                // from advertising on, the bring-up would fill it
+  if(script){
+    SNP_Script(script,steps);
+  }else{
+    SNP_Replay(log,size);
+  }
+  return AP_StartAdvertisement();
+}
+// ****run****
+// ms of Task0, Task1 and Task7, one pass of each per simulated ms
+void static run(uint32_t ms){ uint32_t i,start;
+  start = HostTime;
+  for(i=0; i<ms; i++){
+    if(HostTime < start+1000*i){
+      HostTime = start+1000*i;
+    }
+    Stream_PutSound(512+(i%20));          // Task0
+    if((i%100) == 0){                      // Task1
+      Stream_PutAcc(500,520,700+(i%7));
+      Time++;
+      if((i%1000) == 0) Steps++;
+    }
+    AP_BackgroundProcess();                // Task7
+    AP_NotifyProcess();
+    Stream_Send();
+  }
+}
+// ****check****
+uint32_t static check(int ok, const char *what){
+  if(ok) return 0;
+  printf("  %s\n",what);
+  return 1;
+}
+
+uint8_t Record[CAPTURESIZE];
+event_t Recorded[TESTEVENTS];
+
+int main(void){ uint32_t fails,n,events,recordedCount,errors,i; int r;
+  fails = 0;
+  Host_Init(0);
+  // 1) PhoneScript
+  r = boot(PhoneScript,PhoneScriptSteps,0,0);
+  fails += check(r == APOK,"PhoneScript boot failed");
+  run(TESTMS);
+  printf("PhoneScript: steps done=%u reads=%u writes=%u notifications=%u stream frames=%u\n",
+    (unsigned)SNPStats.scriptDone,(unsigned)SNPStats.reads,(unsigned)SNPStats.writes,
+    (unsigned)SNPStats.notifications,(unsigned)StreamFrames);
+  printf("  fcserr=%u NoSOFErr=%u TimeOutErr=%u faults=%u\n",(unsigned)fcserr,(unsigned)NoSOFErr,
+    (unsigned)TimeOutErr,(unsigned)SNPStats.faults);
+  fails += check(SNPStats.scriptDone == 1,"not every step ran");
+  fails += check(AP_IsConnected() == 0,"still connected after the disconnect");
+  fails += check(SNPStats.faults == 3,"faults not injected");
+  fails += check(fcserr+TimeOutErr >= 2,"spoiled frames not counted");
+  fails += check(PlotState == 1,"PlotState write lost");
+  events = 0;
+  for(i=0; (i<EventCount)&&(i<TESTEVENTS); i++){
+    if((Events[i].uuid == 0xFFF2)&&(Events[i].write == 0)) events |= 1;
+    if((Events[i].uuid == 0xFFF1)&&(Events[i].write == 1)) events |= 2;
+    if((Events[i].uuid == 0xFFF7)&&(Events[i].write == 1)) events |= 4;
+  }
+  fails += check(events == 7,"Time read, PlotState write or Steps CCCD callback missing");
+  fails += check(StreamFrames > 0,"no Stream frames sent");
+  fails += check(SNPStats.notifications > StreamFrames,"no Steps notifications sent");
+  n = SNPStats.framesOut;
+  errors = fcserr+NoSOFErr+TimeOutErr;
+  AP_GetStatus();
+  fails += check((SNPStats.framesOut == n+1)&&(fcserr+NoSOFErr+TimeOutErr == errors),"link down after the faults");
+  // 2) capture of SessionScript, then SNP_Replay of it
+  r = boot(SessionScript,sizeof(SessionScript)/sizeof(snpstep_t),0,0);
+  fails += check(r == APOK,"SessionScript boot failed");
+  run(SESSIONMS);
+  recordedCount = EventCount;
+  memcpy(Recorded,Events,sizeof(Events));
+  fails += check(CaptureLost == 0,"session does not fit in the capture");
+  n = Capture_Copy(Record,sizeof(Record));
+  r = boot(0,0,Record,n);
+  fails += check(r == APOK,"replay boot failed");
+  run(SESSIONMS);
+  printf("SNP_Replay: %u capture bytes, %u callbacks recorded, %u replayed\n",
+    (unsigned)n,(unsigned)recordedCount,(unsigned)EventCount);
+  fails += check(SNPStats.scriptDone == 1,"capture not played to the end");
+  fails += check((recordedCount == 6)&&(recordedCount <= TESTEVENTS),"session callbacks missing");
+  fails += check((EventCount == recordedCount)&&(memcmp(Events,Recorded,sizeof(Events)) == 0),
+    "replay callbacks differ from the recorded ones");
+  fails += check(AP_IsConnected() == 0,"still connected after the replayed disconnect");
+  printf("%s\n",fails ? "FAIL" : "PASS");
+  return fails != 0;
+}
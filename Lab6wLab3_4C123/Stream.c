@@ -0,0 +1,206 @@
+// Stream.c
+// Runs on TM4C123
+// Raw sensor streaming service over Bluetooth
+// Task0 and Task1 put samples into a ring buffer, the Bluetooth
+// thread compresses them into MTU-sized notification frames
+// see Stream.h for the frame format
+
+#include <stdint.h>
+#include "../inc/BSP.h"
+#include "../inc/AP.h"
+#include "Stream.h"
+#include "Codec.h"
+#include "../inc/Diag.h"
+
+// one sample waiting to be sent
+typedef struct{
+  uint8_t type;       // STREAMACC or STREAMSOUND
+  uint16_t time;      // ms, modulo 65536
+  uint16_t data[3];   // AccX,AccY,AccZ or SoundData
+} record_t;
+record_t StreamRing[STREAMSIZE];
+// free running indices, put by the event threads, get by the Bluetooth thread
+volatile uint32_t StreamPutI;
+volatile uint32_t StreamGetI;
+
+uint16_t StreamControl;      // enables and decimation, written by the phone
+uint32_t StreamDrops;        // samples lost because the ring buffer was full
+uint32_t StreamFrames;       // notification frames sent
+uint8_t StreamSeq;           // sequence number of the next frame
+uint32_t StreamDecimate;     // counts microphone samples skipped
+uint32_t StreamIndex;        // notify characteristic index of Stream
+uint8_t StreamFrame[APMAXVALUESIZE]; // frame being sent
+adpcm_t StreamAdpcm;         // microphone encoder, step size carries over between runs
+
+//*************Stream_Init**************
+// Empty the ring buffer, streaming initially stopped
+// Inputs: none
+// Output: none
+void Stream_Init(void){
+  StreamPutI = StreamGetI = 0;
+  StreamControl = 0;
+  StreamDrops = 0;
+  Diag_Register(DIAGSTREAMDROPS, &StreamDrops);
+  StreamFrames = 0;
+  StreamSeq = 0;
+  StreamDecimate = 0;
+  StreamAdpcm.predicted = 0;
+  StreamAdpcm.index = 0;
+}
+
+// ****streamPut****
+// add one record, count a drop if the ring is full
+// called only from the periodic event threads
+void static streamPut(uint8_t type, uint16_t d0, uint16_t d1, uint16_t d2){
+  record_t *r;
+  if((StreamPutI-StreamGetI) >= STREAMSIZE){
+    StreamDrops++;
+    return;
+  }
+  r = &StreamRing[StreamPutI&(STREAMSIZE-1)];
+  r->type = type;
+  r->time = (BSP_Time_Get()/1000)&0xFFFF;
+  r->data[0] = d0;
+  r->data[1] = d1;
+  r->data[2] = d2;
+  StreamPutI++;    // record complete before it becomes visible
+}
+
+//*************Stream_PutAcc**************
+// Queue one accelerometer reading, called from Task1
+// Inputs: x,y,z 10-bit readings
+// Output: none
+void Stream_PutAcc(uint16_t x, uint16_t y, uint16_t z){
+  if(StreamControl&STREAMACC){
+    streamPut(STREAMACC,x,y,z);
+  }
+}
+
+//*************Stream_PutSound**************
+// Offer one microphone sample, called from Task0 at 1 kHz
+// Inputs: data 10-bit reading
+// Output: none
+void Stream_PutSound(uint16_t data){ uint32_t n;
+  if(StreamControl&STREAMSOUND){
+    n = StreamControl>>8;
+    if(n == 0) n = STREAMDECIMATE;
+    StreamDecimate++;
+    if(StreamDecimate >= n){
+      StreamDecimate = 0;
+      streamPut(STREAMSOUND,data,0,0);
+    }
+  }
+}
+
+//*************Stream_Send**************
+// Send queued records as notification frames
+// until the ring is empty or SNP has no buffers free
+// records stay queued until SNP accepts the frame holding them
+// Inputs: none
+// Output: number of frames sent
+uint32_t Stream_Send(void){ uint32_t frames; uint32_t n,k,j,max,i;
+  uint32_t decimation; uint32_t run,runCount; uint16_t prevTime,dt;
+  uint16_t acc[3]; uint8_t buf[16]; uint8_t code;
+  record_t *r;
+  frames = 0;
+  if(AP_GetNotifyCCCD(StreamIndex) == 0) return 0; // phone not listening
+  max = AP_GetMTU()-3;   // ATT notification holds MTU-3 bytes
+  if(max > APMAXVALUESIZE) max = APMAXVALUESIZE;
+  decimation = StreamControl>>8;
+  if(decimation == 0) decimation = STREAMDECIMATE;
+  while(AP_IsConnected()&&(StreamGetI != StreamPutI)){
+    i = StreamGetI;
+    r = &StreamRing[i&(STREAMSIZE-1)];
+    StreamFrame[0] = StreamSeq;
+    StreamFrame[1] = StreamDrops&0xFF;
+    StreamFrame[2] = (StreamDrops>>8)&0xFF;
+    StreamFrame[3] = decimation;
+    StreamFrame[4] = r->time&0xFF;
+    StreamFrame[5] = r->time>>8;
+    n = 6;
+    prevTime = r->time;
+    acc[0] = acc[1] = acc[2] = 0; // first accelerometer record is relative to 0
+    run = 0;                      // index of the open microphone run count, 0 if none
+    runCount = 0;
+    while(i != StreamPutI){
+      r = &StreamRing[i&(STREAMSIZE-1)];
+      dt = r->time-prevTime;
+      if((r->type == STREAMSOUND)&&run&&(runCount < 255)&&(dt == decimation)){
+        // next sample of the open run, one 4-bit code
+        if((runCount&1)&&(n >= max)) break;  // needs a new byte, frame full
+        code = Codec_AdpcmEncode(&StreamAdpcm,Codec_SoundToPCM(r->data[0]));
+        if(runCount&1){
+          StreamFrame[n] = code;              // low nibble first
+          n++;
+        }else{
+          StreamFrame[n-1] |= code<<4;
+        }
+        runCount++;
+        StreamFrame[run] = runCount;
+      }else{
+        // new record, header is time difference and kind
+        k = Codec_PutVarint((dt<<1)|(r->type == STREAMSOUND),buf);
+        if(r->type == STREAMACC){
+          for(j=0; j<3; j++){
+            k = k+Codec_PutVarint(Codec_ZigZag((int32_t)r->data[j]-acc[j]),&buf[k]);
+          }
+        }else{
+          buf[k] = 1;                         // samples in this run
+          buf[k+1] = r->data[0]&0xFF;         // first sample sent as is
+          buf[k+2] = r->data[0]>>8;
+          buf[k+3] = StreamAdpcm.index;       // decoder starts with this step size
+          k = k+4;
+        }
+        if(n+k > max) break;                  // frame full
+        for(j=0; j<k; j++){
+          StreamFrame[n+j] = buf[j];
+        }
+        if(r->type == STREAMACC){
+          acc[0] = r->data[0]; acc[1] = r->data[1]; acc[2] = r->data[2];
+          run = 0;                            // close any open run
+        }else{
+          run = n+k-4;
+          runCount = 1;
+          StreamAdpcm.predicted = Codec_SoundToPCM(r->data[0]);
+        }
+        n = n+k;
+      }
+      prevTime = r->time;
+      i++;
+    }
+    AP_SetNotifyLength(StreamIndex,n);
+    if(AP_SendNotification(StreamIndex) != APOK) break; // busy, retry later
+    StreamGetI = i;  // frame accepted, release its records
+    StreamSeq++;
+    StreamFrames++;
+    frames++;
+  }
+  return frames;
+}
+
+// ****streamWriteControl****
+// called on a SNP Characteristic Write Indication on StreamControl
+// stopping the stream discards whatever is still queued
+void static streamWriteControl(void){
+  if((StreamControl&(STREAMACC|STREAMSOUND)) == 0){
+    StreamGetI = StreamPutI;
+  }
+  StreamDecimate = 0;
+}
+
+//*************Stream_AddService**************
+// Add and register the streaming service 0xFFE0
+// Inputs: none
+// Output: APOK if successful,
+//         APFAIL if SNP failure
+const gatt_t StreamGatt[] = {
+// uuid  size            pt             perm  prop  name             read write
+  {0xFFE1,APMAXVALUESIZE,StreamFrame,   0x00, 0x10, "Stream",        0,   0},
+  {0xFFE2,2,             &StreamControl,0x03, 0x0A, "StreamControl", 0,   &streamWriteControl},
+  {0xFFE3,4,             &StreamDrops,  0x01, 0x02, "StreamDrops",   0,   0}
+};
+int Stream_AddService(void){
+  StreamIndex = NotifyCharacteristicCount;  // Stream is the next notify characteristic
+  if(AP_AddServiceTable(0xFFE0,StreamGatt,sizeof(StreamGatt)/sizeof(gatt_t)) == APFAIL) return APFAIL;
+  return AP_SetNotifyType(StreamIndex,APNOTIFY);   // unacknowledged, full link throughput
+}
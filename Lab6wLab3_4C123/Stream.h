@@ -0,0 +1,76 @@
+// Stream.h
+// Runs on TM4C123
+// Raw sensor streaming service over Bluetooth
+// Timestamped accelerometer and decimated microphone samples
+// are queued in a ring buffer by the periodic event threads and
+// sent to the phone as MTU-sized notification frames
+
+// Stream frame, one notification, all fields little endian
+// byte 0     sequence number, increments by 1 for each frame
+// byte 1,2   total number of samples dropped because the ring was full
+// byte 3     ms between microphone samples (decimation)
+// byte 4,5   time of the first record, BSP_Time_Get in ms, modulo 65536
+// byte 6...  records, as many as fit in MTU-3 bytes, each starting with
+//   varint (dt<<1)+kind, dt is ms since the previous record
+// kind 0 accelerometer record
+//   3 zigzag varints, AccX,AccY,AccZ minus the previous record in this frame (0 for the first)
+// kind 1 microphone run, samples decimation ms apart
+//   count (1 byte), first SoundData (2 bytes), ADPCM step index (1 byte),
+//   count-1 IMA-ADPCM codes, 2 per byte, low nibble first
+// varints hold 7 bits per byte, bit 7 set if more bytes follow
+// Codec_DecodeFrame in Codec.c decodes a frame
+
+#ifndef __STREAM_H
+#define __STREAM_H  1
+
+#define STREAMACC   0x01  // record type and enable bit for accelerometer
+#define STREAMSOUND 0x02  // record type and enable bit for microphone
+// number of records in the ring buffer, must be a power of 2
+#define STREAMSIZE 64
+// default microphone decimation, 1 kHz/10 = 100 Hz
+#define STREAMDECIMATE 10
+
+// StreamControl characteristic, 16-bit number written by the phone
+// bits 7-0   STREAMACC, STREAMSOUND enables, 0 stops the stream
+// bits 15-8  microphone decimation, keep 1 of every N samples, 0 means STREAMDECIMATE
+extern uint16_t StreamControl;
+extern uint32_t StreamDrops;     // samples lost because the ring buffer was full
+extern uint32_t StreamFrames;    // notification frames sent
+
+//*************Stream_Init**************
+// Empty the ring buffer, streaming initially stopped
+// Inputs: none
+// Output: none
+void Stream_Init(void);
+
+//*************Stream_AddService**************
+// Add and register the streaming service 0xFFE0
+// with Stream (notify), StreamControl (read/write) and StreamDrops (read)
+// call after AP_Init and before AP_StartAdvertisement
+// Inputs: none
+// Output: APOK if successful,
+//         APFAIL if SNP failure
+int Stream_AddService(void);
+
+//*************Stream_PutAcc**************
+// Queue one accelerometer reading, called from Task1
+// Inputs: x,y,z 10-bit readings
+// Output: none
+void Stream_PutAcc(uint16_t x, uint16_t y, uint16_t z);
+
+//*************Stream_PutSound**************
+// Offer one microphone sample, called from Task0 at 1 kHz
+// only 1 of every N samples is queued, see StreamControl
+// Inputs: data 10-bit reading
+// Output: none
+void Stream_PutSound(uint16_t data);
+
+//*************Stream_Send**************
+// Send queued records as notification frames
+// until the ring is empty or SNP has no buffers free
+// called from the Bluetooth thread, never blocks
+// Inputs: none
+// Output: number of frames sent
+uint32_t Stream_Send(void);
+
+#endif
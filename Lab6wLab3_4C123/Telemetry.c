@@ -0,0 +1,143 @@
+// Telemetry.c
+// Runs on TM4C123
+// Binary sensor telemetry over UART0, see Telemetry.h for the record format
+// one thread puts and one thread sends, so the ring needs no lock:
+// only Telemetry_Put writes TelemetryPutI, only Telemetry_Send writes TelemetryGetI
+
+#include <stdint.h>
+#include "../inc/BSP.h"
+#include "../inc/UART0.h"
+#include "Telemetry.h"
+#include "../inc/Diag.h"
+
+// one sample waiting to be sent
+typedef struct{
+  uint32_t seq;
+  uint32_t time;     // us
+  telemetry_t data;
+}telemetryrec_t;
+telemetryrec_t TelemetryRing[TELEMETRYSIZE];
+// free running indices
+volatile uint32_t TelemetryPutI;
+volatile uint32_t TelemetryGetI;
+uint32_t TelemetrySeq;    // sequence number of the next sample
+uint32_t TelemetryLost;   // samples dropped, ring full or UART0 busy too long
+uint32_t TelemetrySent;   // records queued on UART0
+
+//*************Telemetry_Init**************
+// Empty the ring buffer, sequence numbers start at 0
+// Inputs: none
+// Output: none
+void Telemetry_Init(void){
+  TelemetryPutI = TelemetryGetI = 0;
+  TelemetrySeq = 0;
+  TelemetryLost = TelemetrySent = 0;
+  Diag_Register(DIAGTELEMETRYLOST, &TelemetryLost);
+}
+
+//*************Telemetry_Put**************
+// Take one sample, a short copy into the ring buffer, never waits
+// Inputs: sample points to the values
+// Output: none
+void Telemetry_Put(const telemetry_t *sample){ telemetryrec_t *rec;
+  TelemetrySeq++;                 // a dropped sample leaves a gap
+  if((TelemetryPutI-TelemetryGetI) >= TELEMETRYSIZE){
+    TelemetryLost++;
+    return;
+  }
+  rec = &TelemetryRing[TelemetryPutI&(TELEMETRYSIZE-1)];
+  rec->seq = TelemetrySeq-1;
+  rec->time = BSP_Time_Get();
+  rec->data = *sample;
+  TelemetryPutI++;                // record complete before it becomes visible
+}
+
+// ****put32****
+// 32-bit number, little endian
+uint8_t static *put32(uint8_t *pt, uint32_t n){
+  pt[0] = n&0xFF;
+  pt[1] = (n>>8)&0xFF;
+  pt[2] = (n>>16)&0xFF;
+  pt[3] = n>>24;
+  return pt+4;
+}
+
+// ****crc16****
+// CRC-16/CCITT, polynomial 0x1021, initial 0xFFFF, bit by bit
+uint16_t static crc16(const uint8_t *pt, uint32_t size){ uint16_t crc; uint32_t i;
+  crc = 0xFFFF;
+  while(size){
+    crc = crc^(*pt<<8);
+    for(i=0; i<8; i++){
+      crc = (crc&0x8000) ? (crc<<1)^0x1021 : crc<<1;
+    }
+    pt++; size--;
+  }
+  return crc;
+}
+
+// ****cobs****
+// Consistent Overhead Byte Stuffing, output has no 0 bytes
+// each code byte n means n-1 data bytes follow, then a 0 unless n is 0xFF
+// Output: number of bytes at out, at most size+1+size/254
+uint32_t static cobs(const uint8_t *in, uint32_t size, uint8_t *out){
+  uint32_t code,i,n;
+  code = 0;         // where the current code byte goes
+  n = 1;
+  for(i=0; i<size; i++){
+    if(in[i] == 0){
+      out[code] = n-code;
+      code = n;
+      n++;
+    }else{
+      out[n] = in[i];
+      n++;
+      if(n-code == 0xFF){
+        out[code] = 0xFF;
+        code = n;
+        n++;
+      }
+    }
+  }
+  out[code] = n-code;
+  return n;
+}
+
+//*************Telemetry_Send**************
+// Frame the waiting samples and queue them on UART0 while there is room
+// a record that does not fit stays in the ring until the next call
+// Inputs: none
+// Output: number of records queued
+uint32_t Telemetry_Send(void){ telemetryrec_t *rec; uint32_t sent,n;
+  uint8_t record[TELEMETRYRECORD],*pt; uint16_t crc;
+  uint8_t frame[TELEMETRYRECORD+3];   // 0, COBS code bytes, record, 0
+  sent = 0;
+  while(TelemetryGetI != TelemetryPutI){
+    if(UART0_Room() < sizeof(frame)) break;
+    rec = &TelemetryRing[TelemetryGetI&(TELEMETRYSIZE-1)];
+    record[0] = TELEMETRYVERSION;
+    pt = put32(&record[1],rec->seq);
+    pt = put32(pt,rec->time);
+    pt = put32(pt,rec->data.magnitude);
+    pt = put32(pt,rec->data.ewma);
+    pt = put32(pt,rec->data.soundRMS);
+    pt = put32(pt,rec->data.lightData);
+    pt = put32(pt,(uint32_t)rec->data.temperature);
+    pt = put32(pt,rec->data.steps);
+    pt = put32(pt,rec->data.lostData);
+    pt = put32(pt,rec->data.lostTask1Data);
+    pt = put32(pt,rec->data.streamDrops);
+    pt = put32(pt,TelemetryLost);
+    crc = crc16(record,TELEMETRYRECORD-2);
+    pt[0] = crc&0xFF;
+    pt[1] = crc>>8;
+    TelemetryGetI++;
+    frame[0] = 0;                     // ends whatever UART0 sent before
+    n = 1+cobs(record,TELEMETRYRECORD,&frame[1]);
+    frame[n] = 0;
+    UART0_Write((const char *)frame,n+1);
+    TelemetrySent++;
+    sent++;
+  }
+  return sent;
+}
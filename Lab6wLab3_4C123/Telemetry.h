@@ -0,0 +1,73 @@
+// Telemetry.h
+// Runs on TM4C123
+// Binary sensor telemetry over UART0 for analysis on the PC
+// Task2 takes a sample after each accelerometer reading, Task3 frames
+// the samples and queues them for UART0 between its switch checks
+// TelemetryDecode.c, compiled on the PC, turns the stream into CSV
+
+// Record, all fields little endian
+// byte 0       TELEMETRYVERSION
+// byte 1-4     sequence number, increments by 1 for each sample taken
+// byte 5-8     BSP_Time_Get when the sample was taken, us
+// byte 9-12    Magnitude
+// byte 13-16   EWMA
+// byte 17-20   SoundRMS
+// byte 21-24   LightData, 100 lux
+// byte 25-28   TemperatureData, 0.1C, signed
+// byte 29-32   Steps
+// byte 33-36   LostData, OS FIFO full
+// byte 37-40   LostTask1Data
+// byte 41-44   StreamDrops
+// byte 45-48   TelemetryLost, samples dropped before they were sent
+// byte 49,50   CRC-16/CCITT (polynomial 0x1021, initial 0xFFFF) of bytes 0-48
+// On UART0 each record is COBS encoded, so it has no 0 bytes, and sent
+// between two 0 bytes; the 0s let the PC find records among the other
+// UART0 output, a gap in the sequence numbers is a lost record
+
+#ifndef __TELEMETRY_H
+#define __TELEMETRY_H  1
+
+// comment out to leave UART0 to the debug log and console
+#define TELEMETRY 1
+#define TELEMETRYVERSION 1
+#define TELEMETRYRECORD 51    // bytes in a record, with the CRC
+// samples waiting for Task3, must be a power of 2
+#define TELEMETRYSIZE 8
+
+// one sample, filled in by Task2
+typedef struct{
+  uint32_t magnitude;
+  uint32_t ewma;
+  uint32_t soundRMS;
+  uint32_t lightData;
+  int32_t  temperature;
+  uint32_t steps;
+  uint32_t lostData;
+  uint32_t lostTask1Data;
+  uint32_t streamDrops;
+}telemetry_t;
+
+extern uint32_t TelemetryLost;   // samples dropped, ring full or UART0 busy too long
+extern uint32_t TelemetrySent;   // records queued on UART0
+
+//*************Telemetry_Init**************
+// Empty the ring buffer, sequence numbers start at 0
+// Inputs: none
+// Output: none
+void Telemetry_Init(void);
+
+//*************Telemetry_Put**************
+// Take one sample, a short copy into the ring buffer, never waits
+// one thread puts, Task2 after the step counter
+// Inputs: sample points to the values
+// Output: none
+void Telemetry_Put(const telemetry_t *sample);
+
+//*************Telemetry_Send**************
+// Frame the waiting samples and queue them on UART0 while there is room
+// one thread sends, Task3, which has time to spare
+// Inputs: none
+// Output: number of records queued
+uint32_t Telemetry_Send(void);
+
+#endif
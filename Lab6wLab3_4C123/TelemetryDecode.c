@@ -0,0 +1,103 @@
+// TelemetryDecode.c
+// Runs on the PC, not part of the Keil project
+// Turns the binary telemetry from Telemetry.c into CSV, one line per record
+// gcc -o TelemetryDecode TelemetryDecode.c
+// TelemetryDecode < capture.bin > telemetry.csv   (bytes saved from the UART0 serial port)
+// records are found between 0 bytes, anything else on UART0, such as the
+// debug log or console text, fails the length or CRC check and is skipped
+// lost records are counted from gaps in the sequence numbers,
+// a sequence number that goes backwards is a reset of the board,
+// the counts go to stderr so they do not mix with the CSV
+// CSV only; tools that want Parquet can convert the CSV
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define TELEMETRYVERSION 1     // same as Telemetry.h
+#define TELEMETRYRECORD 51
+#define MAXFRAME 256           // longer runs without a 0 are not records
+
+// ****get32****
+// 32-bit number, little endian
+uint32_t static get32(const uint8_t *pt){
+  return pt[0]+(pt[1]<<8)+(pt[2]<<16)+((uint32_t)pt[3]<<24);
+}
+
+// ****crc16****
+// CRC-16/CCITT, polynomial 0x1021, initial 0xFFFF, same as Telemetry.c
+uint16_t static crc16(const uint8_t *pt, int size){ uint16_t crc; int i;
+  crc = 0xFFFF;
+  while(size){
+    crc = crc^(*pt<<8);
+    for(i=0; i<8; i++){
+      crc = (crc&0x8000) ? (crc<<1)^0x1021 : crc<<1;
+    }
+    pt++; size--;
+  }
+  return crc;
+}
+
+// ****uncobs****
+// undo Consistent Overhead Byte Stuffing
+// Output: number of bytes at out, -1 if the frame is not valid COBS
+int static uncobs(const uint8_t *in, int size, uint8_t *out){ int i,j,code,n;
+  i = n = 0;
+  while(i < size){
+    code = in[i];
+    if((code == 0)||(i+code > size)) return -1;
+    i++;
+    for(j=1; j<code; j++){
+      out[n] = in[i];
+      n++; i++;
+    }
+    if((code != 0xFF)&&(i < size)){
+      out[n] = 0;
+      n++;
+    }
+  }
+  return n;
+}
+
+int main(void){ int c,size,n; uint8_t frame[MAXFRAME],record[MAXFRAME];
+  uint32_t seq,next; long records = 0,lost = 0,bad = 0,restarts = 0; int first = 1;
+  printf("seq,time_us,magnitude,ewma,sound_rms,light,temperature,steps,"
+         "lost_data,lost_task1_data,stream_drops,telemetry_lost\n");
+  size = 0;
+  next = 0;
+  while((c = getchar()) != EOF){
+    if(c != 0){
+      if(size < MAXFRAME) frame[size] = c;
+      size++;
+      continue;
+    }
+    if(size == 0) continue;        // the 0 in front of each record
+    n = (size <= MAXFRAME) ? uncobs(frame,size,record) : -1;
+    size = 0;
+    if((n != TELEMETRYRECORD)||(record[0] != TELEMETRYVERSION)||
+       (crc16(record,TELEMETRYRECORD-2) != record[49]+(record[50]<<8))){
+      bad++;                       // other UART0 output, or a damaged record
+      continue;
+    }
+    seq = get32(&record[1]);
+    if(first == 0){
+      if(seq >= next){
+        lost += seq-next;
+      }else{
+        restarts++;                // the board was reset
+      }
+    }
+    first = 0;
+    next = seq+1;
+    records++;
+    printf("%lu,%lu,%lu,%lu,%lu,%lu,%ld,%lu,%lu,%lu,%lu,%lu\n",
+      (unsigned long)seq,(unsigned long)get32(&record[5]),
+      (unsigned long)get32(&record[9]),(unsigned long)get32(&record[13]),
+      (unsigned long)get32(&record[17]),(unsigned long)get32(&record[21]),
+      (long)(int32_t)get32(&record[25]),(unsigned long)get32(&record[29]),
+      (unsigned long)get32(&record[33]),(unsigned long)get32(&record[37]),
+      (unsigned long)get32(&record[41]),(unsigned long)get32(&record[45]));
+  }
+  fprintf(stderr,"%ld records, %ld lost, %ld other frames skipped, %ld restarts\n",
+    records,lost,bad,restarts);
+  return 0;
+}
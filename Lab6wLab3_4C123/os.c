@@ -8,6 +8,7 @@
 #include "os.h"
 #include "CortexM.h"
 #include "BSP.h"
+#include "Diag.h"
 
 // function definitions in osasm.s
 void StartOS(void);
@@ -308,6 +309,7 @@ void OS_FIFO_Init(void){
   OS_InitSemaphore(&CurrentSize, 0);
   OS_InitSemaphore(&FifoMutex, 1);
   LostData    = 0;
+  Diag_Register(DIAGLOSTDATA, &LostData);
 }
 
 // ******** OS_FIFO_Put ************
@@ -106,6 +106,8 @@ void OS_Wait(int32_t *semaPt);
 // Outputs: none
 void OS_Signal(int32_t *semaPt);
 
+extern uint32_t LostData;  // number of times OS_FIFO_Put found the FIFO full
+
 // ******** OS_FIFO_Init ************
 // Initialize FIFO.  
 // One event thread producer, one main thread consumer
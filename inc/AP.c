@@ -56,28 +56,57 @@
 #include "../inc/AP.h"
 #include "../inc/tm4c123gh6pm.h"
 #include "../inc/GPIO.h"
+#include "../inc/BSP.h"
+#include "../inc/FCS.h"
+#include "../inc/Diag.h"
+#include "../inc/SNP_Emulator.h"
+#ifdef APCAPTURE
+#include "../inc/Capture.h"
+#else
+#define Capture_Init()
+#define Capture_Frame(FLAGS,PT,SIZE)
+#define Capture_Spans(FLAGS,CMD0,CMD1,SPANS,COUNT)
+#endif
 
 
-const uint32_t RECVSIZE=128;
-uint8_t RecvBuf[RECVSIZE];
+#define APRECVSIZE 128
+#define APDISCARD 16       // bytes read at a time when a frame is larger than the buffer
+const uint32_t RECVSIZE=APRECVSIZE;
+uint8_t RecvBuf[APRECVSIZE];
 
 uint32_t fcserr;      // debugging counts of errors
 uint32_t TimeOutErr;  // debugging counts of no response errors
 uint32_t NoSOFErr;    // debugging counts of no SOF errors
+uint32_t APFailStreak; // failed exchanges in a row, AP_Supervise resets the SNP at APFAILLIMIT
+uint8_t APQuiet;      // 1 to skip the APDEBUG log, set while adding a GATT table
+uint32_t APBootStart;       // BSP_Time_Get when AP_Init started, us
+uint32_t APBootReady;       // BSP_Time_Get when SNP powered up after reset, us
+uint32_t APBootAdvertising; // BSP_Time_Get when advertising started, us
+
+// services added by AP_AddServiceTable, replayed by AP_Supervise after an SNP reset
+typedef struct{
+  uint16_t uuid;
+  const gatt_t *table;
+  uint32_t count;
+}service_t;
+service_t APServiceList[APMAXSERVICES];
+uint32_t APServiceCount;
+uint8_t APReplaying;    // 1 while AP_Supervise adds the services again
+uint8_t APRecovering;   // 1 while AP_Supervise waits for the SNP to power up again
 
 #define APTIMEOUT 40000   // 10 ms
+void static AP_HandlersInit(void);
+void static AP_CharacteristicsInit(void);
 
 //**debug macros**APDEBUG defined in AP.h********
 #ifdef APDEBUG
-#define OutString(STRING) UART0_OutString(STRING)
-#define OutUHex(NUM) UART0_OutUHex(NUM)
-#define OutUHex2(NUM) UART0_OutUHex2(NUM)
-#define OutChar(N) UART0_OutChar(N)
+#include "../inc/Log.h"
 #else
-#define OutString(STRING)
-#define OutUHex(NUM)
-#define OutUHex2(NUM)
-#define OutChar(N)
+#define Log_Init()
+#define Log_Event(ID)
+#define Log_Value(ID,VALUE)
+#define Log_Bytes(ID,PT,SIZE)
+#define Log_Spans(CMD0,CMD1,SPANS,COUNT)
 #endif
 
 //------------AP_Reset------------
@@ -92,24 +121,14 @@ void AP_Reset(void){
   SetReset();     // RESET=1  
 }
 //*************message and message fragments**********
-const uint8_t HCI_EXT_ResetSystemCmd[] = {SOF,0x03,0x00,0x55,0x04,0x1D,0xFC,0x01,0xB2};
-const uint8_t NPI_GetStatus[] =   {SOF,0x00,0x00,0x55,0x06,0x53};
-const uint8_t NPI_GetVersion[] =  {SOF,0x00,0x00,0x35,0x03,0x36};
-uint8_t NPI_AddService[] = {
-  SOF,3,0x00,     // length = 3
-  0x35,0x81,      // SNP Add Service
-  0x01,           // Primary Service
-  0xF0,0xFF,
-  0xB9};          // FCS (calculated by AP_SendMessageResponse)
-
-const uint8_t NPI_Register[] = {   
-  SOF,0x00,0x00,  // length = 0
-  0x35,0x84,      // SNP Register Service
-  0x00};          // FCS (calculated by AP_SendMessageResponse)
+// constant frames are built by NPI_FRAME in AP.h, which counts the length and FCS
+const uint8_t HCI_EXT_ResetSystemCmd[] = NPI_FRAME(0x55,0x04,0x1D,0xFC,0x01);
+const uint8_t NPI_GetStatus[] =   NPI_FRAME0(0x55,0x06);
+const uint8_t NPI_GetVersion[] =  NPI_FRAME0(0x35,0x03);
+const uint8_t NPI_Register[] = NPI_FRAME0(0x35,0x84); // SNP Register Service
 
 // call Set Advertisement twice 0, 2
-const uint8_t NPI_SetAdvertisement1[] = {   
-  SOF,11,0x00,    // length = 11
+const uint8_t NPI_SetAdvertisement1[] = NPI_FRAME(
   0x55,0x43,      // SNP Set Advertisement Data
   0x01,           // Not connected Advertisement Data
   0x02,0x01,0x06, // GAP_ADTYPE_FLAGS,DISCOVERABLE | no BREDR
@@ -117,10 +136,8 @@ const uint8_t NPI_SetAdvertisement1[] = {
   0x0D ,0x00,     // Texas Instruments Company ID
   0x03,           // TI_ST_DEVICE_ID
   0x00,           // TI_ST_KEY_DATA_ID
-  0x00,           // Key state
-  0xEE};          // FCS (calculated by AP_SendMessageResponse)
-const uint8_t NPI_SetAdvertisementSAP[] = {   
-  SOF,31,0x00,    // length = 31
+  0x00);          // Key state
+const uint8_t NPI_SetAdvertisementSAP[] = NPI_FRAME(
   0x55,0x43,      // SNP Set Advertisement Data
   0x00,           // Scan Response Data
   20,0x09,        // length, type=LOCAL_NAME_COMPLETE
@@ -133,19 +150,15 @@ const uint8_t NPI_SetAdvertisementSAP[] = {
 // Tx power level
   0x02,           // length of this data
   0x0A,           // GAP_ADTYPE_POWER_LEVEL
-  0x00,           // 0dBm
-  0x77};          // FCS (calculated by AP_SendMessageResponse)
+  0x00);          // 0dBm
 
-uint8_t NPI_GATTSetDeviceName[] = {   
-  SOF,22,0x00,    // length = 22
+const uint8_t NPI_GATTSetDeviceName[] = NPI_FRAME(
   0x35,0x8C,      // SNP Set GATT Parameter (0x8C)
   0x01,           // Generic Access Service
   0x00,0x00,      // Device Name
-  'S','h','a','p','e',' ','t','h','e',' ','W','o','r','l','d',' ','0','0','1',
-  0x77};          // FCS (calculated by AP_SendMessageResponse)
+  'S','h','a','p','e',' ','t','h','e',' ','W','o','r','l','d',' ','0','0','1');
 
-uint8_t NPI_SetAdvertisementData[] = {   
-  SOF,31,0x00,    // length = 32
+const uint8_t NPI_SetAdvertisementData[] = NPI_FRAME(
   0x55,0x43,      // SNP Set Advertisement Data
   0x00,           // Scan Response Data
   20,0x09,        // length, type=LOCAL_NAME_COMPLETE
@@ -158,11 +171,9 @@ uint8_t NPI_SetAdvertisementData[] = {
 // Tx power level
   0x02,           // length of this data
   0x0A,           // GAP_ADTYPE_POWER_LEVEL
-  0x00,           // 0dBm
-  0x77};          // FCS (calculated by AP_SendMessageResponse)
+  0x00);          // 0dBm
   
-const uint8_t NPI_StartAdvertisement[] = {   
-  SOF,14,0x00,    // length = 14
+const uint8_t NPI_StartAdvertisement[] = NPI_FRAME(
   0x55,0x42,      // SNP Start Advertisement
   0x00,           // Connectable Undirected Advertisements
   0x00,0x00,      // Advertise infinitely.
@@ -170,109 +181,169 @@ const uint8_t NPI_StartAdvertisement[] = {
   0x00,           // Filter Policy RFU
   0x00,           // Initiator Address Type RFU
   0x00,0x01,0x00,0x00,0x00,0xC5, // RFU
-  0x02,           // Advertising will restart with connectable advertising when a connection is terminated
-  0xBB};          // FCS (calculated by AP_SendMessageResponse)
-uint8_t NPI_ReadConfirmation[] = {   
-  SOF,0x08,0x00,  // length = 8 (7+data length, filled in dynamically)
-  0x55,0x87,      // SNP Characteristic Read Confirmation (0x87)
-  0x00,           // Success
-  0x00,0x00,      // handle of connection always 0
-  0x00,0x00,      // Handle of the characteristic value attribute being read (filled in dynamically
-  0x00,0x00,      // offset, ignored, assumes small chucks of data
-  0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,  // actual data (filled in dynamically)
-  0x00};          // FCS (calculated by AP_SendMessageResponse)
-uint8_t NPI_WriteConfirmation[] = {   
-  SOF,0x03,0x00,  // length = 3
+  0x02);          // Advertising will restart with connectable advertising when a connection is terminated
+// the preprocessor checks NPI_FRAME against frames once typed by hand,
+// NPIFrameTest.c compares every frame with the AP_Lab6.c builders on the PC
+NPI_ASSERT(NPI_FCS0(0x55,0x06)==0x53,NPI_GetStatus_FCS);
+NPI_ASSERT(NPI_FCS0(0x35,0x03)==0x36,NPI_GetVersion_FCS);
+NPI_ASSERT(NPI_FCS(0x55,0x04,0x1D,0xFC,0x01)==0xB2,HCI_EXT_ResetSystemCmd_FCS);
+NPI_ASSERT(sizeof(HCI_EXT_ResetSystemCmd)==NPI_FRAMESIZE(3),HCI_EXT_ResetSystemCmd_size);
+NPI_ASSERT(sizeof(NPI_SetAdvertisement1)==NPI_FRAMESIZE(11),NPI_SetAdvertisement1_size);
+NPI_ASSERT(sizeof(NPI_StartAdvertisement)==NPI_FRAMESIZE(14),NPI_StartAdvertisement_size);
+// advertising and scan response data hold at most 31 bytes after the type byte
+NPI_ASSERT(sizeof(NPI_SetAdvertisementData)<=NPI_FRAMESIZE(1+31),NPI_SetAdvertisementData_size);
+NPI_ASSERT(sizeof(NPI_SetAdvertisementSAP)<=NPI_FRAMESIZE(1+31),NPI_SetAdvertisementSAP_size);
+const uint8_t NPI_WriteConfirmation[] = NPI_FRAME(
   0x55,0x88,      // SNP Characteristic Write Confirmation
   0x00,           // Success
-  0x00,0x00,      // handle of connection always 0
-  0xDE};          // FCS (calculated by AP_SendMessageResponse)
-uint8_t NPI_CCCDUpdatedConfirmation[] = {   
-  SOF,0x03,0x00,  // length = 3
+  0x00,0x00);     // handle of connection always 0
+const uint8_t NPI_CCCDUpdatedConfirmation[] = NPI_FRAME(
   0x55,0x8B,      // SNP CCCD Updated Confirmation (0x8B)
   0x00,           // Success
-  0x00,0x00,      // handle of connection always 0
-  0xDD};          // FCS (calculated by AP_SendMessageResponse)
-uint8_t NPI_SendNotificationIndication[] = {   
-  SOF,0x07,0x00,  // length = 7 to 14 depending on data size
-  0x55,0x89,      // SNP Send Notification Indication (0x89))
-  0x00,0x00,      // handle of connection always 0
-  0x00,0x00,      // Handle of the characteristic value attribute to notify / indicate (filled in dynamically
-  0x00,           // RFU
-  0x01,           // Indication Request type
-  0x00,0,0,0,0,0,0,0, // 1 to 8 bytes of data filled in dynamically
-  0xDD};      // FCS (calculated by AP_SendMessageResponse)
-
-uint8_t NPI_AddCharValue[] = {   
-  SOF,0x08,0x00,  // length = 8
-  0x35,0x82,      // SNP Add Characteristic Value Declaration
-  0x03,           // 0=none,1=read,2=write, 3=Read+write, GATT Permission
-  0x0A,0x00,      // 2=read,8=write,0x0A=read+write,0x10=notify, GATT Properties
-  0x00,           // RFU
-  0x00,0x02,      // Maximum length of the attribute value=512
-  0xF1,0xFF,      // UUID
-  0xBA};          // FCS (calculated by AP_SendMessageResponse)
-uint8_t NPI_AddCharDescriptor[] = {   
-  SOF,0x17,0x00,  // length determined at run time 6+string length
-  0x35,0x83,      // SNP Add Characteristic Descriptor Declaration
-  0x80,           // User Description String
-  0x01,           // GATT Read Permissions
-  0x11,0x00,      // Maximum Possible length of the user description string
-  0x11,0x00,      // Initial length of the user description string
-  'C','h','a','r','a','c','t','e','r','i','s','t','i','c',' ','0',0, // Initial user description string
-  0x0C,0,0,0};    // FCS (calculated by AP_SendMessageResponse)
+  0x00,0x00);     // handle of connection always 0
+// frames that carry user data or handles are sent by AP_SendSpans
+// straight from a small header on the stack and the user variable
 
-//------------AP_Init------------
+// SNP bring-up, run by AP_InitRun one step at a time
+#define APBOOTRESET    0  // RESET held low
+#define APBOOTPOWERUP  1  // waiting for the power up indication after the hardware reset
+#define APBOOTSYSRESET 2  // waiting for the power up indication after HCI_EXT_ResetSystemCmd
+#define APBOOTREADY    3  // SNP ready for commands
+#define APBOOTFAIL     4  // gave up
+#define APRESETLOW     10000   // us RESET is held low
+#define APPOWERUPWAIT  100000  // us to wait for power up after a hardware reset
+#define APSYSRESETWAIT 200000  // us to wait for power up after the software reset
+#define APRESETTRIES   10      // hardware resets before giving up
+uint8_t APBootState;    // APBOOTRESET to APBOOTFAIL
+uint32_t APBootTime;    // BSP_Time_Get when the current state was entered, us
+uint32_t APBootTries;   // hardware resets so far
+
+// ****bootReset****
+// start a hardware reset, RESET released later by AP_InitRun
+void static bootReset(void){
+  ClearReset();   // RESET=0    
+  SetMRDY();      // MRDY=1  
+  APBootState = APBOOTRESET;
+  APBootTime = BSP_Time_Get();
+}
+// ****bootPowerUp****
+// check for the SNP Power Up Indication (0x55,0x01), never waits
+// Output: 1 if it arrived, 0 if not
+int static bootPowerUp(void){
+  if(AP_RecvStatus()){
+    if((AP_RecvMessage(RecvBuf,RECVSIZE)==APOK)&&(RecvBuf[3]==0x55)&&(RecvBuf[4]==0x01)){
+      return 1;
+    }
+  }
+  return 0;
+}
+
+//------------AP_InitStart------------
 // Initialize serial link and GPIO to Bluetooth module
-// see GPIO.c file for hardware connections 
-// reset the Bluetooth module and initialize connection
+// and begin the hardware reset, returns at once
+// call AP_InitRun until it returns APOK or APFAIL
 // Input: none
-// Output: APOK on success, APFAIL on timeout
-int AP_Init(void){int bwaiting;   int count = 0;
+// Output: none
+void AP_InitStart(void){
   GPIO_Init(); // MRDY, SRDY, reset
 #ifdef APDEBUG
   if(UART0_CTL_R != 0x301){
     UART0_Init(); // if not on, enable
   }
-  UART0_OutString("\n\rReset CC2650");
+  Log_Init();
+  Log_Event(LOGRESET);
 #endif
   UART1_Init();
+  if((WTIMER5_CTL_R&0x0100) == 0){ // TBEN, main may have started the clock already
+    BSP_Time_Init(); // microsecond time for timeouts and notification flow control
+  }
+  Capture_Init();
+  APBootStart = BSP_Time_Get();
+  APBootReady = APBootAdvertising = 0;
   fcserr = 0;     // number of packets with FCS errors
+  APFailStreak = 0;
+  APRecovering = 0;
   TimeOutErr = 0; // debugging counts of no response error
   NoSOFErr =0 ;   // debugging counts of no SOF error
-  bwaiting = 1; // waiting for reset
-  while(bwaiting){
-    AP_Reset();
-    count = 0;  // should get SNP power up within 30 ms (duration is arbitrary and 'count' value is uncalibrated)
-    while(count < 600000){
-      if(AP_RecvStatus()){
-        AP_RecvMessage(RecvBuf,RECVSIZE);
-        if((RecvBuf[3]==0x55)&&(RecvBuf[4]==0x01)){
-          count = 600000;
-          bwaiting = 0; // success
+  Diag_Register(DIAGFCSERR, &fcserr);
+  Diag_Register(DIAGTIMEOUTERR, &TimeOutErr);
+  Diag_Register(DIAGNOSOFERR, &NoSOFErr);
+  Diag_Register(DIAGRECOVERFAILS, &APRecoverFails);
+  AP_HandlersInit(); // default frame handlers, link down
+  AP_CharacteristicsInit(); // no characteristics on a freshly reset SNP
+  APServiceCount = 0;
+  APBootTries = 0;
+  bootReset();
+}
+
+//------------AP_InitRun------------
+// Take the next step of the SNP bring-up started by AP_InitStart
+// never waits, so it can be called from a thread that yields in between
+// 1) hold RESET low 10 ms
+// 2) wait up to 100 ms for power up, else reset again, at most 10 times
+// 3) send HCI_EXT_ResetSystemCmd, wait up to 200 ms for power up
+// Input: none
+// Output: APBUSY while in progress, APOK when ready, APFAIL on timeout
+int AP_InitRun(void){ uint32_t now;
+#ifdef APDEBUG
+  Log_Drain();
+#endif
+  now = BSP_Time_Get();
+  switch(APBootState){
+    case APBOOTRESET:
+      if((now-APBootTime) >= APRESETLOW){
+        SetReset();     // RESET=1  
+        APBootState = APBOOTPOWERUP;
+        APBootTime = now;
+      }
+      return APBUSY;
+    case APBOOTPOWERUP:
+      if(bootPowerUp()){
+        AP_SendMessageResponse((uint8_t*)HCI_EXT_ResetSystemCmd,RecvBuf,RECVSIZE); 
+        APBootState = APBOOTSYSRESET;
+        APBootTime = BSP_Time_Get();
+      }else if((now-APBootTime) >= APPOWERUPWAIT){
+        APBootTries++;
+        if(APBootTries >= APRESETTRIES){
+          TimeOutErr++;  // no response error
+          APBootState = APBOOTFAIL;
+          return APFAIL;
         }
+        bootReset();
       }
-      count = count + 1;
-    }
-  } 
-  AP_SendMessageResponse((uint8_t*)HCI_EXT_ResetSystemCmd,RecvBuf,RECVSIZE); 
-  count = 0;  // should get SNP power up within 120 ms (duration is arbitrary and 'count' value is uncalibrated)
-  bwaiting = 1; // waiting for SNP power up
-  while(count < 6000000){
-    if(AP_RecvStatus()){
-      AP_RecvMessage(RecvBuf,RECVSIZE);
-      if((RecvBuf[3]==0x55)&&(RecvBuf[4]==0x01)){
-        count = 6000000;
-        bwaiting = 0; // success
+      return APBUSY;
+    case APBOOTSYSRESET:
+      if(bootPowerUp()){
+        APBootReady = BSP_Time_Get();
+        APBootState = APBOOTREADY;
+        return APOK;
       }
-    }
-    count = count + 1;
-  } 
-  if(bwaiting){
-    TimeOutErr++;  // no response error
-    return APFAIL;
-  }  
-  return APOK;
+      if((now-APBootTime) >= APSYSRESETWAIT){
+        TimeOutErr++;  // no response error
+        APBootState = APBOOTFAIL;
+        return APFAIL;
+      }
+      return APBUSY;
+    case APBOOTREADY:
+      return APOK;
+  }
+  return APFAIL;
+}
+
+//------------AP_Init------------
+// Initialize serial link and GPIO to Bluetooth module
+// see GPIO.c file for hardware connections 
+// reset the Bluetooth module and initialize connection
+// busy-waits for the whole bring-up, see AP_InitStart to overlap it with other work
+// call with interrupts enabled, the replies arrive through UART1_Handler
+// Input: none
+// Output: APOK on success, APFAIL on timeout
+int AP_Init(void){ int r;
+  AP_InitStart();
+  do{
+    r = AP_InitRun();
+  }while(r == APBUSY);
+  return r;
 }
 //***********AP_GetSize***************
 // returns the size of an NPI message
@@ -290,49 +361,43 @@ uint32_t AP_GetSize(uint8_t *pt){
 
 #ifdef APDEBUG
 // *****AP_EchoSendMessage**************
-// For debugging, sends message to UART0
+// For debugging, logs message for UART0, see Log.h
 // Inputs:  pointer to message 
 // Outputs: none
-void AP_EchoSendMessage(uint8_t *sendMsg){ int i;uint8_t fcs;
-  uint32_t size=AP_GetSize(sendMsg);
-  fcs = 0;
-  for(i=1;i<size+5;i++)fcs = fcs^sendMsg[i];
-  OutString("\n\rLP->SNP ");
-  for(i=0; i<=(4+size); i++){ 
-    OutUHex2(sendMsg[i]); OutChar(',');
-  }
-  OutUHex2(fcs); //  FCS, calculated and not in messsage
+void AP_EchoSendMessage(uint8_t *sendMsg){
+  Log_Bytes(LOGTX,sendMsg,AP_GetSize(sendMsg)+5); // FCS is calculated by LogDecode
 }
 // *****AP_EchoReceived**************
-// for debugging, sends RecvBuf from SNP to UART0
+// for debugging, logs RecvBuf from SNP for UART0
 // Inputs:  result APOK or APFAIL
 // Outputs: none
-void AP_EchoReceived(int response){ uint32_t size; int i;
+void AP_EchoReceived(int response){ uint32_t size;
   if(response==APOK){
-    OutString("\n\rSNP->LP ");
-    size = AP_GetSize(RecvBuf);
-    for(i=0; i<=(4+size); i++){ 
-      OutUHex2(RecvBuf[i]); OutChar(',');
-    }
-    OutUHex2(RecvBuf[i]); // FCS
+    size = AP_GetSize(RecvBuf)+6;
+    if(size > RECVSIZE) size = RECVSIZE;
+    Log_Bytes(LOGRX,RecvBuf,size);
   }else{
-    OutString("\n\rfrom SNP fail");
+    Log_Event(LOGRXFAIL);
   }
 }
+// *****AP_EchoSendSpans**************
+// For debugging, logs a message gathered from pieces for UART0
+// Inputs:  cmd0, cmd1, spans, count as in AP_SendSpans
+// Outputs: none
+void AP_EchoSendSpans(uint8_t cmd0, uint8_t cmd1, const span_t *spans, uint32_t count){
+  Log_Spans(cmd0,cmd1,spans,count);
+}
 #else
 #define AP_EchoSendMessage(MESSAGE)
+#define AP_EchoSendSpans(CMD0,CMD1,SPANS,COUNT)
 #define AP_EchoReceived(R)
 #endif
-//------------AP_SendMessage------------
-// sends a message to the Bluetooth module
-// calculates/sends FCS at end 
-// FCS is the 8-bit EOR of all bytes except SOF and FCS itself
-// 1) Send NPI package (it will calculate fcs)
-// 2) Wait for entire message to be sent
-// Input: pointer to NPI encoded array
+// ****sendBegin****
+// steps 1,2 of a send, make MRDY=0 and wait for SRDY to be low
+// the SRDY edge interrupt is masked, the SNP answering is not a new frame
 // Output: APOK on success, APFAIL on timeout
-int AP_SendMessage(uint8_t *pt){
-  uint8_t fcs; uint32_t waitCount; uint8_t data; uint32_t size;
+int static sendBegin(void){ uint32_t waitCount;
+  GPIO_SRDYDisarm();  // the Bluetooth thread arms it again before it blocks
 // 1) Make MRDY=0
   ClearMRDY();
 // 2) wait for SRDY to be low
@@ -341,22 +406,16 @@ int AP_SendMessage(uint8_t *pt){
     waitCount++;
     if(waitCount>APTIMEOUT){
       TimeOutErr++;  // no response error
+      APFailStreak++;
       return APFAIL; // timeout??
     } 
   }
-// 3) Send NPI package
-  size = AP_GetSize(pt);
-  fcs=0;
-  UART1_OutChar(SOF); pt++;
-  data=*pt; UART1_OutChar(data); fcs=fcs^data; pt++;   // LSB length
-  data=*pt; UART1_OutChar(data); fcs=fcs^data; pt++;   // MSB length
-  data=*pt; UART1_OutChar(data); fcs=fcs^data; pt++;   // CMD0
-  data=*pt; UART1_OutChar(data); fcs=fcs^data; pt++;   // CMD1
-  for(int i=0;i<size;i++){
-    data=*pt; UART1_OutChar(data); fcs=fcs^data; pt++; // payload
-  }
-  UART1_OutChar(fcs);                                  // FCS
-  
+  return APOK;
+}
+// ****sendEnd****
+// steps 4,5,6 of a send, wait for the bytes to go out, make MRDY=1, wait for SRDY high
+// Output: APOK on success, APFAIL on timeout
+int static sendEnd(void){ uint32_t waitCount;
 // 4) Wait for entire message to be sent
   UART1_FinishOutput();
 // 5) Make MRDY=1
@@ -367,11 +426,80 @@ int AP_SendMessage(uint8_t *pt){
     waitCount++;
     if(waitCount>APTIMEOUT){
       TimeOutErr++;  // no response error
+      APFailStreak++;
       return APFAIL; // timeout??
     } 
   }
   return APOK;
 }
+//------------AP_SendMessage------------
+// sends a message to the Bluetooth module
+// calculates/sends FCS at end 
+// FCS is the 8-bit EOR of all bytes except SOF and FCS itself
+// 1) Send NPI package (it will calculate fcs)
+// 2) Wait for entire message to be sent
+// Input: pointer to NPI encoded array
+// Output: APOK on success, APFAIL on timeout
+int AP_SendMessage(uint8_t *pt){
+  uint8_t fcs; uint32_t size; uint8_t *frame; int result;
+  size = AP_GetSize(pt);
+  fcs = FCS_Frame(pt);       // word at a time, while SRDY is still on its way
+  frame = pt;
+  if(sendBegin() == APFAIL){
+    Capture_Frame(CAPTUREFAIL,frame,size+6);
+    return APFAIL;
+  }
+// 3) Send NPI package
+  UART1_OutBuffer(pt,size+5);  // SOF, length, command and payload, by uDMA if enabled
+  UART1_OutChar(fcs);                                  // FCS
+  result = sendEnd();
+  Capture_Frame((result == APOK) ? 0 : CAPTUREFAIL,frame,size+6);
+  return result;
+}
+
+//------------AP_SendSpans------------
+// send a message to the Bluetooth module, gathered from several pieces
+// the FCS is computed over the spans with FCS_Update before the frame starts,
+// so the bytes go out back to back, nothing is copied
+// Input: cmd0, cmd1 NPI command
+//        spans points to the payload pieces, in the order sent
+//        count is the number of pieces, 0 for no payload
+// Output: APOK on success, APFAIL on timeout
+int AP_SendSpans(uint8_t cmd0, uint8_t cmd1, const span_t *spans, uint32_t count){
+  uint8_t fcs; uint32_t size,i,j; const uint8_t *pt; int result;
+  size = 0;
+  for(i=0; i<count; i++){
+    size = size+spans[i].size;
+  }
+  fcs = (size&0xFF)^(size>>8)^cmd0^cmd1;
+  for(i=0; i<count; i++){
+    fcs = FCS_Update(fcs,spans[i].pt,spans[i].size); // XOR is the same in either order
+  }
+  if(sendBegin() == APFAIL){
+    Capture_Spans(CAPTUREFAIL,cmd0,cmd1,spans,count);
+    return APFAIL;
+  }
+// 3) Send NPI package
+  UART1_OutChar(SOF);
+  UART1_OutChar(size&0xFF);                            // LSB length
+  UART1_OutChar(size>>8);                              // MSB length
+  UART1_OutChar(cmd0);
+  UART1_OutChar(cmd1);
+  for(i=0; i<count; i++){
+    pt = spans[i].pt;
+    if(spans[i].reverse){
+      for(j=spans[i].size; j>0; j--){
+        UART1_OutChar(pt[j-1]);  // number, most significant first
+      }
+    }else{
+      UART1_OutBuffer(pt,spans[i].size); // bytes in memory order
+    }
+  }
+  UART1_OutChar(fcs);                                  // FCS
+  result = sendEnd();
+  Capture_Spans((result == APOK) ? 0 : CAPTUREFAIL,cmd0,cmd1,spans,count);
+  return result;
+}
 
 
   
@@ -384,14 +512,17 @@ int AP_SendMessage(uint8_t *pt){
 // Output: APOK if ok, APFAIL on error (timeout or fcs error)
 int AP_RecvMessage(uint8_t *pt, uint32_t max){
   uint8_t fcs; uint32_t waitCount; uint8_t data,cmd0,cmd1; 
-  uint8_t msb,lsb;
-  uint32_t size,count,SOFcount=10;
+  uint8_t msb,lsb; uint8_t *start; uint8_t discard[APDISCARD];
+  uint32_t size,count,n,i,k,SOFcount=10;
+  GPIO_SRDYDisarm();  // a response also pulls SRDY low
 // 1) wait for SRDY to be low
   waitCount = 0;
   while(ReadSRDY()){
     waitCount++;
     if(waitCount>APTIMEOUT){
       TimeOutErr++;  // no response error
+      APFailStreak++;
+      Capture_Frame(CAPTURERX|CAPTUREFAIL,pt,0);
       return APFAIL; // timeout??
     }      
   }
@@ -405,29 +536,50 @@ int AP_RecvMessage(uint8_t *pt, uint32_t max){
     if(SOFcount==0){
       SetMRDY();     //   MRDY=1  
       NoSOFErr++;    // no SOF error
+      APFailStreak++;
+      Capture_Frame(CAPTURERX|CAPTUREFAIL,pt,0);
       return APFAIL;
     }
   }while(data != SOF);
+  start = pt;
   *pt = data; pt++;
-  fcs = 0;
+  fcs = 0;     // only bytes discarded beyond max, the rest are checked in the buffer
 // get size, once we get SOF, it is highly likely for the rest to come
-  lsb = UART1_InChar(); *pt = lsb; fcs=fcs^lsb; pt++;
-  msb = UART1_InChar(); *pt = msb; fcs=fcs^msb; pt++;
+  lsb = UART1_InChar(); *pt = lsb; pt++;
+  msb = UART1_InChar(); *pt = msb; pt++;
 // get command
-  cmd0 = UART1_InChar(); *pt = cmd0; fcs=fcs^cmd0; pt++;
-  cmd1 = UART1_InChar(); *pt = cmd1; fcs=fcs^cmd1; pt++;
+  cmd0 = UART1_InChar(); *pt = cmd0; pt++;
+  cmd1 = UART1_InChar(); *pt = cmd1; pt++;
   count = 5;
   size = (msb<<8)+lsb;
-// get payload
-  for(int i=0;i<size;i++){
-    data = UART1_InChar(); 
-    fcs = fcs^data; 
-    count++;
-    if(count <= max){
-      *pt = data; 
-      pt++; // payload
+// get payload, what fits in one block copy, then the bytes beyond max
+  n = size;
+  if(count+n > max){
+    n = (max > count) ? max-count : 0;
+  }
+  if(UART1_Read(pt,n,APTIMEOUT) != n){
+    SetMRDY();        //   MRDY=1  
+    TimeOutErr++;     // frame stopped part way
+    APFailStreak++;
+    Capture_Frame(CAPTURERX|CAPTUREFAIL,start,pt-start);
+    return APFAIL;
+  }
+  pt = pt+n;
+  count = count+n;
+  for(i=n; i<size; i=i+k){   // bytes beyond max, checked but not stored
+    k = size-i;
+    if(k > APDISCARD) k = APDISCARD;
+    if(UART1_Read(discard,k,APTIMEOUT) != k){
+      SetMRDY();        //   MRDY=1  
+      TimeOutErr++;     // frame stopped part way
+      APFailStreak++;
+      Capture_Frame(CAPTURERX|CAPTUREFAIL,start,pt-start);
+      return APFAIL;
     }
+    count = count+k;
+    fcs = FCS_Update(fcs,discard,k);
   }
+  fcs = FCS_Update(fcs,&start[1],pt-start-1);  // length, command and stored payload
 // get FCB
   data = UART1_InChar(); 
   count++;
@@ -436,7 +588,9 @@ int AP_RecvMessage(uint8_t *pt, uint32_t max){
   }    
   if(data != fcs){ 
     fcserr++;
+    APFailStreak++;
     SetMRDY();        //   MRDY=1  
+    Capture_Frame(CAPTURERX|CAPTUREFAIL,start,(count < max) ? count : max);
     return APFAIL;
   }
 // 4) Make MRDY=1
@@ -446,6 +600,8 @@ int AP_RecvMessage(uint8_t *pt, uint32_t max){
   while(ReadSRDY()==0){
     waitCount++;
   }
+  APFailStreak = 0;  // SNP is answering
+  Capture_Frame(CAPTURERX,start,(count < max) ? count : max);
   return APOK;
 }
 
@@ -484,8 +640,36 @@ int AP_SendMessageResponse(uint8_t *msgPt, uint8_t *responsePt,uint32_t max){
 //  }
   result = AP_RecvMessage(responsePt,max);
 #ifdef APDEBUG
+  if(APQuiet == 0){
     AP_EchoSendMessage(msgPt);  // debugging
     AP_EchoReceived(result);    // debugging
+  }
+#endif
+  if(result == APFAIL){
+    return APFAIL;
+  }  
+  return APOK;
+}
+
+//------------AP_SendSpansResponse------------
+// AP_SendSpans, then receive the response from the Bluetooth module
+// Input: cmd0, cmd1, spans, count as in AP_SendSpans
+//        responsePt points to empty buffer into which data is returned
+//        maximum size (discard data beyond this limit)
+// Output: APOK if ok, APFAIL on error (timeout or fcs error)
+int AP_SendSpansResponse(uint8_t cmd0, uint8_t cmd1, const span_t *spans, uint32_t count,
+  uint8_t *responsePt, uint32_t max){
+  int result;
+  result = AP_SendSpans(cmd0,cmd1,spans,count);
+  if(result == APFAIL){
+    return APFAIL;
+  }
+  result = AP_RecvMessage(responsePt,max);
+#ifdef APDEBUG
+  if(APQuiet == 0){
+    AP_EchoSendSpans(cmd0,cmd1,spans,count);  // debugging
+    AP_EchoReceived(result);    // debugging
+  }
 #endif
   if(result == APFAIL){
     return APFAIL;
@@ -493,29 +677,143 @@ int AP_SendMessageResponse(uint8_t *msgPt, uint8_t *responsePt,uint32_t max){
   return APOK;
 }
 
-typedef struct characteristics{
-  uint16_t theHandle;          // each object has an ID
-  uint16_t size;               // number of bytes in user data (1,2,4,8)
-  uint8_t *pt;                 // pointer to user data, stored little endian
-  void (*callBackRead)(void);  // action if SNP Characteristic Read Indication
-  void (*callBackWrite)(void); // action if SNP Characteristic Write Indication
-}characteristic_t;
-const uint32_t MAXCHARACTERISTICS=10;
 uint32_t CharacteristicCount=0;
 characteristic_t CharacteristicList[MAXCHARACTERISTICS];
-typedef struct NotifyCharacteristics{
-  uint16_t uuid;               // user defined 
-  uint16_t theHandle;          // each object has an ID (used to notify)
-  uint16_t CCCDhandle;         // generated/assigned by SNP
-  uint16_t CCCDvalue;          // sent by phone to this object
-  uint16_t size;               // number of bytes in user data (1,2,4,8)
-  uint8_t *pt;                 // pointer to user data array, stored little endian
-  void (*callBackCCCD)(void);  // action if SNP CCCD Updated Indication
-}NotifyCharacteristic_t;
-const uint32_t NOTIFYMAXCHARACTERISTICS=4;
 uint32_t NotifyCharacteristicCount=0;
 NotifyCharacteristic_t NotifyCharacteristicList[NOTIFYMAXCHARACTERISTICS];
 
+// SNP hands out attribute handles densely, in the order they are added,
+// so a handle maps directly to its characteristic with one array access
+// HandleMap[handle-HandleBase] is 1+index into CharacteristicList for a value handle,
+// APCCCDENTRY+index into NotifyCharacteristicList for a CCCD handle, or 0
+#define APCCCDENTRY 0x80
+#if (MAXCHARACTERISTICS >= APCCCDENTRY)||(NOTIFYMAXCHARACTERISTICS > APCCCDENTRY)
+#error "HandleMap entries hold at most 127 characteristics and 128 notify characteristics"
+#endif
+uint16_t HandleBase;                 // first handle registered, 0 if none yet
+uint8_t HandleMap[APHANDLEMAPSIZE];
+
+// ****mapHandle****
+// record where a newly registered handle lives
+// handles outside the map are still found by a search
+void static mapHandle(uint16_t handle, uint8_t entry){
+  if(HandleBase == 0){
+    HandleBase = handle;      // SNP handles only increase from here
+  }
+  if((handle >= HandleBase)&&((handle-HandleBase) < APHANDLEMAPSIZE)){
+    HandleMap[handle-HandleBase] = entry;
+  }
+}
+// ****findCharacteristic****
+// Inputs:  handle of a characteristic value attribute
+// Outputs: 1+index into CharacteristicList, 0 if not found
+uint32_t static findCharacteristic(uint16_t h){ uint32_t i; uint8_t entry;
+  if((HandleBase)&&(h >= HandleBase)&&((h-HandleBase) < APHANDLEMAPSIZE)){
+    entry = HandleMap[h-HandleBase];
+    if(entry&APCCCDENTRY) return 0;  // this is a CCCD
+    return entry;
+  }
+  for(i=0; i<CharacteristicCount; i++){ // beyond the map
+    if(CharacteristicList[i].theHandle == h) return i+1;
+  }
+  return 0;
+}
+// ****findCCCD****
+// Inputs:  handle of a CCCD attribute
+// Outputs: 1+index into NotifyCharacteristicList, 0 if not found
+uint32_t static findCCCD(uint16_t h){ uint32_t i; uint8_t entry;
+  if((HandleBase)&&(h >= HandleBase)&&((h-HandleBase) < APHANDLEMAPSIZE)){
+    entry = HandleMap[h-HandleBase];
+    if(entry&APCCCDENTRY) return (entry&~APCCCDENTRY)+1;
+    return 0;
+  }
+  for(i=0; i<NotifyCharacteristicCount; i++){ // beyond the map
+    if(NotifyCharacteristicList[i].CCCDhandle == h) return i+1;
+  }
+  return 0;
+}
+// ****AP_CharacteristicsInit****
+// forget all characteristics and handles, the SNP has just been reset
+void static AP_CharacteristicsInit(void){ uint32_t i;
+  CharacteristicCount = 0;
+  NotifyCharacteristicCount = 0;
+  HandleBase = 0;
+  for(i=0; i<APHANDLEMAPSIZE; i++){
+    HandleMap[i] = 0;
+  }
+}
+
+// ****valueSpan****
+// describe part of a user value as a span, the bytes stay where they are
+// values of 1 to APSCALARSIZE bytes are numbers, stored little endian, sent big endian
+// larger values are byte arrays, sent in memory order
+// Inputs:  span is filled in
+//          src points to the user value of size bytes, of which length are valid
+//          offset is the first byte (in SNP order) to send, max is the most to send
+// Outputs: number of bytes in the span
+uint32_t static valueSpan(span_t *span, uint8_t *src, uint32_t size, uint32_t length,
+  uint32_t offset, uint32_t max){ uint32_t n;
+  n = 0;
+  if(offset < length){
+    n = length-offset;
+    if(n > max) n = max;
+  }
+  if(size <= APSCALARSIZE){
+    span->pt = &src[size-offset-n]; // SNP big endian, last byte sent first
+    span->reverse = 1;
+  }else{
+    span->pt = &src[offset];
+    span->reverse = 0;
+  }
+  span->size = n;
+  return n;
+}
+
+//*************AP_SaveCharacteristic**************
+// Record a read/write characteristic the SNP has accepted
+// Inputs handle is the value handle returned by SNP Add Characteristic Value
+//        thesize, pt, (*ReadFunc), (*WriteFunc) as in AP_AddCharacteristic
+// Output APOK if successful,
+//        APFAIL if more than MAXCHARACTERISTICS characteristics
+int AP_SaveCharacteristic(uint16_t handle, uint16_t thesize, void *pt,
+  void(*ReadFunc)(void), void(*WriteFunc)(void)){
+  if(CharacteristicCount>=MAXCHARACTERISTICS) return APFAIL; // error
+  CharacteristicList[CharacteristicCount].theHandle = handle;
+  CharacteristicList[CharacteristicCount].size = thesize;
+  CharacteristicList[CharacteristicCount].length = thesize;
+  CharacteristicList[CharacteristicCount].pt = (uint8_t *) pt;
+  CharacteristicList[CharacteristicCount].callBackRead = ReadFunc;
+  CharacteristicList[CharacteristicCount].callBackWrite = WriteFunc;
+  CharacteristicCount++;
+  mapHandle(handle,CharacteristicCount);
+  return APOK;
+}
+
+//*************AP_SaveNotifyCharacteristic**************
+// Record a notify characteristic the SNP has accepted
+// Inputs uuid, thesize, pt, (*CCCDfunc) as in AP_AddNotifyCharacteristic
+//        handle is the value handle returned by SNP Add Characteristic Value
+//        CCCDhandle is the handle returned by SNP Add Characteristic Descriptor
+// Output APOK if successful,
+//        APFAIL if more than NOTIFYMAXCHARACTERISTICS notify characteristics
+int AP_SaveNotifyCharacteristic(uint16_t uuid, uint16_t handle, uint16_t CCCDhandle,
+  uint16_t thesize, void *pt, void(*CCCDfunc)(void)){
+  if(NotifyCharacteristicCount>=NOTIFYMAXCHARACTERISTICS) return APFAIL; // error
+  NotifyCharacteristicList[NotifyCharacteristicCount].uuid = uuid;
+  NotifyCharacteristicList[NotifyCharacteristicCount].theHandle = handle;
+  NotifyCharacteristicList[NotifyCharacteristicCount].CCCDhandle = CCCDhandle;
+  NotifyCharacteristicList[NotifyCharacteristicCount].CCCDvalue = 0; // notify initially off
+  NotifyCharacteristicList[NotifyCharacteristicCount].size = thesize;
+  NotifyCharacteristicList[NotifyCharacteristicCount].length = thesize;
+  NotifyCharacteristicList[NotifyCharacteristicCount].type = APNOTIFY;
+  NotifyCharacteristicList[NotifyCharacteristicCount].pt = (uint8_t *) pt;
+  NotifyCharacteristicList[NotifyCharacteristicCount].callBackCCCD = CCCDfunc;
+  NotifyCharacteristicList[NotifyCharacteristicCount].policy = APPOLICYNONE;
+  NotifyCharacteristicList[NotifyCharacteristicCount].pending = 0;
+  mapHandle(CCCDhandle,APCCCDENTRY+NotifyCharacteristicCount);
+  NotifyCharacteristicCount++;
+  return APOK;
+}
 
 //*********AP_GetNotifyCCCD*******
 // Return notification CCCD from the communication interface
@@ -535,10 +833,13 @@ uint16_t AP_GetNotifyCCCD(uint32_t i){
 // Output APOK if successful,
 //        APFAIL if SNP failure
 int AP_AddService(uint16_t uuid){ int r;
-  OutString("\n\rAdd service");
-  NPI_AddService[6] = uuid&0xFF;
-  NPI_AddService[7] = uuid>>8;
-  r = AP_SendMessageResponse((uint8_t*)NPI_AddService,RecvBuf,RECVSIZE);  
+  uint8_t payload[3]; span_t span;
+  Log_Event(LOGADDSERVICE);
+  payload[0] = 0x01;        // Primary Service
+  payload[1] = uuid&0xFF;
+  payload[2] = uuid>>8;
+  span.pt = payload; span.size = 3; span.reverse = 0;
+  r = AP_SendSpansResponse(0x35,0x81,&span,1,RecvBuf,RECVSIZE);  // SNP Add Service
   return r;
 }
 
@@ -548,11 +849,29 @@ int AP_AddService(uint16_t uuid){ int r;
 // Output APOK if successful,
 //        APFAIL if SNP failure
 int AP_RegisterService(void){ int r;
-  OutString("\n\rRegister service");
+  Log_Event(LOGREGISTER);
   r = AP_SendMessageResponse((uint8_t*)NPI_Register,RecvBuf,RECVSIZE);
   return r;
 }
 
+const uint8_t APZero = 0;  // null termination of a user description string
+// ****addCharValue****
+// SNP Add Characteristic Value Declaration (0x35,0x82)
+// Outputs: APOK with the new value handle in RecvBuf[6,7], APFAIL on SNP failure
+int static addCharValue(uint16_t uuid, uint8_t permission, uint8_t properties){
+  uint8_t payload[8]; span_t span;
+  payload[0] = permission;  // 0=none,1=read,2=write, 3=Read+write, GATT Permission
+  payload[1] = properties;  // 2=read,8=write,0x0A=read+write,0x10=notify, GATT Properties
+  payload[2] = 0x00;
+  payload[3] = 0x00;        // RFU
+  payload[4] = 0x00;        // Maximum length of the attribute value=512
+  payload[5] = 0x02;
+  payload[6] = uuid&0xFF;   // UUID
+  payload[7] = uuid>>8;
+  span.pt = payload; span.size = 8; span.reverse = 0;
+  return AP_SendSpansResponse(0x35,0x82,&span,1,RecvBuf,RECVSIZE);
+}
+
 //*************AP_AddCharacteristic**************
 // Add a read, write, or read/write characteristic
 //        for notify properties, call AP_AddNotifyCharacteristic 
@@ -569,41 +888,27 @@ int AP_RegisterService(void){ int r;
 int AP_AddCharacteristic(uint16_t uuid, uint16_t thesize, void *pt, uint8_t permission,
   uint8_t properties, char name[], void(*ReadFunc)(void), void(*WriteFunc)(void)){
   int r; uint16_t handle; int i;
-  if(thesize>8) return APFAIL;
+  uint8_t header[6]; span_t spans[3];
+  if((thesize==0)||(thesize>APMAXVALUESIZE)) return APFAIL;
   if(CharacteristicCount>=MAXCHARACTERISTICS) return APFAIL; // error
-  NPI_AddCharValue[3] = 0x35;   // SNP Add Characteristic Value Declaration
-  NPI_AddCharValue[4] = 0x82;  
-  NPI_AddCharValue[5] = permission; // 0=none,1=read,2=write, 3=Read+write, GATT Permission
-  NPI_AddCharValue[6] = properties; // 2=read,8=write,0x0A=read+write,0x10=notify, GATT Properties
-  NPI_AddCharValue[11] = 0xFF&uuid; NPI_AddCharValue[12] = uuid>>8;
-  OutString("\n\rAdd CharValue");
-  r=AP_SendMessageResponse((uint8_t*)NPI_AddCharValue,RecvBuf,RECVSIZE);
-  if(r == APFAIL) return APFAIL;
-  handle = (RecvBuf[7]<<8)+RecvBuf[6]; // handle for this characteristic
-  OutString("\n\rAdd CharDescriptor");
   i=0;
-  while((i<20)&&(name[i])){
-    NPI_AddCharDescriptor[11+i] = name[i]; i++;
-  }
+  while((i<20)&&(name[i])) i++;
   if(i==0) return APFAIL;       // empty name
-
-  NPI_AddCharDescriptor[11+i] = 0; i++;
-  NPI_AddCharDescriptor[1] = 6+i;  // frame length
-  NPI_AddCharDescriptor[3] = 0x35; // SNP Add Characteristic Descriptor Declaration
-  NPI_AddCharDescriptor[4] = 0x83;
-  NPI_AddCharDescriptor[5] = 0x80; // User Description String
-  NPI_AddCharDescriptor[6] = 0x01; // GATT Read Permissions
-  NPI_AddCharDescriptor[7] = NPI_AddCharDescriptor[9] = i;  // string length
-  NPI_AddCharDescriptor[8] = NPI_AddCharDescriptor[10] = 0; // string length
-  r=AP_SendMessageResponse((uint8_t*)NPI_AddCharDescriptor,RecvBuf,RECVSIZE);
+  Log_Event(LOGADDCHARVALUE);
+  r=addCharValue(uuid,permission,properties);
   if(r == APFAIL) return APFAIL;
-  CharacteristicList[CharacteristicCount].theHandle = handle;
-  CharacteristicList[CharacteristicCount].size = thesize;
-  CharacteristicList[CharacteristicCount].pt = (uint8_t *) pt;
-  CharacteristicList[CharacteristicCount].callBackRead = ReadFunc;
-  CharacteristicList[CharacteristicCount].callBackWrite = WriteFunc;
-  CharacteristicCount++;
-  return APOK; // OK
+  handle = (RecvBuf[7]<<8)+RecvBuf[6]; // handle for this characteristic
+  Log_Event(LOGADDCHARDESC);
+  header[0] = 0x80;             // User Description String
+  header[1] = 0x01;             // GATT Read Permissions
+  header[2] = header[4] = i+1;  // string length, with null termination
+  header[3] = header[5] = 0;
+  spans[0].pt = header;         spans[0].size = 6; spans[0].reverse = 0;
+  spans[1].pt = (uint8_t*)name; spans[1].size = i; spans[1].reverse = 0;
+  spans[2].pt = &APZero;        spans[2].size = 1; spans[2].reverse = 0;
+  r=AP_SendSpansResponse(0x35,0x83,spans,3,RecvBuf,RECVSIZE); // SNP Add Characteristic Descriptor Declaration
+  if(r == APFAIL) return APFAIL;
+  return AP_SaveCharacteristic(handle,thesize,pt,ReadFunc,WriteFunc);
 }  
 
 //*************AP_AddNotifyCharacteristic**************
@@ -619,71 +924,251 @@ int AP_AddCharacteristic(uint16_t uuid, uint16_t thesize, void *pt, uint8_t perm
 int AP_AddNotifyCharacteristic(uint16_t uuid, uint16_t thesize, void *pt,   
   char name[], void(*CCCDfunc)(void)){
   int r; uint16_t handle; int i;
-  if(thesize>8) return APFAIL;
+  uint8_t header[7]; span_t spans[3];
+  if((thesize==0)||(thesize>APMAXVALUESIZE)) return APFAIL;
   if(NotifyCharacteristicCount>=NOTIFYMAXCHARACTERISTICS) return APFAIL; // error
-  NPI_AddCharValue[3] = 0x35;   // SNP Add Characteristic Value Declaration
-  NPI_AddCharValue[4] = 0x82;  
-  NPI_AddCharValue[5] = 0x00;   // GATT no read, no Write GATT Permission
-  NPI_AddCharValue[6] = 0x10;   // 0x10=notify, GATT Properties
-  NPI_AddCharValue[11] = 0xFF&uuid; NPI_AddCharValue[12] = uuid>>8;
-  OutString("\n\rAdd Notify CharValue");
-  r=AP_SendMessageResponse((uint8_t*)NPI_AddCharValue,RecvBuf,RECVSIZE);
-  if(r == APFAIL) return APFAIL;
-  handle = (RecvBuf[7]<<8)+RecvBuf[6]; // handle for this characteristic
-  OutString("\n\rAdd CharDescriptor");
   i=0;
-  while((i<19)&&(name[i])){
-    NPI_AddCharDescriptor[12+i] = name[i]; i++;
-  }
+  while((i<19)&&(name[i])) i++;
   if(i==0) return APFAIL;               // empty name
-  NPI_AddCharDescriptor[12+i] = 0; i++; // add null termination
-  NPI_AddCharDescriptor[1] = 7+i;       // frame length
-  NPI_AddCharDescriptor[3] = 0x35;      // SNP Add Characteristic Descriptor Declaration
-  NPI_AddCharDescriptor[4] = 0x83;
-  NPI_AddCharDescriptor[5] = 0x84;      // User Description String, and CCCD permissions
-  NPI_AddCharDescriptor[6] = 0x03;      // CCCD parameters read+write
-  NPI_AddCharDescriptor[7] = 0x01;      // GATT Read Permissions
-  NPI_AddCharDescriptor[8] = NPI_AddCharDescriptor[10] = i; // string length
-  NPI_AddCharDescriptor[9] = NPI_AddCharDescriptor[11] = 0; // string length
-  r=AP_SendMessageResponse((uint8_t*)NPI_AddCharDescriptor,RecvBuf,RECVSIZE);
+  Log_Event(LOGADDNOTIFY);
+  r=addCharValue(uuid,0x00,0x30);       // no read, no write, 0x10=notify, 0x20=indicate
   if(r == APFAIL) return APFAIL;
-  NotifyCharacteristicList[NotifyCharacteristicCount].uuid = uuid;
-  NotifyCharacteristicList[NotifyCharacteristicCount].theHandle = handle;
-  NotifyCharacteristicList[NotifyCharacteristicCount].CCCDhandle = (RecvBuf[8]<<8)+RecvBuf[7]; // handle for this CCCD
-  NotifyCharacteristicList[NotifyCharacteristicCount].CCCDvalue = 0; // notify initially off
-  NotifyCharacteristicList[NotifyCharacteristicCount].size = thesize;
-  NotifyCharacteristicList[NotifyCharacteristicCount].pt = (uint8_t *) pt;
-  NotifyCharacteristicList[NotifyCharacteristicCount].callBackCCCD = CCCDfunc;
-  NotifyCharacteristicCount++;
-  return APOK; // OK
+  handle = (RecvBuf[7]<<8)+RecvBuf[6]; // handle for this characteristic
+  Log_Event(LOGADDCHARDESC);
+  header[0] = 0x84;             // User Description String, and CCCD permissions
+  header[1] = 0x03;             // CCCD parameters read+write
+  header[2] = 0x01;             // GATT Read Permissions
+  header[3] = header[5] = i+1;  // string length, with null termination
+  header[4] = header[6] = 0;
+  spans[0].pt = header;         spans[0].size = 7; spans[0].reverse = 0;
+  spans[1].pt = (uint8_t*)name; spans[1].size = i; spans[1].reverse = 0;
+  spans[2].pt = &APZero;        spans[2].size = 1; spans[2].reverse = 0;
+  r=AP_SendSpansResponse(0x35,0x83,spans,3,RecvBuf,RECVSIZE); // SNP Add Characteristic Descriptor Declaration
+  if(r == APFAIL) return APFAIL;
+  return AP_SaveNotifyCharacteristic(uuid,handle,(RecvBuf[8]<<8)+RecvBuf[7], // handle for this CCCD
+    thesize,pt,CCCDfunc);
 }
   
+// SNP status in the Send Notification Indication response
+#define SNPSUCCESS            0x00
+#define SNPALREADYINPROGRESS  0x85
+#define SNPOUTOFRESOURCES     0x87
+#define SNPGATTCOLLISION      0x8E
+// credit based flow control, SNP buffers only a few notifications per connection event
+uint32_t NotifyCredits;     // notifications SNP can still accept this connection event
+uint32_t NotifyCreditTime;  // BSP_Time_Get when the credits were refilled, us
+uint32_t NotifyBusy;        // debugging count of notifications refused for lack of buffers
+
+// ****creditsRefill****
+// give back all credits once a connection interval has gone by
+void static creditsRefill(void){ uint32_t period;
+  period = AP_GetConnInterval()*1250;  // 1.25 ms units to us
+  if(period == 0) period = 7500;       // shortest interval allowed
+  if((BSP_Time_Get()-NotifyCreditTime) >= period){
+    NotifyCredits = APNOTIFYCREDITS;
+    NotifyCreditTime = BSP_Time_Get();
+  }
+}
+//*************AP_AddServiceTable**************
+// Add a service with all its characteristics from a const table and register it
+// the table is remembered, so the service can be added again after an SNP reset
+// Inputs uuid is the service, 0xFFF0, 0xFFE0, ...
+//        table points to the characteristics, in the order they are added
+//        count is the number of entries in table
+// Output APOK if successful,
+//        APFAIL if an entry is not valid, too many characteristics, or if SNP failure
+int AP_AddServiceTable(uint16_t uuid, const gatt_t *table, uint32_t count){
+  int r; uint32_t i;
+  if((APReplaying == 0)&&(APServiceCount < APMAXSERVICES)){
+    APServiceList[APServiceCount].uuid = uuid;
+    APServiceList[APServiceCount].table = table;
+    APServiceList[APServiceCount].count = count;
+    APServiceCount++;
+  }
+  APQuiet = 1;             // no echo, frames go out back to back
+  r = AP_AddService(uuid);
+  for(i=0; (i<count)&&(r==APOK); i++){
+    if(table[i].properties&APGATTNOTIFY){
+      r = AP_AddNotifyCharacteristic(table[i].uuid,table[i].size,table[i].pt,
+        (char *)table[i].name,table[i].callBackWrite);
+    }else{
+      r = AP_AddCharacteristic(table[i].uuid,table[i].size,table[i].pt,
+        table[i].permission,table[i].properties,(char *)table[i].name,
+        table[i].callBackRead,table[i].callBackWrite);
+    }
+  }
+  if(r == APOK){
+    r = AP_RegisterService();
+  }
+  APQuiet = 0;
+  return r;
+}
 //*************AP_SendNotification**************
 // Send a notification (will skip if CCCD is 0) 
 // Input:  index into notify characteristic to send
 // Output: APOK if successful,
+//         APBUSY if SNP has no buffer free this connection event,
 //         APFAIL if notification not configured, or if SNP failure
-int AP_SendNotification(uint32_t i){ uint16_t handle; uint32_t j;uint8_t thedata;
-  int r1; uint32_t s;
+int AP_SendNotification(uint32_t i){ uint16_t handle;
+  int r1; uint8_t type; uint16_t cccd;
+  uint8_t header[6]; span_t spans[2];
   if(i>= NotifyCharacteristicCount) return APFAIL;   // not valid
-  if(NotifyCharacteristicList[i].CCCDvalue){         // send only if active
+  cccd = NotifyCharacteristicList[i].CCCDvalue;
+  if(cccd){                                          // send only if active
     handle = NotifyCharacteristicList[i].theHandle;
     if(handle == 0) return APFAIL; // not open   
-    NPI_SendNotificationIndication[1] = 6+NotifyCharacteristicList[i].size;      // 1 to 8 bytes 
-    OutString("\n\rSend data=");
-    s = NotifyCharacteristicList[i].size;
-    for(j=0; j<s; j++){
-      thedata = NotifyCharacteristicList[i].pt[s-j-1]; // fetch data from user little endian to SNP big endian
-      OutUHex(thedata); OutString(", ");      
-      NPI_SendNotificationIndication[11+j] = thedata;    // copy into message, big endian
+    type = NotifyCharacteristicList[i].type;
+    if((cccd&type)==0) type = cccd&APINDICATE ? APINDICATE : APNOTIFY; // what the phone enabled
+    creditsRefill();
+    if(NotifyCredits == 0){
+      NotifyBusy++;
+      return APBUSY;   // SNP buffers full, try next connection event
+    }
+    header[0] = header[1] = 0;   // handle of connection always 0
+    header[2] = handle&0x0FF;    // handle of the characteristic value attribute
+    header[3] = handle>>8; 
+    header[4] = 0;               // RFU
+    header[5] = type;            // 1=notification, 2=indication
+    spans[0].pt = header; spans[0].size = 6; spans[0].reverse = 0;
+    valueSpan(&spans[1],NotifyCharacteristicList[i].pt,NotifyCharacteristicList[i].size,
+      NotifyCharacteristicList[i].length,0,AP_GetMTU()-3); // ATT notification holds MTU-3 bytes
+    Log_Event(LOGSENDNOTIFY);
+    r1=AP_SendSpansResponse(0x55,0x89,spans,2,RecvBuf,RECVSIZE); // SNP Send Notification Indication
+    if(r1 == APFAIL) return APFAIL;
+    switch(RecvBuf[5]){      // status
+      case SNPSUCCESS:
+        if(type == APINDICATE){
+          NotifyCredits = 0; // phone confirms in the next connection event
+        }else{
+          NotifyCredits--;
+        }
+        break;
+      case SNPALREADYINPROGRESS:
+      case SNPOUTOFRESOURCES:
+      case SNPGATTCOLLISION:
+        NotifyCredits = 0;   // out of buffers until the next connection event
+        NotifyCreditTime = BSP_Time_Get();
+        NotifyBusy++;
+        r1 = APBUSY;
+        break;
+      default:
+        r1 = APFAIL;
     }
-    NPI_SendNotificationIndication[7] = handle&0x0FF; // handle
-    NPI_SendNotificationIndication[8] = handle>>8; 
-    r1=AP_SendMessageResponse(NPI_SendNotificationIndication,RecvBuf,RECVSIZE);
   }else{
     r1 = APOK; // no need to notify
   }
-  return r1; // OK or fail depending on SendNotificationIndication
+  return r1; // OK, busy or fail depending on SendNotificationIndication
+}
+//*************AP_SetNotifyType**************
+// Choose how a notify characteristic is sent, default is APNOTIFY
+// Input:  i index into notify characteristic
+//         type APNOTIFY or APINDICATE
+// Output: APOK if successful,
+//         APFAIL if i or type not valid
+int AP_SetNotifyType(uint32_t i, uint8_t type){
+  if(i>= NotifyCharacteristicCount) return APFAIL;   // not valid
+  if((type!=APNOTIFY)&&(type!=APINDICATE)) return APFAIL;
+  NotifyCharacteristicList[i].type = type;
+  return APOK;
+}
+//*************notify policy engine**************
+// NotifyShadow[i] holds the value of notify characteristic i as last sent
+uint8_t NotifyShadow[NOTIFYMAXCHARACTERISTICS][APMAXVALUESIZE];
+
+// ****readNumber****
+// user data of 1, 2 or 4 bytes, stored little endian
+uint32_t static readNumber(uint8_t *pt, uint32_t size){ uint32_t value;
+  value = pt[0];
+  if(size >= 2) value = value+(pt[1]<<8);
+  if(size >= 4) value = value+(pt[2]<<16)+((uint32_t)pt[3]<<24);
+  return value;
+}
+// ****notifyChanged****
+// compare the user variable with the value last sent
+// Outputs: 1 if the policy calls for a notification, 0 if not
+uint32_t static notifyChanged(uint32_t i){ uint32_t j,size,now,last;
+  NotifyCharacteristic_t *c = &NotifyCharacteristicList[i];
+  size = c->size;
+  if((c->policy == APPOLICYDEADBAND)&&((size==1)||(size==2)||(size==4))){
+    now = readNumber(c->pt,size);
+    last = readNumber(NotifyShadow[i],size);
+    if(now > last) return (now-last) > c->deadband;
+    return (last-now) > c->deadband;
+  }
+  for(j=0; j<size; j++){
+    if(c->pt[j] != NotifyShadow[i][j]) return 1;
+  }
+  return 0;
+}
+//*************AP_SetNotifyPolicy**************
+// Have AP_NotifyProcess send a notify characteristic automatically
+// Input:  i index into notify characteristic
+//         policy APPOLICYNONE, APPOLICYCHANGE or APPOLICYDEADBAND
+//         deadband smallest change sent, for APPOLICYDEADBAND
+//         minInterval ms, at most one notification per minInterval
+//         maxInterval ms, at least one notification per maxInterval, 0 for never
+// Output: APOK if successful,
+//         APFAIL if i or policy not valid
+int AP_SetNotifyPolicy(uint32_t i, uint8_t policy, uint32_t deadband,
+  uint16_t minInterval, uint16_t maxInterval){ uint32_t j;
+  if(i>= NotifyCharacteristicCount) return APFAIL;   // not valid
+  if(policy > APPOLICYDEADBAND) return APFAIL;
+  NotifyCharacteristicList[i].policy = policy;
+  NotifyCharacteristicList[i].deadband = deadband;
+  NotifyCharacteristicList[i].minInterval = minInterval;
+  NotifyCharacteristicList[i].maxInterval = maxInterval;
+  NotifyCharacteristicList[i].lastSent = BSP_Time_Get();
+  for(j=0; j<NotifyCharacteristicList[i].size; j++){
+    NotifyShadow[i][j] = NotifyCharacteristicList[i].pt[j];
+  }
+  return APOK;
+}
+//*************AP_NotifyProcess**************
+// Send the notify characteristics whose policy calls for it
+// a change seen before minInterval has passed stays in the user variable
+// and goes out, merged with later changes, once it has
+// Input:  none
+// Output: number of notifications sent
+uint32_t AP_NotifyProcess(void){ uint32_t i,j,elapsed,sent;
+  NotifyCharacteristic_t *c;
+  sent = 0;
+  if(AP_IsConnected() == 0) return 0;
+  for(i=0; i<NotifyCharacteristicCount; i++){
+    c = &NotifyCharacteristicList[i];
+    if((c->policy == APPOLICYNONE)||(c->CCCDvalue == 0)) continue;
+    elapsed = BSP_Time_Get()-c->lastSent;
+    if(elapsed < c->minInterval*1000) continue;  // too soon, coalesce
+    if(c->pending||notifyChanged(i)||(c->maxInterval&&(elapsed >= c->maxInterval*1000))){
+      if(AP_SendNotification(i) != APOK) break; // out of credits, try again later
+      c->pending = 0;
+      c->lastSent = BSP_Time_Get();
+      for(j=0; j<c->size; j++){
+        NotifyShadow[i][j] = c->pt[j];
+      }
+      sent++;
+    }
+  }
+  return sent;
+}
+//*************AP_GetNotifyCredits**************
+// Number of notifications SNP can still accept this connection event
+// Input:  none
+// Output: 0 to APNOTIFYCREDITS
+uint32_t AP_GetNotifyCredits(void){
+  creditsRefill();
+  return NotifyCredits;
+}
+//*************AP_SetNotifyLength**************
+// Set how many bytes of a notify characteristic the next notification sends
+// Input:  i index into notify characteristic
+//         length number of bytes, 1 to the size given when it was added
+// Output: APOK if successful,
+//         APFAIL if i or length not valid
+int AP_SetNotifyLength(uint32_t i, uint16_t length){
+  if(i>= NotifyCharacteristicCount) return APFAIL;   // not valid
+  if((length==0)||(length>NotifyCharacteristicList[i].size)) return APFAIL;
+  NotifyCharacteristicList[i].length = length;
+  return APOK;
 }
 //*************AP_StartAdvertisement**************
 // Start advertisement
@@ -691,18 +1176,29 @@ int AP_SendNotification(uint32_t i){ uint16_t handle; uint32_t j;uint8_t thedata
 // Output: APOK if successful,
 //         APFAIL if notification not configured, or if SNP failure
 int AP_StartAdvertisement(void){volatile int r;
-  OutString("\n\rSet Device name");
+  Log_Event(LOGDEVICENAME);
   r =AP_SendMessageResponse((uint8_t*)NPI_GATTSetDeviceName,RecvBuf,RECVSIZE);
-  OutString("\n\rSetAdvertisement1");
+  Log_Event(LOGADVERTISEMENT1);
   r =AP_SendMessageResponse((uint8_t*)NPI_SetAdvertisement1,RecvBuf,RECVSIZE);
 //  OutString("\n\rSetAdvertisementSAP");
 //  r =AP_SendMessageResponse((uint8_t*)NPI_SetAdvertisementSAP,RecvBuf,RECVSIZE);
-  OutString("\n\rSetAdvertisement Data");
+  Log_Event(LOGADVERTISEDATA);
   r =AP_SendMessageResponse((uint8_t*)NPI_SetAdvertisementData,RecvBuf,RECVSIZE);
-  OutString("\n\rStartAdvertisement");
+  Log_Event(LOGSTARTADVERTISE);
   r =AP_SendMessageResponse((uint8_t*)NPI_StartAdvertisement,RecvBuf,RECVSIZE);
+  if((r == APOK)&&(APBootAdvertising == 0)){
+    APBootAdvertising = BSP_Time_Get();  // first time only, not after a recovery
+  }
   return r;
 }
+//*************AP_GetBootTime**************
+// Time from the start of AP_Init until advertising started
+// Input:  none
+// Output: time in us, 0 if not advertising yet
+uint32_t AP_GetBootTime(void){
+  if(APBootAdvertising == 0) return 0;
+  return APBootAdvertising-APBootStart;
+}
 //*************AP_GetStatus**************
 // Get status of connection
 // Input:  none
@@ -712,7 +1208,7 @@ int AP_StartAdvertisement(void){volatile int r;
 // CC is ATT Status
 // DD is ATT method in progress
 uint32_t AP_GetStatus(void){volatile int r;
-  OutString("\n\rGet Status");
+  Log_Event(LOGGETSTATUS);
   r = AP_SendMessageResponse((uint8_t*)NPI_GetStatus,RecvBuf,RECVSIZE);
   return (RecvBuf[4]<<24)+(RecvBuf[5]<<16)+(RecvBuf[6]<<8)+(RecvBuf[7]);
 }
@@ -721,87 +1217,463 @@ uint32_t AP_GetStatus(void){volatile int r;
 // Input:  none
 // Output: version
 uint32_t AP_GetVersion(void){volatile int r;
-  OutString("\n\rGet Version");
+  Log_Event(LOGGETVERSION);
   r = AP_SendMessageResponse((uint8_t*)NPI_GetVersion,RecvBuf,RECVSIZE); 
   return (RecvBuf[5]<<8)+(RecvBuf[6]);
 }
+//*************NPI baud rate**************
+uint32_t APBaud = UART1BAUD;  // rate both ends of the NPI link use now
+//*************AP_SetBaud**************
+// Move both ends of the NPI link to a new baud rate
+// runs between exchanges, the Bluetooth thread is the only caller of the link,
+// then checks the link with Get Status; if that fails both ends go back
+// SimpleNP 2.2 has no NPI command for this, its UART rate is fixed
+// when the image is built, so only the emulator can follow
+// a hardware reset of the SNP, e.g. by AP_Supervise, returns to UART1BAUD
+// Input:  baud bits/sec
+// Output: APOK if the link runs at the new rate,
+//         APFAIL if the emulator or UART1 cannot change rate or the check failed,
+//         APUNSUPPORTED with a real SNP
+int AP_SetBaud(uint32_t baud){
+#ifdef SNPEMULATOR
+  uint32_t old;
+  if(baud == APBaud) return APOK;
+  old = APBaud;
+  if(SNP_SetBaud(baud) == 0) return APFAIL;
+  if(UART1_SetBaud(baud) == 0){
+    SNP_SetBaud(old);
+    return APFAIL;
+  }
+  APBaud = baud;
+  Log_Value(LOGBAUD,baud);
+  if(AP_SendMessageResponse((uint8_t*)NPI_GetStatus,RecvBuf,RECVSIZE) == APOK){
+    return APOK;
+  }
+  UART1_SetBaud(old);
+  SNP_SetBaud(old);
+  APBaud = old;
+  Log_Value(LOGBAUD,old);
+  return APFAIL;
+#else
+  if(baud == APBaud) return APOK;
+  return APUNSUPPORTED;  // the CC2650 stays at UART1BAUD
+#endif
+}
+//*************frame handlers**************
+// AP_BackgroundProcess looks up each incoming frame in a table indexed by (cmd0,cmd1)
+// HandlerIndex[cmd1] is 1+slot of the first handler for that cmd1, or 0 if none
+// handlers sharing a cmd1 with a different cmd0 are chained through next
+typedef struct handlers{
+  uint8_t cmd0;                   // NPI command type/subsystem
+  uint8_t cmd1;                   // NPI command id
+  uint8_t next;                   // 1+slot of next handler with same cmd1, 0 if none
+  void (*handler)(uint8_t *msg);  // action for this frame
+}handler_t;
+uint32_t HandlerCount=0;
+handler_t HandlerList[APMAXHANDLERS];
+uint8_t HandlerIndex[256];
+
+//*************AP_RegisterHandler**************
+// Install the function AP_BackgroundProcess calls when
+// a frame with this (cmd0,cmd1) arrives from the SNP,
+// replacing any handler already installed for that pair.
+// Inputs cmd0 is the NPI command type/subsystem, 0x55 for SNP asynchronous
+//        cmd1 is the NPI command id
+//        (*handler) called with a pointer to the received frame, 0 to remove
+// Output APOK if successful,
+//        APFAIL if more than APMAXHANDLERS handlers
+int AP_RegisterHandler(uint8_t cmd0, uint8_t cmd1, void(*handler)(uint8_t *msg)){
+  uint32_t slot;
+  slot = HandlerIndex[cmd1];
+  while(slot){
+    if(HandlerList[slot-1].cmd0 == cmd0){
+      HandlerList[slot-1].handler = handler; // replace (0 removes)
+      return APOK;
+    }
+    slot = HandlerList[slot-1].next;
+  }
+  if(handler == 0) return APOK;  // nothing to remove
+  if(HandlerCount>=APMAXHANDLERS) return APFAIL; // error
+  HandlerList[HandlerCount].cmd0 = cmd0;
+  HandlerList[HandlerCount].cmd1 = cmd1;
+  HandlerList[HandlerCount].handler = handler;
+  HandlerList[HandlerCount].next = HandlerIndex[cmd1]; // push on front of chain
+  HandlerCount++;
+  HandlerIndex[cmd1] = HandlerCount;
+  return APOK;
+}
+
+//*************link state**************
+// updated by SNP Event Indications, read by AP_IsConnected, AP_GetMTU, AP_GetConnInterval
+uint8_t  LinkConnected;     // 1 if a phone is connected
+uint16_t LinkConnHandle;    // connection handle assigned by SNP
+uint16_t LinkInterval;      // connection interval, 1.25 ms units
+uint16_t LinkLatency;       // slave latency, number of connection events
+uint16_t LinkTimeout;       // supervision timeout, 10 ms units
+uint16_t LinkMTU;           // negotiated ATT MTU
+uint8_t  LinkTermReason;    // reason for last connection termination
+uint8_t  LinkAdvertising;   // 1 if SNP is advertising
+uint16_t LinkErrorOpcode;   // command that caused the last SNP_ERROR_EVT
+uint8_t  LinkErrorStatus;   // status of the last SNP_ERROR_EVT
+void (*LinkEventCallback)(uint16_t event); // action after an SNP Event Indication
+
+void static linkReset(void){
+  LinkConnected = 0;
+  LinkConnHandle = 0;
+  LinkInterval = LinkLatency = LinkTimeout = 0;
+  LinkMTU = APDEFAULTMTU;
+  LinkAdvertising = 0;
+}
+//*************AP_SetEventCallback**************
+// Install the function called after AP_BackgroundProcess
+// receives an SNP Event Indication and updates the link state
+// Input:  (*EventFunc) called with the SNP_xxx_EVT event type, 0 for none
+// Output: none
+void AP_SetEventCallback(void(*EventFunc)(uint16_t event)){
+  LinkEventCallback = EventFunc;
+}
+//*************AP_IsConnected**************
+// Link state kept up to date by SNP Event Indications
+// Input:  none
+// Output: 1 if a phone is connected, 0 if not
+uint32_t AP_IsConnected(void){
+  return LinkConnected;
+}
+//*************AP_GetMTU**************
+// Negotiated ATT MTU of the current connection
+// Input:  none
+// Output: ATT MTU in bytes, APDEFAULTMTU until the phone negotiates
+uint16_t AP_GetMTU(void){
+  return LinkMTU;
+}
+//*************AP_GetConnInterval**************
+// Connection interval of the current connection
+// Input:  none
+// Output: connection interval in 1.25 ms units, 0 if not connected
+uint16_t AP_GetConnInterval(void){
+  return LinkInterval;
+}
+
+// ****AP_WriteIndication****
+// SNP Characteristic Write Indication (0x55,0x88)
+// copy data into user variable, call user function, confirm if needed
+void static AP_WriteIndication(uint8_t *msg){
+  int count; uint16_t h; int i,j;
+  uint32_t s; // size of user data
+  uint32_t d; // difference between packet size and user data size
+  uint32_t offset; // first byte written, nonzero for long writes
+  uint8_t responseNeeded;
+  h = (msg[8]<<8)+msg[7]; // handle for this characteristic
+  responseNeeded = msg[9];
+  i = findCharacteristic(h);
+  if(i){
+    i = i-1;
+    count = AP_GetSize(msg)-7; // number of bytes in message
+    s = CharacteristicList[i].size;
+    if(s <= APSCALARSIZE){  // number, SNP big endian to user little endian
+      if(count>s)count=s;   // truncate to size
+      d = s-count;
+      for(j=0;j<s;j++){     // if message is smaller than size
+        CharacteristicList[i].pt[j] = 0; // fill MSbytes with 0
+      }
+      for(j=0;j<count;j++){ // write data
+        CharacteristicList[i].pt[s-j-1-d] = msg[12+j];
+      }
+    }else{                  // byte array, stored in order
+      offset = (msg[11]<<8)+msg[10];
+      if(offset>s) offset=s;
+      if(count>s-offset) count=s-offset; // truncate to size
+      for(j=0;j<count;j++){ // write data
+        CharacteristicList[i].pt[offset+j] = msg[12+j];
+      }
+      CharacteristicList[i].length = offset+count;
+    }
+    if(CharacteristicList[i].callBackWrite){
+      (*CharacteristicList[i].callBackWrite)(); // process Characteristic Write Indication
+    }
+  }
+  if(responseNeeded){
+    AP_SendMessage((uint8_t*)NPI_WriteConfirmation);
+    AP_EchoSendMessage((uint8_t*)NPI_WriteConfirmation);
+  }
+}
+// ****AP_ReadIndication****
+// SNP Characteristic Read Indication (0x55,0x87)
+// call user function, respond with data from user variable
+void static AP_ReadIndication(uint8_t *msg){
+  uint16_t h; int i;
+  uint32_t offset; // first byte requested, nonzero for long reads
+  uint32_t max;    // most bytes the phone can take in this response
+  uint8_t header[7]; span_t spans[2];
+  h = (msg[8]<<8)+msg[7]; // handle for this characteristic
+  offset = (msg[10]<<8)+msg[9];
+  max = (msg[12]<<8)+msg[11];
+  if(max > LinkMTU-1) max = LinkMTU-1;  // ATT Read Response holds MTU-1 bytes
+  header[0] = 0x00;      // Success
+  header[1] = header[2] = 0; // handle of connection always 0
+  header[3] = msg[7];    // handle
+  header[4] = msg[8];
+  header[5] = msg[9];    // offset of the first byte returned
+  header[6] = msg[10];
+  spans[0].pt = header; spans[0].size = 7; spans[0].reverse = 0;
+  spans[1].size = 0;     // no data if the handle is unknown
+  i = findCharacteristic(h);
+  if(i){
+    i = i-1;
+    if((offset==0)&&(CharacteristicList[i].callBackRead)){
+      (*CharacteristicList[i].callBackRead)(); // process Characteristic Read Indication
+    }
+    valueSpan(&spans[1],CharacteristicList[i].pt,
+      CharacteristicList[i].size,CharacteristicList[i].length,offset,max);
+  }
+  AP_SendSpans(0x55,0x87,spans,1+(spans[1].size>0)); // SNP Characteristic Read Confirmation
+  AP_EchoSendSpans(0x55,0x87,spans,1+(spans[1].size>0));
+}
+// ****AP_CCCDIndication****
+// SNP CCCD Updated Indication (0x55,0x8B)
+// save new CCCD value, call user function, confirm if needed
+void static AP_CCCDIndication(uint8_t *msg){
+  uint16_t h; int i;
+  uint8_t responseNeeded;
+  h = (msg[8]<<8)+msg[7]; // handle for this characteristic
+  responseNeeded = msg[9];
+  i = findCCCD(h);
+  if(i){
+    i = i-1;
+    NotifyCharacteristicList[i].CCCDvalue = (msg[11]<<8)+msg[10];
+    NotifyCharacteristicList[i].pending = 1;  // new subscriber gets the current value
+    if(NotifyCharacteristicList[i].callBackCCCD){
+      NotifyCharacteristicList[i].callBackCCCD();
+    }
+  }
+  if(responseNeeded){
+    AP_SendMessage((uint8_t*)NPI_CCCDUpdatedConfirmation);
+    AP_EchoSendMessage((uint8_t*)NPI_CCCDUpdatedConfirmation);
+  }
+}
+// ****AP_EventIndication****
+// SNP Event Indication (0x55,0x05)
+// bytes 5,6 are the event type, event parameters start at byte 7
+// update link state, call user function
+void static AP_EventIndication(uint8_t *msg){
+  uint16_t event;
+  event = (msg[6]<<8)+msg[5];
+  switch(event){
+    case SNP_CONN_EST_EVT:
+      LinkConnected = 1;
+      LinkAdvertising = 0;
+      LinkConnHandle = (msg[8]<<8)+msg[7];
+      LinkInterval = (msg[10]<<8)+msg[9];
+      LinkLatency = (msg[12]<<8)+msg[11];
+      LinkTimeout = (msg[14]<<8)+msg[13];
+      LinkMTU = APDEFAULTMTU;     // each new connection starts at the default
+      NotifyCredits = APNOTIFYCREDITS;
+      NotifyCreditTime = BSP_Time_Get();
+      Log_Event(LOGCONNECTED);
+      break;
+    case SNP_CONN_TERM_EVT:
+      LinkTermReason = msg[9];
+      linkReset();
+      Log_Value(LOGDISCONNECTED,LinkTermReason);
+      break;
+    case SNP_CONN_PARAM_UPDATED_EVT:
+      LinkInterval = (msg[10]<<8)+msg[9];
+      LinkLatency = (msg[12]<<8)+msg[11];
+      LinkTimeout = (msg[14]<<8)+msg[13];
+      Log_Value(LOGINTERVAL,LinkInterval);
+      break;
+    case SNP_ADV_STARTED_EVT:
+      LinkAdvertising = 1;
+      break;
+    case SNP_ADV_ENDED_EVT:
+      LinkAdvertising = 0;
+      break;
+    case SNP_ATT_MTU_EVT:
+      LinkMTU = (msg[10]<<8)+msg[9];
+      Log_Value(LOGMTU,LinkMTU);
+      break;
+    case SNP_ERROR_EVT:
+      LinkErrorOpcode = (msg[8]<<8)+msg[7];
+      LinkErrorStatus = msg[9];
+      Log_Value(LOGSNPERROR,LinkErrorStatus);
+      break;
+    default:
+      break;
+  }
+  if(LinkEventCallback){
+    (*LinkEventCallback)(event);
+  }
+}
+// ****AP_PowerUpIndication****
+// SNP Power Up Indication (0x55,0x01)
+// the SNP has reset on its own, so any connection is gone
+void static AP_PowerUpIndication(uint8_t *msg){
+  linkReset();
+  if(APServiceCount||APBootAdvertising){
+    APFailStreak = APFAILLIMIT;  // its GATT database is gone too, AP_Supervise adds it back
+  }
+}
+// ****AP_HandlersInit****
+// empty the handler table, then install the default handlers
+void static AP_HandlersInit(void){ int i;
+  for(i=0; i<256; i++){
+    HandlerIndex[i] = 0;
+  }
+  HandlerCount = 0;
+  AP_RegisterHandler(0x55,0x88,&AP_WriteIndication); // SNP Characteristic Write Indication
+  AP_RegisterHandler(0x55,0x87,&AP_ReadIndication);  // SNP Characteristic Read Indication
+  AP_RegisterHandler(0x55,0x8B,&AP_CCCDIndication);  // SNP CCCD Updated Indication
+  AP_RegisterHandler(0x55,0x05,&AP_EventIndication); // SNP Event Indication
+  AP_RegisterHandler(0x55,0x01,&AP_PowerUpIndication); // SNP Power Up Indication
+  linkReset();
+}
+
 // ****AP_BackgroundProcess****
 // handle incoming SNP frames
 // Inputs:  none
 // Outputs: none
 void AP_BackgroundProcess(void){
-  int count; uint16_t h; int i,j;
-  uint32_t s; // size of user data 1,2,4,8
-  uint32_t d; // difference between packet size and user data size
-  uint8_t responseNeeded;
-
+  uint32_t slot; uint8_t cmd0;
+#ifdef APDEBUG
+  Log_Drain();   // Bluetooth thread has nothing better to do
+#endif
   if(AP_RecvStatus()){
     if(AP_RecvMessage(RecvBuf,RECVSIZE)==APOK){
-      OutString("\n\rRecvMessage");
-      AP_EchoReceived(APOK);        
-      if((RecvBuf[3]==0x55)&&(RecvBuf[4]==0x88)){// SNP Characteristic Write Indication (0x88)
-        h = (RecvBuf[8]<<8)+RecvBuf[7]; // handle for this characteristic
-        responseNeeded = RecvBuf[9];
-        i = 0;
-        while(i<MAXCHARACTERISTICS){
-          if(CharacteristicList[i].theHandle == h){
-            count = RecvBuf[1]-7;   // number of bytes in message
-            s = CharacteristicList[i].size;
-            if(count>s)count=s;   // truncate to size
-            d = s-count;
-            for(j=0;j<s;j++){     // if message is smaller than size
-              CharacteristicList[i].pt[j] = 0; // fill MSbytes with 0
-            }
-            for(j=0;j<count;j++){ // write data
-              CharacteristicList[i].pt[s-j-1-d] = RecvBuf[12+j];
-            }
-            (*CharacteristicList[i].callBackWrite)(); // process Characteristic Write Indication
-            i = MAXCHARACTERISTICS;
-          }else{
-            i++;
+      Log_Event(LOGRECVMESSAGE);
+      AP_EchoReceived(APOK);
+      cmd0 = RecvBuf[3];
+      slot = HandlerIndex[RecvBuf[4]];
+      while(slot){
+        if(HandlerList[slot-1].cmd0 == cmd0){
+          if(HandlerList[slot-1].handler){
+            (*HandlerList[slot-1].handler)(RecvBuf);
           }
+          return;
         }
-        if(responseNeeded){
-          AP_SendMessage(NPI_WriteConfirmation);
-          AP_EchoSendMessage(NPI_WriteConfirmation);
-        }
+        slot = HandlerList[slot-1].next;
       }
-      if((RecvBuf[3]==0x55)&&(RecvBuf[4]==0x87)){// SNP Characteristic Read Indication (0x87)
-        h = (RecvBuf[8]<<8)+RecvBuf[7]; // handle for this characteristic
-        i = 0;
-        while(i<MAXCHARACTERISTICS){
-          if(CharacteristicList[i].theHandle == h){
-            (*CharacteristicList[i].callBackRead)(); // process Characteristic Read Indication
-            NPI_ReadConfirmation[1] = 7+CharacteristicList[i].size;
-            s = CharacteristicList[i].size;
-            for(j=0;j<s;j++){ // write data
-              NPI_ReadConfirmation[j+12]=CharacteristicList[i].pt[s-j-1];
-            }
-            i = MAXCHARACTERISTICS;
-          }else{
-            i++;
-          }
-        }
-        NPI_ReadConfirmation[8] = RecvBuf[7]; // handle
-        NPI_ReadConfirmation[9] = RecvBuf[8]; 
-        AP_SendMessage(NPI_ReadConfirmation);
-        AP_EchoSendMessage(NPI_ReadConfirmation);
-      }
-      if((RecvBuf[3]==0x55)&&(RecvBuf[4]==0x8B)){// SNP CCCD Updated Indication (0x8B)
-        h = (RecvBuf[8]<<8)+RecvBuf[7]; // handle for this characteristic
-        responseNeeded = RecvBuf[9];
-        for(i=0; i<NOTIFYMAXCHARACTERISTICS;i++){
-          if(NotifyCharacteristicList[i].CCCDhandle == h){  // to do
-            NotifyCharacteristicList[i].CCCDvalue = (RecvBuf[11]<<8)+RecvBuf[10];
-            NotifyCharacteristicList[i].callBackCCCD();
-          }
-        }
-        if(responseNeeded){
-          AP_SendMessage(NPI_CCCDUpdatedConfirmation);
-          AP_EchoSendMessage(NPI_CCCDUpdatedConfirmation);
-        }
-      }        
     }
   }
 }
 
+//*************link recovery**************
+uint32_t APRecoveries;     // number of times AP_Supervise reset the SNP
+uint32_t APRecoverFails;   // recoveries that did not get the SNP back
+uint32_t APRecoverTime;    // duration of the last recovery, us
+uint32_t APRecoverMax;     // longest recovery, us
+uint32_t APRecoverLast;    // BSP_Time_Get at the end of the last recovery, us
+uint32_t APRecoverStart;   // BSP_Time_Get at the start of the recovery in progress, us
+uint8_t APRecoverAdvertising; // 1 if advertising has to be restarted
+NotifyCharacteristic_t APNotifySaved[NOTIFYMAXCHARACTERISTICS];
+uint32_t APNotifySavedCount;
+uint16_t APLengthSaved[MAXCHARACTERISTICS];
+uint32_t APLengthSavedCount;
+
+// ****recoverStart****
+// save the settings, dump the capture and start a hardware reset of the SNP
+// returns at once, AP_InitRun finishes the reset one step at a time
+void static recoverStart(void){ uint32_t i; uint8_t connected;
+  APNotifySavedCount = NotifyCharacteristicCount;
+  APLengthSavedCount = CharacteristicCount;
+  for(i=0; i<APNotifySavedCount; i++){
+    APNotifySaved[i] = NotifyCharacteristicList[i];
+  }
+  for(i=0; i<APLengthSavedCount; i++){
+    APLengthSaved[i] = CharacteristicList[i].length;
+  }
+  APRecoverAdvertising = (APBootAdvertising != 0);
+  connected = LinkConnected;
+  linkReset();
+  if(connected&&LinkEventCallback){
+    (*LinkEventCallback)(SNP_CONN_TERM_EVT); // the phone is gone with the reset
+  }
+#ifdef APCAPTURE
+  Capture_Dump();   // the frames that led up to the failure
+#endif
+  Log_Event(LOGRECOVER);
+  APBootTries = 0;
+  bootReset();      // RESET low, AP_InitRun releases it
+  if(APBaud != UART1BAUD){  // the SNP starts again at its default rate
+    UART1_SetBaud(UART1BAUD);
+    APBaud = UART1BAUD;
+  }
+}
+// ****recoverFinish****
+// the SNP is up again, add the recorded services again and restart advertising
+// notify settings carry over, the SNP hands out the same handles,
+// CCCDs start off as in AP_AddNotifyCharacteristic, the phone has to subscribe again
+// bounded by APTIMEOUT on each exchange
+// Output: APOK if the SNP is back, APFAIL if not
+int static recoverFinish(void){ int r; uint32_t i;
+// 1) same services, in the same order, so the indices stay the same
+  AP_CharacteristicsInit();
+  APReplaying = 1;
+  r = APOK;
+  for(i=0; (i<APServiceCount)&&(r==APOK); i++){
+    r = AP_AddServiceTable(APServiceList[i].uuid,APServiceList[i].table,APServiceList[i].count);
+  }
+  APReplaying = 0;
+  if(r == APFAIL) return APFAIL;
+// 2) settings from before the reset, handles from the new database, CCCDs off
+  for(i=0; (i<APNotifySavedCount)&&(i<NotifyCharacteristicCount); i++){
+    APNotifySaved[i].theHandle = NotifyCharacteristicList[i].theHandle;
+    APNotifySaved[i].CCCDhandle = NotifyCharacteristicList[i].CCCDhandle;
+    APNotifySaved[i].CCCDvalue = 0;  // notify initially off
+    APNotifySaved[i].pending = 0;
+    NotifyCharacteristicList[i] = APNotifySaved[i];
+  }
+  for(i=0; (i<APLengthSavedCount)&&(i<CharacteristicCount); i++){
+    CharacteristicList[i].length = APLengthSaved[i];
+  }
+// 3) advertise again if it was before
+  if(APRecoverAdvertising){
+    r = AP_StartAdvertisement();
+  }
+  return r;
+}
+// ****recoverEnd****
+// record how the recovery went
+void static recoverEnd(int r){
+  APRecovering = 0;
+  APRecoverLast = BSP_Time_Get();
+  APRecoverTime = APRecoverLast-APRecoverStart;
+  if(APRecoverTime > APRecoverMax){
+    APRecoverMax = APRecoverTime;
+  }
+  if(r == APFAIL){
+    APRecoverFails++;
+    APFailStreak = APFAILLIMIT;  // try again after the hold off
+  }
+  Log_Value(LOGRECOVERTIME,APRecoverTime);
+}
+
+//*************AP_Supervise**************
+// Check the health of the SNP link, call from the Bluetooth thread
+// after APFAILLIMIT failed exchanges in a row (timeout, missing SOF, FCS error),
+// or an unexpected SNP power up, the SNP is reset and its services replayed
+// the reset is stepped like AP_InitRun, one step per call
+// a failed recovery is retried at most once every APRECOVERHOLDOFF us
+// Input:  none
+// Output: APOK if the link is fine or was recovered,
+//         APBUSY while the SNP is resetting, call again later,
+//         APFAIL if a recovery failed or is held off
+int AP_Supervise(void){ int r; uint32_t start;
+  if(APRecovering){
+    r = AP_InitRun();
+    if(r == APBUSY) return APBUSY;
+    if(r == APOK){
+      r = recoverFinish();
+    }
+    recoverEnd(r);
+    return r;
+  }
+  if(APFailStreak < APFAILLIMIT) return APOK;
+  start = BSP_Time_Get();
+  if(APRecoverFails&&((start-APRecoverLast) < APRECOVERHOLDOFF)) return APFAIL;
+  APFailStreak = 0;
+  APRecoveries++;
+  APRecoverStart = start;
+  APRecovering = 1;
+  recoverStart();
+  return APBUSY;
+}
@@ -50,21 +50,181 @@
 
 // NPI symbols
 #define SOF  254
+// NPI frames built at compile time, for frames that never change
+// NPI_FRAME(cmd0,cmd1,payload bytes...) is a complete initializer list
+// SOF, length, cmd0, cmd1, payload and FCS, with the length and FCS
+// counted by the preprocessor, so they always match the bytes
+// NPI_FRAME0(cmd0,cmd1) is the same for a frame without payload
+// payload is 1 to 32 bytes
+#define NPI_FRAME0(CMD0,CMD1) {SOF,0x00,0x00,CMD0,CMD1,NPI_FCS0(CMD0,CMD1)}
+#define NPI_FRAME(CMD0,CMD1,...) {SOF,NPI_COUNT(__VA_ARGS__),0x00,CMD0,CMD1,__VA_ARGS__,\
+  NPI_FCS(CMD0,CMD1,__VA_ARGS__)}
+#define NPI_FCS0(CMD0,CMD1) (0xFF&((CMD0)^(CMD1)))
+#define NPI_FCS(CMD0,CMD1,...) (0xFF&(NPI_COUNT(__VA_ARGS__)^(CMD0)^(CMD1)^NPI_XOR(__VA_ARGS__)))
+// number of bytes in a frame with N payload bytes
+#define NPI_FRAMESIZE(N) ((N)+6)
+// compile-time check, fails to compile if COND is false
+#define NPI_ASSERT(COND,NAME) typedef char NAME[(COND)?1:-1]
+#define NPI_COUNT(...) NPI_COUNT_(__VA_ARGS__,32,31,30,29,28,27,26,25,24,23,22,21,20,19,18,17,16,15,14,13,12,11,10,9,8,7,6,5,4,3,2,1)
+#define NPI_COUNT_(_1,_2,_3,_4,_5,_6,_7,_8,_9,_10,_11,_12,_13,_14,_15,_16,_17,_18,_19,_20,_21,_22,_23,_24,_25,_26,_27,_28,_29,_30,_31,_32,N,...) N
+#define NPI_XOR(...) NPI_XOR_(NPI_COUNT(__VA_ARGS__),__VA_ARGS__)
+#define NPI_XOR_(N,...) NPI_XOR__(N,__VA_ARGS__)
+#define NPI_XOR__(N,...) NPI_X##N(__VA_ARGS__)
+#define NPI_X1(A) (A)
+#define NPI_X2(A,...) ((A)^NPI_X1(__VA_ARGS__))
+#define NPI_X3(A,...) ((A)^NPI_X2(__VA_ARGS__))
+#define NPI_X4(A,...) ((A)^NPI_X3(__VA_ARGS__))
+#define NPI_X5(A,...) ((A)^NPI_X4(__VA_ARGS__))
+#define NPI_X6(A,...) ((A)^NPI_X5(__VA_ARGS__))
+#define NPI_X7(A,...) ((A)^NPI_X6(__VA_ARGS__))
+#define NPI_X8(A,...) ((A)^NPI_X7(__VA_ARGS__))
+#define NPI_X9(A,...) ((A)^NPI_X8(__VA_ARGS__))
+#define NPI_X10(A,...) ((A)^NPI_X9(__VA_ARGS__))
+#define NPI_X11(A,...) ((A)^NPI_X10(__VA_ARGS__))
+#define NPI_X12(A,...) ((A)^NPI_X11(__VA_ARGS__))
+#define NPI_X13(A,...) ((A)^NPI_X12(__VA_ARGS__))
+#define NPI_X14(A,...) ((A)^NPI_X13(__VA_ARGS__))
+#define NPI_X15(A,...) ((A)^NPI_X14(__VA_ARGS__))
+#define NPI_X16(A,...) ((A)^NPI_X15(__VA_ARGS__))
+#define NPI_X17(A,...) ((A)^NPI_X16(__VA_ARGS__))
+#define NPI_X18(A,...) ((A)^NPI_X17(__VA_ARGS__))
+#define NPI_X19(A,...) ((A)^NPI_X18(__VA_ARGS__))
+#define NPI_X20(A,...) ((A)^NPI_X19(__VA_ARGS__))
+#define NPI_X21(A,...) ((A)^NPI_X20(__VA_ARGS__))
+#define NPI_X22(A,...) ((A)^NPI_X21(__VA_ARGS__))
+#define NPI_X23(A,...) ((A)^NPI_X22(__VA_ARGS__))
+#define NPI_X24(A,...) ((A)^NPI_X23(__VA_ARGS__))
+#define NPI_X25(A,...) ((A)^NPI_X24(__VA_ARGS__))
+#define NPI_X26(A,...) ((A)^NPI_X25(__VA_ARGS__))
+#define NPI_X27(A,...) ((A)^NPI_X26(__VA_ARGS__))
+#define NPI_X28(A,...) ((A)^NPI_X27(__VA_ARGS__))
+#define NPI_X29(A,...) ((A)^NPI_X28(__VA_ARGS__))
+#define NPI_X30(A,...) ((A)^NPI_X29(__VA_ARGS__))
+#define NPI_X31(A,...) ((A)^NPI_X30(__VA_ARGS__))
+#define NPI_X32(A,...) ((A)^NPI_X31(__VA_ARGS__))
+// constant frames in flash, built with NPI_FRAME in AP.c
+extern const uint8_t NPI_GetStatus[];
+extern const uint8_t NPI_GetVersion[];
+extern const uint8_t NPI_Register[];
+extern const uint8_t NPI_SetAdvertisement1[];
 // return parameters
 #define APFAIL 0
 #define APOK   1
-// if you define APDEBUG then all LP-SNP traffic is displayed on UART0
-// if you do not define APDEBUG then no UART0 output is performed (runs faster)
+#define APBUSY 2  // not done yet, SNP has no buffer free or is still starting, try again later
+#define APUNSUPPORTED 3  // SimpleNP 2.2 has no command for this, see AP_SetBaud
+// if you define APDEBUG then all LP-SNP traffic is logged in binary, see Log.h,
+// and sent to UART0 by AP_BackgroundProcess, decode it on the PC with LogDecode.c
+// if you do not define APDEBUG then no UART0 output is performed
 #define APDEBUG 1
+// if you define APCAPTURE then every NPI frame is recorded in a RAM ring buffer, see Capture.h
+#define APCAPTURE 1
+// if you define SNPEMULATOR then AP.c talks to the SimpleNP emulator in SNP_Emulator.c
+// instead of UART1 and the CC2650, no BoosterPack needed
+//#define SNPEMULATOR 1
+// maximum number of read/write and of notify characteristics
+// override at build time, e.g. MAXCHARACTERISTICS=20 in the C/C++ Define field
+#ifndef MAXCHARACTERISTICS
+#define MAXCHARACTERISTICS 10
+#endif
+#ifndef NOTIFYMAXCHARACTERISTICS
+#define NOTIFYMAXCHARACTERISTICS 4
+#endif
+// maximum number of bytes in one characteristic value, at most RECVSIZE-13 (115)
+// values of 1 to APSCALARSIZE bytes are numbers, stored little endian, sent big endian
+// larger values are byte arrays, sent in memory order
+// reads and notifications are limited to the negotiated ATT MTU (MTU-1 and MTU-3 bytes)
+#ifndef APMAXVALUESIZE
+#define APMAXVALUESIZE 64
+#endif
+#define APSCALARSIZE 8
+// notification types, SNP Send Notification Indication request type
+#define APNOTIFY   0x01  // unacknowledged, several per connection event
+#define APINDICATE 0x02  // phone confirms each one, at most one per connection event
+// notifications SNP can buffer per connection event,
+// spent by AP_SendNotification and refilled each connection interval
+#ifndef APNOTIFYCREDITS
+#define APNOTIFYCREDITS 4
+#endif
+// notify policies, when AP_NotifyProcess sends a notify characteristic on its own
+#define APPOLICYNONE     0  // only when the user calls AP_SendNotification
+#define APPOLICYCHANGE   1  // when any byte of the value changes
+#define APPOLICYDEADBAND 2  // when the number moves more than deadband (sizes 1,2,4)
+// a characteristic uses at most 4 attribute handles (declaration, value, CCCD, user description)
+#define APHANDLEMAPSIZE (4*(MAXCHARACTERISTICS+NOTIFYMAXCHARACTERISTICS))
+
+typedef struct characteristics{
+  uint16_t theHandle;          // each object has an ID
+  uint16_t size;               // number of bytes in user data (1 to APMAXVALUESIZE)
+  uint16_t length;             // number of valid bytes, size unless a write was shorter
+  uint8_t *pt;                 // pointer to user data, stored little endian
+  void (*callBackRead)(void);  // action if SNP Characteristic Read Indication
+  void (*callBackWrite)(void); // action if SNP Characteristic Write Indication
+}characteristic_t;
+extern uint32_t CharacteristicCount;
+extern characteristic_t CharacteristicList[MAXCHARACTERISTICS];
+typedef struct NotifyCharacteristics{
+  uint16_t uuid;               // user defined
+  uint16_t theHandle;          // each object has an ID (used to notify)
+  uint16_t CCCDhandle;         // generated/assigned by SNP
+  uint16_t CCCDvalue;          // sent by phone to this object
+  uint16_t size;               // number of bytes in user data (1 to APMAXVALUESIZE)
+  uint16_t length;             // number of bytes to notify, set by AP_SetNotifyLength
+  uint8_t type;                // APNOTIFY or APINDICATE, set by AP_SetNotifyType
+  uint8_t *pt;                 // pointer to user data array, stored little endian
+  void (*callBackCCCD)(void);  // action if SNP CCCD Updated Indication
+  uint8_t policy;              // APPOLICYxxx, set by AP_SetNotifyPolicy
+  uint8_t pending;             // 1 to send on the next AP_NotifyProcess, e.g. just subscribed
+  uint16_t minInterval;        // ms, no faster than this, changes in between are coalesced
+  uint16_t maxInterval;        // ms, send at least this often even if unchanged, 0 for never
+  uint32_t deadband;           // APPOLICYDEADBAND threshold, in units of the number
+  uint32_t lastSent;           // BSP_Time_Get of the last notification, us
+}NotifyCharacteristic_t;
+extern uint32_t NotifyCharacteristicCount;
+extern NotifyCharacteristic_t NotifyCharacteristicList[NOTIFYMAXCHARACTERISTICS];
+// one entry of a declarative GATT table, defined as const data in flash
+// an entry with the 0x10 notify property is added as a notify characteristic
+typedef struct GattCharacteristics{
+  uint16_t uuid;               // 0xFFF1, 0xFFF2, ...
+  uint16_t size;               // number of bytes in user data (1 to APMAXVALUESIZE)
+  void *pt;                    // pointer to user data, stored little endian
+  uint8_t permission;          // GATT Permission, 0=none,1=read,2=write,3=read+write
+  uint8_t properties;          // GATT Properties, 2=read,8=write,0x0A=read+write,0x10=notify
+  const char *name;            // null-terminated, at most 20 bytes (19 for notify)
+  void (*callBackRead)(void);  // action if SNP Characteristic Read Indication
+  void (*callBackWrite)(void); // action if SNP Characteristic Write Indication or CCCD Updated Indication
+}gatt_t;
+#define APGATTNOTIFY 0x10
+// boot timestamps, BSP_Time_Get in us, 0 if not reached yet
+extern uint32_t APBootStart;       // AP_Init started
+extern uint32_t APBootReady;       // SNP powered up after reset
+extern uint32_t APBootAdvertising; // AP_StartAdvertisement finished
 
 //------------AP_Init------------
 // Initialize serial link and GPIO to Bluetooth module
 // see GPIO.c file for hardware connections 
 // reset the Bluetooth module and initialize connection
+// busy-waits for the whole bring-up, see AP_InitStart to overlap it with other work
+// call with interrupts enabled, the replies arrive through UART1_Handler
 // Input: none
 // Output: APOK on success, APFAIL on timeout
 int AP_Init(void);
 
+//------------AP_InitStart------------
+// Initialize serial link and GPIO to Bluetooth module
+// and begin the hardware reset, returns at once
+// call AP_InitRun until it returns APOK or APFAIL
+// Input: none
+// Output: none
+void AP_InitStart(void);
+
+//------------AP_InitRun------------
+// Take the next step of the SNP bring-up started by AP_InitStart
+// never waits, timeouts come from BSP_Time_Get, so it can run in a
+// thread that yields between calls while the other threads start up
+// Input: none
+// Output: APBUSY while in progress, APOK when ready, APFAIL on timeout
+int AP_InitRun(void);
+
 //------------AP_Reset------------
 // reset the Bluetooth module
 // with MRDY high, clear RESET low for 10 ms
@@ -83,13 +243,13 @@ void AP_Reset(void);
 int AP_SendMessage(uint8_t *pt);
 
 // *****AP_EchoReceived**************
-// for debugging, sends RecvBuf from SNP to UART0
+// for debugging, logs RecvBuf from SNP for UART0, see Log.h
 // Inputs:  result APOK or APFAIL
 // Outputs: none
 void AP_EchoReceived(int response);
 
 // *****AP_EchoSendMessage**************
-// For debugging, sends message to UART0
+// For debugging, logs message for UART0, see Log.h
 // Inputs:  pointer to message 
 // Outputs: none
 void AP_EchoSendMessage(uint8_t *sendMsg);
@@ -102,6 +262,10 @@ void AP_EchoSendMessage(uint8_t *sendMsg);
 //        maximum size (discard data beyond this limit)
 // Output: APOK if ok, APFAIL on error (timeout or fcs error)
 int AP_RecvMessage(uint8_t *pt, uint32_t max);
+extern uint32_t fcserr;       // frames with a bad FCS
+extern uint32_t TimeOutErr;   // no response, or a frame stopped part way
+extern uint32_t NoSOFErr;     // no SOF in the first 10 bytes
+extern uint32_t APFailStreak; // failed exchanges in a row, see AP_Supervise
 
 //------------AP_RecvStatus------------
 // check to see if Bluetooth module wishes to send packet
@@ -122,6 +286,33 @@ uint32_t AP_RecvStatus(void);
 // Output: APOK if ok, APFAIL on error (timeout or fcs error)
 int AP_SendMessageResponse(uint8_t *msgPt, uint8_t *responsePt,uint32_t max);
 
+// one piece of an NPI payload, sent from where it lives without a copy
+typedef struct spans{
+  const uint8_t *pt;   // first byte in memory
+  uint16_t size;       // number of bytes
+  uint8_t reverse;     // 1 to send the last byte first, e.g. a little endian number sent big endian
+}span_t;
+
+//------------AP_SendSpans------------
+// send a message to the Bluetooth module, gathered from several pieces
+// SOF, length, cmd0, cmd1 and the FCS are generated here,
+// the FCS is computed over the spans with FCS_Update before the frame starts,
+// so the bytes go out back to back, nothing is copied
+// Input: cmd0, cmd1 NPI command
+//        spans points to the payload pieces, in the order sent
+//        count is the number of pieces, 0 for no payload
+// Output: APOK on success, APFAIL on timeout
+int AP_SendSpans(uint8_t cmd0, uint8_t cmd1, const span_t *spans, uint32_t count);
+
+//------------AP_SendSpansResponse------------
+// AP_SendSpans, then receive the response from the Bluetooth module
+// Input: cmd0, cmd1, spans, count as in AP_SendSpans
+//        responsePt points to empty buffer into which data is returned
+//        maximum size (discard data beyond this limit)
+// Output: APOK if ok, APFAIL on error (timeout or fcs error)
+int AP_SendSpansResponse(uint8_t cmd0, uint8_t cmd1, const span_t *spans, uint32_t count,
+  uint8_t *responsePt, uint32_t max);
+
 // ------------AP_Delay1ms------------
 // Simple delay function which delays about n milliseconds.
 // Inputs: n, number of msec to wait
@@ -165,7 +356,7 @@ int AP_RegisterService(void);
 // Add a read, write, or read/write characteristic
 //        for notify properties, call AP_AddNotifyCharacteristic 
 // Inputs uuid is 0xFFF0, 0xFFF1, ...
-//        thesize is the number of bytes in the user data 1,2,4, or 8 
+//        thesize is the number of bytes in the user data, 1 to APMAXVALUESIZE
 //        pt is a pointer to the user data, stored little endian
 //        permission is GATT Permission, 0=none,1=read,2=write, 3=Read+write 
 //        properties is GATT Properties, 2=read,8=write,0x0A=read+write
@@ -173,7 +364,7 @@ int AP_RegisterService(void);
 //        (*ReadFunc) called before it responses with data from internal structure
 //        (*WriteFunc) called after it accepts data into internal structure
 // Output APOK if successful,
-//        APFAIL if name is empty, more than 8 characteristics, or if SNP failure
+//        APFAIL if name is empty, more than MAXCHARACTERISTICS characteristics, or if SNP failure
 int AP_AddCharacteristic(uint16_t uuid, uint16_t thesize, void *pt, uint8_t permission,
   uint8_t properties, char name[], void(*ReadFunc)(void), void(*WriteFunc)(void));
 
@@ -181,22 +372,132 @@ int AP_AddCharacteristic(uint16_t uuid, uint16_t thesize, void *pt, uint8_t perm
 // Add a notify characteristic
 //        for read, write, or read/write characteristic, call AP_AddCharacteristic 
 // Inputs uuid is 0xFFF0, 0xFFF1, ...
-//        thesize is the number of bytes in the user data 1,2,4, or 8 
+//        thesize is the number of bytes in the user data, 1 to APMAXVALUESIZE
 //        pt is a pointer to the user data, stored little endian
 //        name is a null-terminated string, maximum length of name is 20 bytes
 //        (*CCCDfunc) called after it accepts , changing CCCDvalue
 // Output APOK if successful,
-//        APFAIL if name is empty, more than 4 notify characteristics, or if SNP failure
+//        APFAIL if name is empty, more than NOTIFYMAXCHARACTERISTICS notify characteristics, or if SNP failure
 int AP_AddNotifyCharacteristic(uint16_t uuid, uint16_t thesize,  void *pt, 
   char name[], void(*CCCDfunc)(void));
+
+//*************AP_SaveCharacteristic**************
+// Record a read/write characteristic the SNP has accepted,
+// so Read and Write Indications on its handle reach the user data
+// called by AP_AddCharacteristic and Lab6_AddCharacteristic
+// Inputs handle is the value handle returned by SNP Add Characteristic Value
+//        thesize, pt, (*ReadFunc), (*WriteFunc) as in AP_AddCharacteristic
+// Output APOK if successful,
+//        APFAIL if more than MAXCHARACTERISTICS characteristics
+int AP_SaveCharacteristic(uint16_t handle, uint16_t thesize, void *pt,
+  void(*ReadFunc)(void), void(*WriteFunc)(void));
+
+//*************AP_SaveNotifyCharacteristic**************
+// Record a notify characteristic the SNP has accepted,
+// so CCCD Updated Indications on its CCCD handle reach it
+// called by AP_AddNotifyCharacteristic and Lab6_AddNotifyCharacteristic
+// Inputs uuid, thesize, pt, (*CCCDfunc) as in AP_AddNotifyCharacteristic
+//        handle is the value handle returned by SNP Add Characteristic Value
+//        CCCDhandle is the handle returned by SNP Add Characteristic Descriptor
+// Output APOK if successful,
+//        APFAIL if more than NOTIFYMAXCHARACTERISTICS notify characteristics
+int AP_SaveNotifyCharacteristic(uint16_t uuid, uint16_t handle, uint16_t CCCDhandle,
+  uint16_t thesize, void *pt, void(*CCCDfunc)(void));
   
+//*************AP_AddServiceTable**************
+// Add a service with all its characteristics from a const table and register it
+// frames are sent back to back, without the APDEBUG log
+// the table is remembered, so AP_Supervise can add it again after an SNP reset
+// Inputs uuid is the service, 0xFFF0, 0xFFE0, ...
+//        table points to the characteristics, in the order they are added
+//        count is the number of entries in table
+// Output APOK if successful,
+//        APFAIL if an entry is not valid, too many characteristics, or if SNP failure
+int AP_AddServiceTable(uint16_t uuid, const gatt_t *table, uint32_t count);
+
+#define APMAXSERVICES    4       // service tables AP_Supervise can replay
+#define APFAILLIMIT      3       // failed exchanges in a row before the SNP is reset
+#define APRECOVERHOLDOFF 1000000 // us between attempts after a failed recovery
+extern uint32_t APRecoveries;     // number of times AP_Supervise reset the SNP
+extern uint32_t APRecoverFails;   // recoveries that did not get the SNP back
+extern uint32_t APRecoverTime;    // duration of the last recovery, us
+extern uint32_t APRecoverMax;     // longest recovery, us
+
+//*************AP_Supervise**************
+// Check the health of the SNP link, call from the Bluetooth thread
+// after APFAILLIMIT failed exchanges in a row (timeout, missing SOF, FCS error),
+// or an unexpected SNP power up, the NPI capture is dumped (APCAPTURE), the SNP is reset,
+// the services added with AP_AddServiceTable are added again in the same order,
+// notify settings are kept with the new handles, CCCDs start off until the phone
+// subscribes again, and advertising is restarted
+// the reset never waits, it is stepped like AP_InitRun, so keep calling while it
+// returns APBUSY, yielding in between, and do not process SNP frames meanwhile
+// takes at most about 1.5 s, a failed recovery is retried every APRECOVERHOLDOFF
+// Input:  none
+// Output: APOK if the link is fine or was recovered,
+//         APBUSY while the SNP is resetting,
+//         APFAIL if a recovery failed or is held off
+int AP_Supervise(void);
+
+//*************AP_GetBootTime**************
+// Time from the start of AP_Init until advertising started
+// Input:  none
+// Output: time in us, 0 if not advertising yet
+uint32_t AP_GetBootTime(void);
+
 //*************AP_SendNotification**************
 // Send a notification (will skip if CCCD is 0) 
+// sent as a notification or indication, see AP_SetNotifyType
 // Input:  index into notify characteristic to send
 // Output: APOK if successful,
+//         APBUSY if SNP has no buffer free this connection event, nothing sent
 //         APFAIL if notification not configured, or if SNP failure
 int AP_SendNotification(uint32_t i);
 
+//*************AP_SetNotifyType**************
+// Choose how a notify characteristic is sent, default is APNOTIFY
+// if the phone enabled only the other type in the CCCD, that one is used
+// Input:  i index into notify characteristic
+//         type APNOTIFY (unacknowledged) or APINDICATE (acknowledged)
+// Output: APOK if successful,
+//         APFAIL if i or type not valid
+int AP_SetNotifyType(uint32_t i, uint8_t type);
+
+//*************AP_SetNotifyPolicy**************
+// Have AP_NotifyProcess send a notify characteristic automatically
+// it compares the user variable with a copy of the value last sent
+// Input:  i index into notify characteristic
+//         policy APPOLICYNONE, APPOLICYCHANGE or APPOLICYDEADBAND
+//         deadband smallest change sent, for APPOLICYDEADBAND
+//         minInterval ms, at most one notification per minInterval
+//         maxInterval ms, at least one notification per maxInterval, 0 for never
+// Output: APOK if successful,
+//         APFAIL if i or policy not valid
+int AP_SetNotifyPolicy(uint32_t i, uint8_t policy, uint32_t deadband,
+  uint16_t minInterval, uint16_t maxInterval);
+
+//*************AP_NotifyProcess**************
+// Send the notify characteristics whose policy calls for it
+// call often from the Bluetooth thread, never blocks
+// Input:  none
+// Output: number of notifications sent
+uint32_t AP_NotifyProcess(void);
+
+//*************AP_GetNotifyCredits**************
+// Number of notifications SNP can still accept this connection event
+// Input:  none
+// Output: 0 to APNOTIFYCREDITS
+uint32_t AP_GetNotifyCredits(void);
+
+//*************AP_SetNotifyLength**************
+// Set how many bytes of a notify characteristic the next notification sends
+// used for variable-length values such as a block of samples
+// Input:  i index into notify characteristic
+//         length number of bytes, 1 to the size given when it was added
+// Output: APOK if successful,
+//         APFAIL if i or length not valid
+int AP_SetNotifyLength(uint32_t i, uint16_t length);
+
 //*************AP_StartAdvertisement**************
 // Start advertisement
 // Input:  none
@@ -220,6 +521,21 @@ uint32_t AP_GetStatus(void);
 // Output: version
 uint32_t AP_GetVersion(void);
 
+//*************AP_SetBaud**************
+// Move both ends of the NPI link to a new baud rate, between exchanges
+// checks the link with Get Status at the new rate, and goes back if it fails
+// SimpleNP 2.2 has no command to change its UART rate, so unless
+// SNPEMULATOR is defined any rate but UART1BAUD returns APUNSUPPORTED
+// and the link is left alone; the SNP emulator follows any rate the
+// UART1 divisors allow, to test the switch-over only: the emulated link
+// has no wire, so no throughput at any rate has been measured on hardware
+// a hardware reset of the SNP returns the link to UART1BAUD
+// Input:  baud bits/sec
+// Output: APOK if the link runs at the new rate,
+//         APFAIL if the emulator or UART1 cannot change rate or the check failed,
+//         APUNSUPPORTED with a real SNP
+int AP_SetBaud(uint32_t baud);
+
 // ****AP_BackgroundProcess****
 // handle incoming SNP frames
 // Inputs:  none
@@ -233,6 +549,59 @@ void AP_BackgroundProcess(void);
 // extracted little Endian from byte 1 and byte 2
 uint32_t AP_GetSize(uint8_t *pt);
 
+// SNP Event Indication (0x55,0x05) event types
+#define SNP_CONN_EST_EVT           0x0001  // connection established
+#define SNP_CONN_TERM_EVT          0x0002  // connection terminated
+#define SNP_CONN_PARAM_UPDATED_EVT 0x0004  // connection parameters updated
+#define SNP_ADV_STARTED_EVT        0x0008  // advertising started
+#define SNP_ADV_ENDED_EVT          0x0010  // advertising ended
+#define SNP_ATT_MTU_EVT            0x0020  // ATT MTU updated
+#define SNP_ERROR_EVT              0x8000  // SNP error
+#define APDEFAULTMTU 23  // ATT MTU before the phone negotiates a larger one
+#define APMAXHANDLERS 16 // maximum number of (cmd0,cmd1) frame handlers
+
+//*************AP_RegisterHandler**************
+// Install the function AP_BackgroundProcess calls when
+// a frame with this (cmd0,cmd1) arrives from the SNP,
+// replacing any handler already installed for that pair.
+// AP_Init installs handlers for Read (0x55,0x87), Write (0x55,0x88),
+// CCCD (0x55,0x8B), Event (0x55,0x05) and Power Up (0x55,0x01) indications,
+// so call this after AP_Init
+// Inputs cmd0 is the NPI command type/subsystem, 0x55 for SNP asynchronous
+//        cmd1 is the NPI command id
+//        (*handler) called with a pointer to the received frame, 0 to remove
+// Output APOK if successful,
+//        APFAIL if more than APMAXHANDLERS handlers
+int AP_RegisterHandler(uint8_t cmd0, uint8_t cmd1, void(*handler)(uint8_t *msg));
+
+//*************AP_SetEventCallback**************
+// Install the function called after AP_BackgroundProcess
+// receives an SNP Event Indication and updates the link state
+// Input:  (*EventFunc) called with the SNP_xxx_EVT event type, 0 for none
+// Output: none
+void AP_SetEventCallback(void(*EventFunc)(uint16_t event));
+
+//*************AP_IsConnected**************
+// Link state kept up to date by SNP Event Indications
+// this does not perform BLE communication
+// Input:  none
+// Output: 1 if a phone is connected, 0 if not
+uint32_t AP_IsConnected(void);
+
+//*************AP_GetMTU**************
+// Negotiated ATT MTU of the current connection
+// this does not perform BLE communication
+// Input:  none
+// Output: ATT MTU in bytes, APDEFAULTMTU until the phone negotiates
+uint16_t AP_GetMTU(void);
+
+//*************AP_GetConnInterval**************
+// Connection interval of the current connection
+// this does not perform BLE communication
+// Input:  none
+// Output: connection interval in 1.25 ms units, 0 if not connected
+uint16_t AP_GetConnInterval(void);
+
 // source https://docs.mbed.com/docs/ble-api/en/master/api/classGattCharacteristic.html
 enum GattDescription   {
   UUID_BATTERY_LEVEL_STATE_CHAR = 0x2A1B, UUID_BATTERY_POWER_STATE_CHAR = 0x2A1A, UUID_REMOVABLE_CHAR = 0x2A3A, UUID_SERVICE_REQUIRED_CHAR = 0x2A3B,
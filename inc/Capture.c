@@ -0,0 +1,163 @@
+// Capture.c
+// Runs on TM4C123
+// Binary capture of the NPI frames between the TM4C123 and the CC2650
+// see Capture.h for the record and dump formats
+
+#include <stdint.h>
+#include "../inc/AP.h"
+#ifdef APCAPTURE
+#include "../inc/BSP.h"
+#include "../inc/UART0.h"
+#include "../inc/FCS.h"
+#include "../inc/Capture.h"
+#include "../inc/Diag.h"
+
+uint8_t CaptureRing[CAPTURESIZE];
+// free running byte indices, get is the start of the oldest record
+uint32_t CapturePut;
+uint32_t CaptureGet;
+uint32_t CaptureLost;    // records dropped to make room for new ones
+uint8_t CaptureEnable;   // 0 to freeze the capture
+
+//*************Capture_Init**************
+// Empty the ring buffer and start capturing
+// Inputs: none
+// Output: none
+void Capture_Init(void){
+  CapturePut = CaptureGet = 0;
+  CaptureLost = 0;
+  Diag_Register(DIAGCAPTURELOST, &CaptureLost);
+  CaptureEnable = 1;
+}
+
+// ****captureAt****
+// byte of the ring at a free running index
+#define captureAt(I) CaptureRing[(I)&(CAPTURESIZE-1)]
+
+// ****captureBegin****
+// make room for a record of size frame bytes and write its header
+// Output: size actually recorded
+uint32_t static captureBegin(uint8_t flags, uint32_t size){ uint32_t time,n;
+  if(size > CAPTURESIZE-CAPTUREHEADER){
+    size = CAPTURESIZE-CAPTUREHEADER;
+  }
+  while((CAPTURESIZE-(CapturePut-CaptureGet)) < size+CAPTUREHEADER){
+    n = captureAt(CaptureGet+5)+(captureAt(CaptureGet+6)<<8);
+    CaptureGet = CaptureGet+CAPTUREHEADER+n;  // drop the oldest record
+    CaptureLost++;
+  }
+  time = BSP_Time_Get();
+  captureAt(CapturePut) = flags;
+  captureAt(CapturePut+1) = time&0xFF;
+  captureAt(CapturePut+2) = (time>>8)&0xFF;
+  captureAt(CapturePut+3) = (time>>16)&0xFF;
+  captureAt(CapturePut+4) = time>>24;
+  captureAt(CapturePut+5) = size&0xFF;
+  captureAt(CapturePut+6) = size>>8;
+  CapturePut = CapturePut+CAPTUREHEADER;
+  return size;
+}
+
+//*************Capture_Frame**************
+// Record a frame, or the part of it that was stored
+// Inputs: flags CAPTURERX, CAPTUREFAIL
+//         pt points to the SOF of the frame
+//         size number of bytes, 0 for none
+// Output: none
+void Capture_Frame(uint8_t flags, const uint8_t *pt, uint32_t size){ uint32_t i;
+  if(CaptureEnable == 0) return;
+  size = captureBegin(flags,size);
+  for(i=0; i<size; i++){
+    captureAt(CapturePut) = pt[i];
+    CapturePut++;
+  }
+}
+
+//*************Capture_Spans**************
+// Record a frame sent by AP_SendSpans
+// Inputs: flags CAPTUREFAIL
+//         cmd0, cmd1, spans, count as in AP_SendSpans
+// Output: none
+void Capture_Spans(uint8_t flags, uint8_t cmd0, uint8_t cmd1, const span_t *spans, uint32_t count){
+  uint32_t i,j,size; uint8_t fcs,header[5];
+  if(CaptureEnable == 0) return;
+  size = 0;
+  for(i=0; i<count; i++){
+    size = size+spans[i].size;
+  }
+  if(captureBegin(flags,size+6) != size+6){
+    CapturePut = CapturePut-CAPTUREHEADER;  // cannot be larger than the ring
+    return;
+  }
+  header[0] = SOF; header[1] = size&0xFF; header[2] = size>>8;
+  header[3] = cmd0; header[4] = cmd1;
+  fcs = FCS_Update(0,&header[1],4);
+  for(i=0; i<5; i++){
+    captureAt(CapturePut) = header[i];
+    CapturePut++;
+  }
+  for(i=0; i<count; i++){
+    fcs = FCS_Update(fcs,spans[i].pt,spans[i].size);
+    for(j=0; j<spans[i].size; j++){
+      captureAt(CapturePut) = spans[i].reverse ? spans[i].pt[spans[i].size-1-j] : spans[i].pt[j];
+      CapturePut++;
+    }
+  }
+  captureAt(CapturePut) = fcs;
+  CapturePut++;
+}
+
+// ****captureOut32****
+// 32-bit number to UART0, little endian
+void static captureOut32(uint32_t n){
+  UART0_OutChar(n&0xFF);
+  UART0_OutChar((n>>8)&0xFF);
+  UART0_OutChar((n>>16)&0xFF);
+  UART0_OutChar(n>>24);
+}
+
+//*************Capture_Dump**************
+// Send the capture over UART0, binary
+// Inputs: none
+// Output: number of records sent
+uint32_t Capture_Dump(void){ uint32_t i,next,records; uint8_t fcs,enable;
+  enable = CaptureEnable;
+  CaptureEnable = 0;
+  UART0_OutChar('N'); UART0_OutChar('P'); UART0_OutChar('I'); UART0_OutChar('C');
+  UART0_OutChar(CAPTUREVERSION);
+  captureOut32(CapturePut-CaptureGet);
+  captureOut32(CaptureLost);
+  fcs = 0;
+  records = 0;
+  next = CaptureGet;
+  for(i=CaptureGet; i!=CapturePut; i++){
+    if(i == next){             // start of a record
+      next = i+CAPTUREHEADER+captureAt(i+5)+(captureAt(i+6)<<8);
+      records++;
+    }
+    fcs = FCS_Byte(fcs,captureAt(i));
+    UART0_OutChar(captureAt(i));
+  }
+  UART0_OutChar(fcs);
+  CaptureEnable = enable;
+  return records;
+}
+
+//*************Capture_Copy**************
+// Copy the records, oldest first
+// Inputs: pt points to a buffer of max bytes
+// Output: number of bytes copied, whole records only
+uint32_t Capture_Copy(uint8_t *pt, uint32_t max){ uint32_t i,n,count;
+  count = 0;
+  i = CaptureGet;
+  while(i != CapturePut){
+    n = CAPTUREHEADER+captureAt(i+5)+(captureAt(i+6)<<8);
+    if(count+n > max) break;
+    while(n){
+      pt[count] = captureAt(i);
+      count++; i++; n--;
+    }
+  }
+  return count;
+}
+#endif
@@ -0,0 +1,68 @@
+// Capture.h
+// Runs on TM4C123
+// Binary capture of the NPI frames between the TM4C123 and the CC2650
+// AP.c records every frame it sends or receives, with a timestamp,
+// into a RAM ring buffer; the oldest records are dropped when it fills
+// Capture_Dump sends the records over UART0 to the PC,
+// SNP_Replay in SNP_Emulator.c plays a capture back into AP.c
+// compiled only when APCAPTURE is defined in AP.h
+
+// Record, all fields little endian
+// byte 0     flags, CAPTURERX and CAPTUREFAIL
+// byte 1-4   BSP_Time_Get when the frame was sent or received, us
+// byte 5,6   n, number of frame bytes that follow
+// byte 7...  the frame from SOF to FCS, as sent or as stored in the receive buffer
+//            n is 0 for a receive that timed out or lost its SOF
+// Dump over UART0
+// "NPIC", version (1 byte), record bytes (4 bytes), records dropped (4 bytes),
+// the records oldest first, then the 8-bit XOR of the record bytes
+
+#ifndef __CAPTURE_H
+#define __CAPTURE_H  1
+
+#define CAPTURERX    0x01  // frame from SNP to AP, 0 for AP to SNP
+#define CAPTUREFAIL  0x02  // exchange failed, timeout, lost SOF or bad FCS
+#define CAPTUREHEADER 7    // bytes in front of each frame
+#define CAPTUREVERSION 1
+// bytes in the ring buffer, must be a power of 2
+#define CAPTURESIZE 1024
+
+extern uint32_t CaptureLost;   // records dropped to make room for new ones
+extern uint8_t CaptureEnable;  // 0 to freeze the capture, e.g. while dumping it
+
+//*************Capture_Init**************
+// Empty the ring buffer and start capturing
+// Inputs: none
+// Output: none
+void Capture_Init(void);
+
+//*************Capture_Frame**************
+// Record a frame, or the part of it that was stored
+// called by AP.c from the Bluetooth thread
+// Inputs: flags CAPTURERX, CAPTUREFAIL
+//         pt points to the SOF of the frame
+//         size number of bytes, 0 for none
+// Output: none
+void Capture_Frame(uint8_t flags, const uint8_t *pt, uint32_t size);
+
+//*************Capture_Spans**************
+// Record a frame sent by AP_SendSpans
+// Inputs: flags CAPTUREFAIL
+//         cmd0, cmd1, spans, count as in AP_SendSpans
+// Output: none
+void Capture_Spans(uint8_t flags, uint8_t cmd0, uint8_t cmd1, const span_t *spans, uint32_t count);
+
+//*************Capture_Dump**************
+// Send the capture over UART0 in the format above, binary
+// capture is frozen while it runs, call from the Bluetooth thread
+// Inputs: none
+// Output: number of records sent
+uint32_t Capture_Dump(void);
+
+//*************Capture_Copy**************
+// Copy the records, oldest first, for SNP_Replay or a debugger
+// Inputs: pt points to a buffer of max bytes
+// Output: number of bytes copied, whole records only
+uint32_t Capture_Copy(uint8_t *pt, uint32_t max);
+
+#endif
@@ -0,0 +1,71 @@
+// Diag.c
+// Runs on TM4C123
+// Registry of the overflow, drop and error counters kept by each module
+// see Diag.h for the IDs and the snapshot layout
+
+#include <stdint.h>
+#include "../inc/CortexM.h"
+#include "../inc/UART0.h"
+#include "../inc/Diag.h"
+
+volatile uint32_t *DiagCounter[DIAGCOUNT];  // 0 if not registered
+uint32_t DiagSnapshot[DIAGCOUNT];
+
+// indexed by the IDs in Diag.h
+const char * const DiagName[DIAGCOUNT] = {
+  "LostData",
+  "LostTask1Data",
+  "RxFifoLost",
+  "RxOverrun",
+  "RxFramingErr",
+  "UART1DMAErrors",
+  "fcserr",
+  "TimeOutErr",
+  "NoSOFErr",
+  "RecoverFails",
+  "LogLost",
+  "CaptureLost",
+  "StreamDrops",
+  "TelemetryLost",
+  "UART0Lost"
+};
+
+//*************Diag_Register**************
+// Report a counter into the registry, called from the module's init
+// Inputs: id DIAGLOSTDATA ... DIAGUART0LOST
+//         counter points to the module's counter
+// Output: none
+void Diag_Register(uint32_t id, volatile uint32_t *counter){
+  if(id < DIAGCOUNT){
+    DiagCounter[id] = counter;
+  }
+}
+
+//*************Diag_Snapshot**************
+// Copy every registered counter into DiagSnapshot at one instant
+// Inputs: none
+// Output: sum of all counters, 0 if nothing was lost
+uint32_t Diag_Snapshot(void){ uint32_t i,sum; long sr;
+  sr = StartCritical();
+  for(i=0; i<DIAGCOUNT; i++){
+    DiagSnapshot[i] = DiagCounter[i] ? *DiagCounter[i] : 0;
+  }
+  EndCritical(sr);
+  sum = 0;
+  for(i=0; i<DIAGCOUNT; i++){
+    sum += DiagSnapshot[i];
+  }
+  return sum;
+}
+
+//*************Diag_Dump**************
+// Take a snapshot and print it on UART0, one name=value per line
+// Inputs: none
+// Output: none
+void Diag_Dump(void){ uint32_t i;
+  Diag_Snapshot();
+  UART0_Printf("\n\rDiagnostics");
+  for(i=0; i<DIAGCOUNT; i++){
+    UART0_Printf("\n\r%s=%u",DiagName[i],DiagSnapshot[i]);
+  }
+}
@@ -0,0 +1,58 @@
+// Diag.h
+// Runs on TM4C123
+// Registry of the overflow, drop and error counters kept by each module
+// every module registers its counters in its init function, under a fixed
+// ID below, so the layout does not depend on the order of initialization
+// Diag_Snapshot copies all of them at one instant, with interrupts disabled;
+// Lab6.c publishes the snapshot as a BLE read characteristic and Diag_Dump
+// prints it on UART0
+
+// Snapshot, DIAGCOUNT 32-bit numbers, little endian, indexed by the IDs
+// below, 0 for a counter no module registered (e.g. UART1 with the emulator)
+
+#ifndef __DIAG_H
+#define __DIAG_H  1
+
+// counter IDs, the names are in Diag.c, keep the two lists in step
+#define DIAGLOSTDATA       0   // os.c, OS FIFO full
+#define DIAGLOSTTASK1DATA  1   // Lab6.c, accelerometer sample lost in Task1
+#define DIAGRXFIFOLOST     2   // UART1.c, receive buffer full
+#define DIAGRXOVERRUN      3   // UART1.c, hardware RX FIFO overrun
+#define DIAGRXFRAMINGERR   4   // UART1.c, byte without a stop bit
+#define DIAGUART1DMAERRORS 5   // UART1.c, uDMA bus errors
+#define DIAGFCSERR         6   // AP.c, frames from the SNP with a bad FCS
+#define DIAGTIMEOUTERR     7   // AP.c, SNP did not answer
+#define DIAGNOSOFERR       8   // AP.c, frame without SOF
+#define DIAGRECOVERFAILS   9   // AP.c, SNP recoveries that failed
+#define DIAGLOGLOST       10   // Log.c, debug records dropped
+#define DIAGCAPTURELOST   11   // Capture.c, captured frames overwritten
+#define DIAGSTREAMDROPS   12   // Stream.c, raw samples dropped
+#define DIAGTELEMETRYLOST 13   // Telemetry.c, telemetry records dropped
+#define DIAGUART0LOST     14   // UART0.c, console characters dropped
+#define DIAGCOUNT         15   // number of IDs, at most APMAXVALUESIZE/4
+
+extern uint32_t DiagSnapshot[DIAGCOUNT];  // values at the last Diag_Snapshot
+
+//*************Diag_Register**************
+// Report a counter into the registry, called from the module's init
+// registering the same ID again replaces the pointer
+// Inputs: id DIAGLOSTDATA ... DIAGUART0LOST
+//         counter points to the module's counter
+// Output: none
+void Diag_Register(uint32_t id, volatile uint32_t *counter);
+
+//*************Diag_Snapshot**************
+// Copy every registered counter into DiagSnapshot at one instant
+// interrupts are disabled for DIAGCOUNT loads
+// Inputs: none
+// Output: sum of all counters, 0 if nothing was lost
+uint32_t Diag_Snapshot(void);
+
+//*************Diag_Dump**************
+// Take a snapshot and print it on UART0, one name=value per line
+// uses UART0_Printf, so it never waits
+// Inputs: none
+// Output: none
+void Diag_Dump(void);
+
+#endif
@@ -0,0 +1,73 @@
+// FCS.c
+// Runs on TM4C123, also compiles on the PC
+// NPI frame check sequence, see FCS.h
+// the byte-at-a-time loop costs a load, an XOR and a loop test per byte
+// here the aligned middle of the block is read one 32-bit word at a time
+// and folded to 8 bits once, about 4 times fewer loads and branches
+// bytes before the first word boundary and after the last one are done singly
+
+#include <stdint.h>
+#include <string.h>
+#include "FCS.h"
+
+// ****load32****
+// 32-bit word from a word aligned byte pointer
+// memcpy keeps it legal C, the bytes are never accessed as uint32_t objects,
+// and the compiler turns it into a single LDR
+uint32_t static load32(const uint8_t *pt){ uint32_t word;
+  memcpy(&word,pt,4);
+  return word;
+}
+
+//*************FCS_Update**************
+// Add a block of bytes to a running FCS
+// Inputs: fcs running value, start with 0
+//         pt points to the bytes
+//         size number of bytes
+// Output: new running value
+uint8_t FCS_Update(uint8_t fcs, const uint8_t *pt, uint32_t size){
+  uint32_t word;
+  // head, up to 3 bytes until pt is word aligned
+  while(size&&((uintptr_t)pt&3)){
+    fcs = fcs^*pt; pt++;
+    size--;
+  }
+  // middle, whole words, 4 per iteration
+  word = 0;
+  while(size >= 16){
+    word = word^load32(pt)^load32(&pt[4])^load32(&pt[8])^load32(&pt[12]);
+    pt = pt+16;
+    size = size-16;
+  }
+  while(size >= 4){
+    word = word^load32(pt); pt = pt+4;
+    size = size-4;
+  }
+  word = word^(word>>16);        // fold 32 bits to 8
+  word = word^(word>>8);
+  fcs = fcs^(uint8_t)word;
+  // tail, up to 3 bytes
+  while(size){
+    fcs = fcs^*pt; pt++;
+    size--;
+  }
+  return fcs;
+}
+
+//*************FCS_Frame**************
+// FCS of a complete NPI frame, the length field must be set
+// Inputs: msg points to the SOF of the frame
+// Output: FCS over length, command and payload
+uint8_t FCS_Frame(const uint8_t *msg){ uint32_t size;
+  size = msg[1]+(msg[2]<<8);     // payload bytes
+  return FCS_Update(0,&msg[1],size+4);
+}
+
+//*************FCS_Set**************
+// Store the FCS at the end of an NPI frame
+// Inputs: msg points to the SOF of the frame
+// Output: none
+void FCS_Set(uint8_t *msg){ uint32_t size;
+  size = msg[1]+(msg[2]<<8);
+  msg[5+size] = FCS_Frame(msg);
+}
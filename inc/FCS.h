@@ -0,0 +1,40 @@
+// FCS.h
+// Runs on TM4C123, also compiles on the PC
+// NPI frame check sequence, the 8-bit XOR of every byte except SOF and the FCS itself
+// XOR does not care about byte order, so the bytes are folded 32 bits at a time
+// and the 32-bit result folded down to 8 bits at the end
+// the running FCS can be updated piece by piece as a frame is built or sent
+
+#ifndef __FCS_H
+#define __FCS_H  1
+
+//*************FCS_Byte**************
+// Add one byte to a running FCS
+// Inputs: fcs running value, start with 0
+//         data byte to add
+// Output: new running value
+#define FCS_Byte(FCS,DATA) ((uint8_t)((FCS)^(DATA)))
+
+//*************FCS_Update**************
+// Add a block of bytes to a running FCS
+// the block may start and end on any byte address
+// Inputs: fcs running value, start with 0
+//         pt points to the bytes
+//         size number of bytes, 0 returns fcs unchanged
+// Output: new running value
+uint8_t FCS_Update(uint8_t fcs, const uint8_t *pt, uint32_t size);
+
+//*************FCS_Frame**************
+// FCS of a complete NPI frame, the length field must be set
+// Inputs: msg points to the SOF of the frame
+// Output: FCS over length, command and payload
+uint8_t FCS_Frame(const uint8_t *msg);
+
+//*************FCS_Set**************
+// Store the FCS at the end of an NPI frame
+// every byte but the FCS must be set, including the length field
+// Inputs: msg points to the SOF of the frame
+// Output: none
+void FCS_Set(uint8_t *msg);
+
+#endif
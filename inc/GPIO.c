@@ -81,6 +81,48 @@ void GPIO_Init(void){
   
   ClearReset();     // RESET=0    
 }
+void (*SRDYTask)(void);  // run on each falling edge of SRDY
+uint32_t SRDYEdges;      // falling edges of SRDY
+//------------GPIO_SRDYInterrupt------------
+// Interrupt on the falling edge of SRDY, PB2
+// Input: task called in the ISR on each falling edge
+//        priority 0 (highest) to 7 (lowest)
+// Output: none
+void GPIO_SRDYInterrupt(void(*task)(void), uint32_t priority){
+  SRDYTask = task;
+  SRDYEdges = 0;
+  GPIO_PORTB_IS_R &= ~0x04;        // PB2 is edge-sensitive
+  GPIO_PORTB_IBE_R &= ~0x04;       // not both edges
+  GPIO_PORTB_IEV_R &= ~0x04;       // falling edge event
+  GPIO_PORTB_ICR_R = 0x04;         // clear flag2
+  GPIO_PORTB_IM_R |= 0x04;         // arm interrupt on PB2
+  NVIC_PRI0_R = (NVIC_PRI0_R&0xFFFF00FF)|((priority&0x07)<<13); // interrupt 1
+  NVIC_EN0_R = 0x00000002;         // enable interrupt 1 in NVIC
+}
+void GPIOPortB_Handler(void){
+  GPIO_PORTB_ICR_R = 0x04;         // acknowledge flag2
+  SRDYEdges++;
+  (*SRDYTask)();
+}
+//------------GPIO_SRDYDisarm------------
+// Mask the SRDY edge interrupt, the edge flag still latches
+// Input: none
+// Output: none
+void GPIO_SRDYDisarm(void){
+  GPIO_PORTB_IM_R &= ~0x04;        // disarm interrupt on PB2
+}
+//------------GPIO_SRDYArm------------
+// Clear the edges latched since GPIO_SRDYDisarm and arm the interrupt again
+// Input: none
+// Output: none
+void GPIO_SRDYArm(void){
+  if(SRDYTask == 0) return;        // GPIO_SRDYInterrupt not called yet
+  GPIO_PORTB_ICR_R = 0x04;         // clear flag2, edges of the AP exchanges
+  GPIO_PORTB_IM_R |= 0x04;         // arm interrupt on PB2
+  if(ReadSRDY() == 0){
+    (*SRDYTask)();                 // fell while disarmed, SNP has a frame
+  }
+}
 #else
 // These three options require either reprogramming the CC2650LP/CC2650BP or using a 7-wire tether
 // These three options allow the use of the MKII I/O boosterpack
@@ -154,4 +196,46 @@ void GPIO_Init(void){
   ClearReset();     // RESET=0    
   
 }
+void (*SRDYTask)(void);  // run on each falling edge of SRDY
+uint32_t SRDYEdges;      // falling edges of SRDY
+//------------GPIO_SRDYInterrupt------------
+// Interrupt on the falling edge of SRDY, PA3
+// Input: task called in the ISR on each falling edge
+//        priority 0 (highest) to 7 (lowest)
+// Output: none
+void GPIO_SRDYInterrupt(void(*task)(void), uint32_t priority){
+  SRDYTask = task;
+  SRDYEdges = 0;
+  GPIO_PORTA_IS_R &= ~0x08;        // PA3 is edge-sensitive
+  GPIO_PORTA_IBE_R &= ~0x08;       // not both edges
+  GPIO_PORTA_IEV_R &= ~0x08;       // falling edge event
+  GPIO_PORTA_ICR_R = 0x08;         // clear flag3
+  GPIO_PORTA_IM_R |= 0x08;         // arm interrupt on PA3
+  NVIC_PRI0_R = (NVIC_PRI0_R&0xFFFFFF00)|((priority&0x07)<<5); // interrupt 0
+  NVIC_EN0_R = 0x00000001;         // enable interrupt 0 in NVIC
+}
+void GPIOPortA_Handler(void){
+  GPIO_PORTA_ICR_R = 0x08;         // acknowledge flag3
+  SRDYEdges++;
+  (*SRDYTask)();
+}
+//------------GPIO_SRDYDisarm------------
+// Mask the SRDY edge interrupt, the edge flag still latches
+// Input: none
+// Output: none
+void GPIO_SRDYDisarm(void){
+  GPIO_PORTA_IM_R &= ~0x08;        // disarm interrupt on PA3
+}
+//------------GPIO_SRDYArm------------
+// Clear the edges latched since GPIO_SRDYDisarm and arm the interrupt again
+// Input: none
+// Output: none
+void GPIO_SRDYArm(void){
+  if(SRDYTask == 0) return;        // GPIO_SRDYInterrupt not called yet
+  GPIO_PORTA_ICR_R = 0x08;         // clear flag3, edges of the AP exchanges
+  GPIO_PORTA_IM_R |= 0x08;         // arm interrupt on PA3
+  if(ReadSRDY() == 0){
+    (*SRDYTask)();                 // fell while disarmed, SNP has a frame
+  }
+}
 #endif
@@ -123,3 +123,30 @@
 // Input: none
 // Output: none
 void GPIO_Init(void);
+
+//------------GPIO_SRDYInterrupt------------
+// Interrupt on the falling edge of SRDY, the SNP has a frame or is ready
+// SRDY also falls during each AP-initiated exchange, so AP.c masks the
+// interrupt with GPIO_SRDYDisarm at the start of each exchange, and the
+// task calls GPIO_SRDYArm when it is done with the link, before it blocks
+// the ISR counts edges in SRDYEdges, then runs task, e.g. OS_Signal
+// SRDY is PB2 (DEFAULT) or PA3, the rest of the port is not touched
+// Input: task called in the ISR on each falling edge
+//        priority 0 (highest) to 7 (lowest)
+// Output: none
+void GPIO_SRDYInterrupt(void(*task)(void), uint32_t priority);
+extern uint32_t SRDYEdges;  // falling edges of SRDY seen by the ISR
+
+//------------GPIO_SRDYDisarm------------
+// Mask the SRDY edge interrupt, the edge flag still latches
+// Input: none
+// Output: none
+void GPIO_SRDYDisarm(void);
+
+//------------GPIO_SRDYArm------------
+// Clear the edges latched since GPIO_SRDYDisarm and arm the interrupt again
+// if SRDY is already low, the SNP has a frame waiting, so task is run here
+// does nothing before GPIO_SRDYInterrupt
+// Input: none
+// Output: none
+void GPIO_SRDYArm(void);
@@ -0,0 +1,150 @@
+// Log.c
+// Runs on TM4C123
+// Binary debug log, replaces the ASCII APDEBUG echo
+// see Log.h for the record format
+// one thread logs and one thread drains, so the ring needs no lock:
+// only the logging thread writes LogPut, only the draining thread writes LogGet
+
+#include <stdint.h>
+#include "../inc/AP.h"
+#ifdef APDEBUG
+#include "../inc/UART0.h"
+#include "../inc/Log.h"
+#include "../inc/Diag.h"
+
+uint8_t LogRing[LOGSIZE];
+volatile uint32_t LogPut;  // free running byte indices
+volatile uint32_t LogGet;
+uint32_t LogLost;          // records dropped because the ring was full
+uint32_t LogNext;          // where the record being built goes
+uint8_t LogCheck;          // XOR of the record being built
+
+#define logAt(I) LogRing[(I)&(LOGSIZE-1)]
+
+//*************Log_Init**************
+// Empty the ring buffer
+// Inputs: none
+// Output: none
+void Log_Init(void){
+  LogPut = LogGet = 0;
+  LogLost = 0;
+  Diag_Register(DIAGLOGLOST, &LogLost);
+}
+
+// ****logBegin****
+// start a record with size argument bytes
+// Output: 1 if it fits, 0 if dropped
+uint32_t static logBegin(uint8_t id, uint32_t size){
+  if((LOGSIZE-(LogPut-LogGet)) < size+4){
+    LogLost++;
+    return 0;
+  }
+  logAt(LogPut) = LOGSYNC;
+  logAt(LogPut+1) = id;
+  logAt(LogPut+2) = size;
+  LogNext = LogPut+3;
+  LogCheck = id^size;
+  return 1;
+}
+// ****logPut****
+// one argument byte
+void static logPut(uint8_t data){
+  logAt(LogNext) = data;
+  LogNext++;
+  LogCheck = LogCheck^data;
+}
+// ****logEnd****
+// finish the record and make it visible to Log_Drain
+void static logEnd(void){
+  logAt(LogNext) = LogCheck;
+  LogPut = LogNext+1;   // record complete before it becomes visible
+}
+
+//*************Log_Event**************
+// Log a message without arguments
+// Inputs: id format ID
+// Output: none
+void Log_Event(uint8_t id){
+  if(logBegin(id,0)){
+    logEnd();
+  }
+}
+
+//*************Log_Value**************
+// Log a message with one 32-bit argument
+// Inputs: id format ID
+//         value argument
+// Output: none
+void Log_Value(uint8_t id, uint32_t value){
+  if(logBegin(id,4)){
+    logPut(value&0xFF);
+    logPut((value>>8)&0xFF);
+    logPut((value>>16)&0xFF);
+    logPut(value>>24);
+    logEnd();
+  }
+}
+
+//*************Log_Bytes**************
+// Log a message with a block of bytes, at most 255
+// Inputs: id format ID
+//         pt points to the bytes
+//         size number of bytes
+// Output: none
+void Log_Bytes(uint8_t id, const uint8_t *pt, uint32_t size){ uint32_t i;
+  if(size > 255) size = 255;
+  if(logBegin(id,size)){
+    for(i=0; i<size; i++){
+      logPut(pt[i]);
+    }
+    logEnd();
+  }
+}
+
+//*************Log_Spans**************
+// Log a frame sent by AP_SendSpans as LOGTX, without FCS
+// Inputs: cmd0, cmd1, spans, count as in AP_SendSpans
+// Output: none
+void Log_Spans(uint8_t cmd0, uint8_t cmd1, const span_t *spans, uint32_t count){
+  uint32_t i,j,size;
+  size = 0;
+  for(i=0; i<count; i++){
+    size = size+spans[i].size;
+  }
+  if((size+5 > 255)||(logBegin(LOGTX,size+5) == 0)) return;
+  logPut(SOF);
+  logPut(size&0xFF);
+  logPut(size>>8);
+  logPut(cmd0);
+  logPut(cmd1);
+  for(i=0; i<count; i++){
+    for(j=0; j<spans[i].size; j++){
+      logPut(spans[i].reverse ? spans[i].pt[spans[i].size-1-j] : spans[i].pt[j]);
+    }
+  }
+  logEnd();
+}
+
+//*************Log_Drain**************
+// Move logged bytes to the UART0 transmit ring while it has room,
+// less LOGUART0KEEP bytes kept free for UART0_Printf
+// Inputs: none
+// Output: number of bytes still in the ring
+uint32_t Log_Drain(void){ uint32_t get,n,room;
+  get = LogGet;
+  while(get != LogPut){
+    room = UART0_Room();
+    if(room <= LOGUART0KEEP) break;     // leave room for console text
+    n = LogPut-get;
+    if(n > LOGSIZE-(get&(LOGSIZE-1))){
+      n = LOGSIZE-(get&(LOGSIZE-1));   // up to the end of the ring
+    }
+    if(n > room-LOGUART0KEEP){
+      n = room-LOGUART0KEEP;
+    }
+    get += UART0_Write((const char *)&logAt(get),n);
+  }
+  LogGet = get;
+  return LogPut-get;
+}
+#endif
@@ -0,0 +1,96 @@
+// Log.h
+// Runs on TM4C123
+// Binary debug log, replaces the ASCII APDEBUG echo
+// AP.c and AP_Lab6.c put short binary records into a RAM ring buffer,
+// which takes a few microseconds and never waits for UART0;
+// Log_Drain moves the ring to the UART0 transmit ring whenever there is room
+// LogDecode.c, compiled on the PC, turns the UART0 stream back into text
+
+// Record on UART0
+// byte 0     LOGSYNC
+// byte 1     format ID, LOGRESET ... LOGRX below
+// byte 2     n, number of argument bytes
+// byte 3...  arguments, a 32-bit value (little endian) or the bytes of a frame
+// last byte  XOR of the ID, n and the arguments
+// a record that does not fit in the ring is dropped whole and counted in LogLost
+
+#ifndef __LOG_H
+#define __LOG_H  1
+
+#define LOGSYNC 0xA5
+// bytes in the ring buffer, must be a power of 2
+#define LOGSIZE 512
+// bytes of the UART0 transmit ring Log_Drain leaves for console text
+#define LOGUART0KEEP 128
+
+// format IDs, the text is in LogDecode.c, keep the two lists in step
+#define LOGRESET          1   // Reset CC2650
+#define LOGADDSERVICE     2   // Add service
+#define LOGREGISTER       3   // Register service
+#define LOGADDCHARVALUE   4   // Add CharValue
+#define LOGADDCHARDESC    5   // Add CharDescriptor
+#define LOGADDNOTIFY      6   // Add Notify CharValue
+#define LOGSENDNOTIFY     7   // Send notification
+#define LOGDEVICENAME     8   // Set Device name
+#define LOGADVERTISEMENT1 9   // SetAdvertisement1
+#define LOGADVERTISEDATA  10  // SetAdvertisement Data
+#define LOGSTARTADVERTISE 11  // StartAdvertisement
+#define LOGGETSTATUS      12  // Get Status
+#define LOGGETVERSION     13  // Get Version
+#define LOGCONNECTED      14  // Connected
+#define LOGDISCONNECTED   15  // Disconnected, reason=value
+#define LOGINTERVAL       16  // Connection interval=value
+#define LOGMTU            17  // MTU=value
+#define LOGSNPERROR       18  // SNP error=value
+#define LOGRECVMESSAGE    19  // RecvMessage
+#define LOGRECOVER        20  // Recover CC2650
+#define LOGRECOVERTIME    21  // Recovery time (us)=value
+#define LOGRXFAIL         22  // from SNP fail
+#define LOGTX             23  // LP->SNP frame, without FCS
+#define LOGRX             24  // SNP->LP frame
+#define LOGBAUD           25  // Baud rate=value
+#define LOGIDS            26  // number of format IDs
+
+extern uint32_t LogLost;   // records dropped because the ring was full
+
+//*************Log_Init**************
+// Empty the ring buffer
+// Inputs: none
+// Output: none
+void Log_Init(void);
+
+//*************Log_Event**************
+// Log a message without arguments
+// Inputs: id format ID
+// Output: none
+void Log_Event(uint8_t id);
+
+//*************Log_Value**************
+// Log a message with one 32-bit argument
+// Inputs: id format ID
+//         value argument
+// Output: none
+void Log_Value(uint8_t id, uint32_t value);
+
+//*************Log_Bytes**************
+// Log a message with a block of bytes, at most 255
+// Inputs: id format ID, usually LOGTX or LOGRX
+//         pt points to the bytes
+//         size number of bytes
+// Output: none
+void Log_Bytes(uint8_t id, const uint8_t *pt, uint32_t size);
+
+//*************Log_Spans**************
+// Log a frame sent by AP_SendSpans as LOGTX, without FCS
+// Inputs: cmd0, cmd1, spans, count as in AP_SendSpans
+// Output: none
+void Log_Spans(uint8_t cmd0, uint8_t cmd1, const span_t *spans, uint32_t count);
+
+//*************Log_Drain**************
+// Move logged bytes to the UART0 transmit ring while it has room,
+// less LOGUART0KEEP bytes kept free for console text; never waits, call from a thread whenever it has nothing else to do
+// Inputs: none
+// Output: number of bytes still in the ring
+uint32_t Log_Drain(void);
+
+#endif
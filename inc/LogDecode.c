@@ -0,0 +1,100 @@
+// LogDecode.c
+// Runs on the PC, not part of the Keil project
+// Turns the binary debug log from Log.c back into the old APDEBUG text
+// gcc -o LogDecode LogDecode.c
+// LogDecode < capture.bin      (bytes saved from the UART0 serial port)
+// bytes that are not part of a valid record, such as other UART0 output,
+// are skipped until the next LOGSYNC that starts a record with a good check byte
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define LOGSYNC 0xA5   // same as Log.h
+#define LOGIDS  26
+#define LOGVALUE 1     // record has a 32-bit argument
+#define LOGFRAME 2     // record has frame bytes
+#define LOGFCS   4     // frame was logged without its FCS
+
+// indexed by the format IDs in Log.h
+const struct{
+  const char *text;
+  int args;
+}LogFormat[LOGIDS] = {
+  {"?",0},
+  {"Reset CC2650",0},
+  {"Add service",0},
+  {"Register service",0},
+  {"Add CharValue",0},
+  {"Add CharDescriptor",0},
+  {"Add Notify CharValue",0},
+  {"Send notification",0},
+  {"Set Device name",0},
+  {"SetAdvertisement1",0},
+  {"SetAdvertisement Data",0},
+  {"StartAdvertisement",0},
+  {"Get Status",0},
+  {"Get Version",0},
+  {"Connected",0},
+  {"Disconnected, reason=",LOGVALUE},
+  {"Connection interval=",LOGVALUE},
+  {"MTU=",LOGVALUE},
+  {"SNP error=",LOGVALUE},
+  {"RecvMessage",0},
+  {"Recover CC2650",0},
+  {"Recovery time (us)=",LOGVALUE},
+  {"from SNP fail",0},
+  {"LP->SNP ",LOGFRAME|LOGFCS},
+  {"SNP->LP ",LOGFRAME},
+  {"Baud rate=",LOGVALUE}
+};
+
+// ****decode****
+// print one checked record
+void static decode(uint8_t id, const uint8_t *arg, int n){ int i; uint8_t fcs;
+  if((id == 0)||(id >= LOGIDS)){
+    printf("\nunknown ID %d",id);
+    return;
+  }
+  printf("\n%s",LogFormat[id].text);
+  if((LogFormat[id].args&LOGVALUE)&&(n == 4)){
+    printf("%X",arg[0]+(arg[1]<<8)+(arg[2]<<16)+((uint32_t)arg[3]<<24));
+  }
+  if(LogFormat[id].args&LOGFRAME){
+    fcs = 0;
+    for(i=0; i<n; i++){
+      printf("%02X,",arg[i]);
+      if(i) fcs = fcs^arg[i];
+    }
+    if(LogFormat[id].args&LOGFCS){
+      printf("%02X",fcs);   // calculated, as the old echo did
+    }
+  }
+}
+
+int main(void){ int c,n,i; uint8_t id,check,arg[255];
+  long lost = 0;
+  while((c = getchar()) != EOF){
+    if(c != LOGSYNC){
+      lost++;
+      continue;
+    }
+    if((c = getchar()) == EOF) break;
+    id = c;
+    if((n = getchar()) == EOF) break;
+    check = id^n;
+    for(i=0; i<n; i++){
+      if((c = getchar()) == EOF) break;
+      arg[i] = c;
+      check = check^c;
+    }
+    if(i < n) break;
+    if((c = getchar()) == EOF) break;
+    if(c != check){
+      lost++;        // not a record, look for the next LOGSYNC
+      continue;
+    }
+    decode(id,arg,n);
+  }
+  printf("\n%ld bytes skipped\n",lost);
+  return 0;
+}
@@ -0,0 +1,100 @@
+// SNPHost.c
+// Runs on the PC, not part of the Keil project
+// Host build of AP.c talking to the SNP emulator, for the host test programs
+// AP.c is compiled in unchanged with SNPEMULATOR defined, so its pins and
+// UART1 calls already go to SNP_Emulator.c; the two registers it reads are
+// replaced by variables, and the board calls made by AP.c, Log.c, Capture.c
+// and Diag.c are stubbed below
+// BSP_Time_Get is a simulated microsecond clock that moves on HOSTTICK us
+// each time it is read, so timeouts, script delays and notification
+// periods all run without a timer
+// link it with the test program, e.g. from Lab6wLab3_4C123:
+// gcc -O2 -Wall -Wno-unused-but-set-variable -DSNPEMULATOR -I../inc -o SNPTest SNPTest.c
+//   PhoneScript.c Stream.c Codec.c ../inc/SNPHost.c ../inc/SNP_Emulator.c
+//   ../inc/FCS.c ../inc/Capture.c ../inc/Log.c ../inc/Diag.c
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include "tm4c123gh6pm.h"
+#include "SNPHost.h"
+
+#ifndef SNPEMULATOR
+#error "build the host programs with -DSNPEMULATOR"
+#endif
+
+// ****register model****
+uint32_t HostWTimer5Ctl;   // TBEN set, so AP_InitStart leaves the clock alone
+uint32_t HostUART0Ctl;     // 0x301, so AP_InitStart leaves UART0 alone
+#undef WTIMER5_CTL_R
+#define WTIMER5_CTL_R HostWTimer5Ctl
+#undef UART0_CTL_R
+#define UART0_CTL_R   HostUART0Ctl
+
+#include "AP.c"
+
+uint32_t HostTime;         // simulated us since Host_Init
+uint32_t HostEcho;         // 1 to copy UART0 output to stdout
+
+//------------Host_Init------------
+// Reset the simulated clock and registers, call before AP_InitStart
+// Input: echo 1 to print what the firmware sends to UART0
+// Output: none
+void Host_Init(uint32_t echo){
+  HostTime = 0;
+  HostEcho = echo;
+  HostWTimer5Ctl = 0x0100;
+  HostUART0Ctl = 0x301;
+}
+
+// stubs for BSP.c and Clock.c
+void BSP_Time_Init(void){}
+uint32_t BSP_Time_Get(void){
+  HostTime = HostTime+HOSTTICK;
+  return HostTime;
+}
+uint32_t BSP_Clock_GetFreq(void){ return 80000000; }
+void Clock_Delay1ms(uint32_t n){
+  HostTime = HostTime+1000*n;
+}
+
+// stubs for CortexM.c, the host program has no interrupts
+long StartCritical(void){ return 0; }
+void EndCritical(long sr){ (void)sr; }
+void DisableInterrupts(void){}
+void EnableInterrupts(void){}
+
+// stubs for UART0.c, output goes to stdout when HostEcho is set
+void UART0_Init(void){}
+void UART0_OutChar(char data){
+  if(HostEcho) putchar(data);
+}
+uint32_t UART0_Write(const char *pt, uint32_t size){ uint32_t i;
+  for(i=0; i<size; i++){
+    UART0_OutChar(pt[i]);
+  }
+  return size;
+}
+uint32_t UART0_Room(void){ return 0xFFFF; }
+void UART0_OutString(char *pt){
+  while(*pt){
+    UART0_OutChar(*pt);
+    pt++;
+  }
+}
+void UART0_FinishOutput(void){}
+uint32_t UART0_Printf(const char *fmt, ...){ va_list args; int n;
+  va_start(args,fmt);
+  n = HostEcho ? vprintf(fmt,args) : 0;
+  va_end(args);
+  return n < 0 ? 0 : (uint32_t)n;
+}
+void UART0_OutUDec(uint32_t n){
+  UART0_Printf("%u",(unsigned)n);
+}
+void UART0_OutUHex(uint32_t number){
+  UART0_Printf("%X",(unsigned)number);
+}
+void UART0_OutUHex2(uint32_t number){
+  UART0_Printf("%02X",(unsigned)(number&0xFF));
+}
@@ -0,0 +1,17 @@
+// SNPHost.h
+// Runs on the PC, not part of the Keil project
+// Host build of AP.c talking to the SNP emulator, see SNPHost.c
+
+#ifndef __SNPHOST_H
+#define __SNPHOST_H  1
+
+#define HOSTTICK 2         // simulated us each BSP_Time_Get call moves the clock on
+extern uint32_t HostTime;  // simulated us since Host_Init
+
+//------------Host_Init------------
+// Reset the simulated clock and registers, call before AP_InitStart
+// Input: echo 1 to print what the firmware sends to UART0
+// Output: none
+void Host_Init(uint32_t echo);
+
+#endif
@@ -0,0 +1,686 @@
+// SNP_Emulator.c
+// Runs on TM4C123
+// In-process stand-in for a CC2650 running SimpleNP 2.2, see SNP_Emulator.h
+// compiled only when SNPEMULATOR is defined in AP.h
+// The NPI handshake is modeled on the pins the AP polls:
+//   MRDY low with nothing to send, SRDY goes low, the AP sends a frame
+//   SRDY low with MRDY high, the SNP has a frame, the AP lowers MRDY and reads it
+//   after each frame MRDY goes high and SRDY reads high at least once
+// Frames from the AP are checked and answered as soon as MRDY goes high,
+// the phone script and faults run each time the AP reads SRDY
+
+#include <stdint.h>
+#include "../inc/AP.h"
+#ifdef SNPEMULATOR
+#include "../inc/BSP.h"
+#include "../inc/FCS.h"
+#include "../inc/UART1.h"
+#include "../inc/SNP_Emulator.h"
+#include "../inc/Capture.h"
+
+#define SNPTXFRAMES 8     // frames queued for the AP
+#define SNPTXMAX    80    // largest frame to the AP, a write indication with APMAXVALUESIZE bytes
+#define SNPRXMAX    128   // largest frame from the AP
+#define SNPCHARS    24    // characteristics in the emulated GATT database
+#define SNPFIRSTHANDLE 0x001C  // SimpleNP puts the first user service here
+#define SNPSUCCESS  0x00
+#define SNPFAILURE  0x83  // notification refused, not connected or CCCD off
+#define SNPBUSY     0x87  // out of resources
+
+snpstats_t SNPStats;
+
+// frames waiting for the AP, slot SNPTxGet is the one SRDY announces
+uint8_t SNPTx[SNPTXFRAMES][SNPTXMAX];
+uint8_t SNPTxLength[SNPTXFRAMES];
+uint32_t SNPTxPut,SNPTxGet;  // free running
+uint32_t SNPTxPos;           // bytes of the first frame the AP has read
+uint8_t SNPRx[SNPRXMAX];     // frame being sent by the AP
+uint32_t SNPRxCount;
+
+uint8_t SNPMRDY;      // MRDY level from the AP
+uint8_t SNPPowered;   // 0 while RESET is low
+uint8_t SNPHold;      // 1 to show SRDY high once after a frame
+uint8_t SNPWedged;    // 1 after SNPFAULTWEDGE, until a hardware reset
+uint8_t SNPConnected; // phone connected
+uint8_t SNPAdvertising;
+uint16_t SNPAttMTU;
+uint32_t SNPIndTime;  // BSP_Time_Get when the last indication was queued
+uint32_t SNPBaud;     // rate of the SNP end of the link, UART1BAUD after power up
+uint32_t SNPLinkBaud; // rate of the AP end, UART1_SetBaud in AP.c
+// a byte crossing the link, unreadable when the two ends disagree
+#define snpWire(D) ((SNPBaud == SNPLinkBaud) ? (D) : (uint8_t)~(D))
+
+// fault counts, frames or requests still to be affected
+uint16_t SNPBadFCS,SNPNoSOF,SNPNoResponse,SNPBusy,SNPPartial;
+
+// emulated GATT database
+typedef struct{
+  uint16_t uuid;
+  uint16_t handle;      // value handle
+  uint16_t cccdHandle;  // 0 if no CCCD
+  uint16_t cccd;        // value written by the phone
+}snpchar_t;
+snpchar_t SNPChar[SNPCHARS];
+uint32_t SNPCharCount;
+uint16_t SNPNextHandle;
+uint16_t SNPServiceStart;
+
+// phone script
+const snpstep_t *SNPScriptPt;
+uint32_t SNPScriptCount;
+uint32_t SNPScriptI;       // next step
+uint32_t SNPScriptTime;    // BSP_Time_Get of the previous step, us
+uint8_t SNPScriptRunning;  // 1 once advertising started
+uint32_t SNPAdvTime;       // BSP_Time_Get when advertising started, us
+
+// capture being replayed, see Capture.h
+const uint8_t *SNPReplayPt;
+uint32_t SNPReplaySize;
+uint32_t SNPReplayI;       // next record
+uint32_t SNPReplayBase;    // capture time that matches SNPAdvTime
+
+// phone side of the notifications, see SNP_SetNotifyHandler
+void (*SNPNotifyHandler)(uint16_t uuid, const uint8_t *pt, uint32_t size);
+
+// ****snpSend****
+// queue a frame for the AP, cmd0, cmd1 and payload, length and FCS added here
+// faults that change frames are applied here
+void static snpSend(uint8_t cmd0, uint8_t cmd1, const uint8_t *payload, uint32_t size){
+  uint8_t *pt; uint32_t i;
+  if((SNPTxPut-SNPTxGet) >= SNPTXFRAMES) return;  // AP not reading, frame lost
+  if(size+6 > SNPTXMAX) return;
+  pt = SNPTx[SNPTxPut&(SNPTXFRAMES-1)];
+  pt[0] = SOF;
+  pt[1] = size&0xFF;
+  pt[2] = size>>8;
+  pt[3] = cmd0;
+  pt[4] = cmd1;
+  for(i=0; i<size; i++){
+    pt[5+i] = payload[i];
+  }
+  FCS_Set(pt);
+  if(SNPBadFCS){
+    SNPBadFCS--;
+    pt[5+size] = pt[5+size]^0x5A;
+  }
+  if(SNPNoSOF){
+    SNPNoSOF--;
+    pt[0] = 0x00;
+  }
+  SNPTxLength[SNPTxPut&(SNPTXFRAMES-1)] = size+6;
+  if(SNPPartial){
+    SNPPartial--;
+    SNPTxLength[SNPTxPut&(SNPTXFRAMES-1)] = 5+size/2; // header and half the payload
+  }
+  SNPTxPut++;
+}
+// ****snpEvent****
+// queue an SNP Event Indication (0x55,0x05)
+void static snpEvent(uint16_t event, const uint8_t *params, uint32_t size){
+  uint8_t payload[16]; uint32_t i;
+  payload[0] = event&0xFF;
+  payload[1] = event>>8;
+  for(i=0; (i<size)&&(i<14); i++){
+    payload[2+i] = params[i];
+  }
+  snpSend(0x55,0x05,payload,2+i);
+}
+// ****snpPowerUp****
+// a reset SNP has an empty database and announces itself
+void static snpPowerUp(void){
+  SNPTxPut = SNPTxGet = SNPTxPos = 0;
+  SNPRxCount = 0;
+  SNPHold = 0;
+  SNPWedged = 0;
+  SNPConnected = 0;
+  SNPAdvertising = 0;
+  SNPAttMTU = APDEFAULTMTU;
+  SNPBaud = UART1BAUD;
+  SNPCharCount = 0;
+  SNPNextHandle = SNPFIRSTHANDLE;
+  snpSend(0x55,0x01,0,0);   // SNP Power Up Indication
+}
+// ****snpFind****
+// Output: 1+index of the characteristic with this uuid, 0 if none
+uint32_t static snpFind(uint16_t uuid){ uint32_t i;
+  for(i=0; i<SNPCharCount; i++){
+    if(SNPChar[i].uuid == uuid) return i+1;
+  }
+  return 0;
+}
+// ****snpLatency****
+// an AP confirmation arrived, time since the indication
+void static snpLatency(void){
+  SNPStats.latency = BSP_Time_Get()-SNPIndTime;
+  if(SNPStats.latency > SNPStats.latencyMax){
+    SNPStats.latencyMax = SNPStats.latency;
+  }
+}
+
+// ****snpWireTime****
+// time size bytes (10 bits each) spend on the wire at the AP rate
+void static snpWireTime(uint32_t size){
+  SNPStats.wireBytes += size;
+  SNPStats.wireTime += (size*10000000)/SNPLinkBaud;  // size < 400
+}
+// ****snpRequest****
+// answer a complete frame from the AP
+void static snpRequest(void){
+  uint8_t cmd0,cmd1; uint8_t rsp[8]; uint32_t size,i;
+  uint16_t handle;
+  size = SNPRx[1]+(SNPRx[2]<<8);
+  if((SNPRx[0] != SOF)||(size+6 != SNPRxCount)||(FCS_Frame(SNPRx) != SNPRx[5+size])){
+    SNPStats.fcsErrors++;   // SNP drops bad frames without an answer
+    return;
+  }
+  SNPStats.framesIn++;
+  cmd0 = SNPRx[3];
+  cmd1 = SNPRx[4];
+  // confirmations from the AP never get an answer
+  if(cmd0 == 0x55){
+    if(cmd1 == 0x87){ SNPStats.reads++;  snpLatency(); return; } // Characteristic Read Confirmation
+    if(cmd1 == 0x88){ SNPStats.writes++; snpLatency(); return; } // Characteristic Write Confirmation
+    if(cmd1 == 0x8B){ snpLatency(); return; }                    // CCCD Updated Confirmation
+  }
+  if(SNPNoResponse){
+    SNPNoResponse--;
+    return;
+  }
+  rsp[0] = SNPSUCCESS;
+  if(cmd0 == 0x55){
+    switch(cmd1){
+      case 0x04:   // HCI command, only HCI_EXT_ResetSystemCmd is used
+        snpPowerUp();                           // empties the queue, then power up indication
+        SNPTxPut = SNPTxGet = 0;                // the response goes out first
+        rsp[1] = SNPRx[5]; rsp[2] = SNPRx[6];   // opcode
+        snpSend(0x55,0x04,rsp,3);
+        snpSend(0x55,0x01,0,0);                 // SNP Power Up Indication
+        return;
+      case 0x06:   // Get Status
+        rsp[0] = SNPConnected ? 0x06 : (SNPAdvertising ? 0x03 : 0x02); // GAPRole state
+        rsp[1] = SNPAdvertising;
+        rsp[2] = rsp[3] = 0;
+        snpSend(0x55,0x06,rsp,4);
+        return;
+      case 0x42:   // Start Advertisement
+        SNPAdvertising = 1;
+        if(SNPScriptRunning == 0){
+          SNPScriptRunning = 1;        // the phone can see us now
+          SNPScriptTime = SNPAdvTime = BSP_Time_Get();
+        }
+        snpEvent(SNP_ADV_STARTED_EVT,rsp,1);
+        return;
+      case 0x43:   // Set Advertisement Data
+        snpSend(0x55,0x43,rsp,1);
+        return;
+      case 0x89:   // Send Notification Indication
+        handle = SNPRx[7]+(SNPRx[8]<<8);
+        for(i=0; (i<SNPCharCount)&&(SNPChar[i].handle != handle); i++){};
+        if(SNPBusy){
+          SNPBusy--;
+          rsp[0] = SNPBUSY;
+        }else if((SNPConnected == 0)||(i == SNPCharCount)||(SNPChar[i].cccd == 0)){
+          rsp[0] = SNPFAILURE;
+        }else{
+          SNPStats.notifications++;
+          SNPStats.notifyBytes += size-6;
+          if(SNPNotifyHandler){
+            (*SNPNotifyHandler)(SNPChar[i].uuid,&SNPRx[11],size-6);
+          }
+        }
+        rsp[1] = rsp[2] = 0;             // connection handle
+        snpSend(0x55,0x89,rsp,3);
+        return;
+    }
+  }else if(cmd0 == 0x35){
+    switch(cmd1){
+      case 0x03:   // Get Version
+        rsp[1] = 0x02; rsp[2] = 0x02;    // SimpleNP 2.2
+        snpSend(0x75,0x03,rsp,3);
+        return;
+      case 0x81:   // Add Service
+        SNPServiceStart = SNPNextHandle;
+        rsp[1] = SNPNextHandle&0xFF; rsp[2] = SNPNextHandle>>8;
+        SNPNextHandle++;
+        snpSend(0x75,0x81,rsp,3);
+        return;
+      case 0x82:   // Add Characteristic Value Declaration
+        if(SNPCharCount >= SNPCHARS){
+          rsp[0] = SNPBUSY;
+        }else{
+          SNPNextHandle++;                 // characteristic declaration
+          SNPChar[SNPCharCount].uuid = SNPRx[11]+(SNPRx[12]<<8);
+          SNPChar[SNPCharCount].handle = SNPNextHandle;
+          SNPChar[SNPCharCount].cccdHandle = 0;
+          SNPChar[SNPCharCount].cccd = 0;
+          SNPCharCount++;
+        }
+        rsp[1] = SNPNextHandle&0xFF; rsp[2] = SNPNextHandle>>8;
+        SNPNextHandle++;
+        snpSend(0x75,0x82,rsp,3);
+        return;
+      case 0x83:   // Add Characteristic Descriptor Declaration
+        rsp[1] = SNPRx[5];                 // which descriptors
+        i = 2;
+        if((SNPRx[5]&0x04)&&SNPCharCount){ // CCCD
+          SNPChar[SNPCharCount-1].cccdHandle = SNPNextHandle;
+          rsp[i] = SNPNextHandle&0xFF; rsp[i+1] = SNPNextHandle>>8;
+          SNPNextHandle++; i = i+2;
+        }
+        rsp[i] = SNPNextHandle&0xFF; rsp[i+1] = SNPNextHandle>>8; // user description
+        SNPNextHandle++; i = i+2;
+        snpSend(0x75,0x83,rsp,i);
+        return;
+      case 0x84:   // Register Service
+        rsp[1] = SNPServiceStart&0xFF; rsp[2] = SNPServiceStart>>8;
+        rsp[3] = (SNPNextHandle-1)&0xFF; rsp[4] = (SNPNextHandle-1)>>8;
+        snpSend(0x75,0x84,rsp,5);
+        return;
+      case 0x8C:   // Set GATT Parameter
+        snpSend(0x75,0x8C,rsp,1);
+        return;
+    }
+  }
+  rsp[0] = 0x82;   // command not supported by the emulator
+  snpSend(cmd0,cmd1,rsp,1);
+}
+
+// ****snpStep****
+// run one script step
+void static snpStep(const snpstep_t *step){
+  uint8_t msg[12]; uint32_t i;
+  i = snpFind(step->uuid);
+  switch(step->action){
+    case SNPCONNECT:
+      SNPConnected = 1;
+      SNPAdvertising = 0;
+      SNPAttMTU = APDEFAULTMTU;
+      msg[0] = msg[1] = 0;                                // connection handle
+      msg[2] = step->value&0xFF; msg[3] = step->value>>8; // interval
+      msg[4] = msg[5] = 0;                                // slave latency
+      msg[6] = 200; msg[7] = 0;                           // supervision timeout, 2 s
+      msg[8] = 0;                                         // address type
+      msg[9] = 0x11; msg[10] = 0x22; msg[11] = 0x33;      // start of the phone address
+      snpEvent(SNP_CONN_EST_EVT,msg,12);
+      break;
+    case SNPMTU:
+      SNPAttMTU = step->value;
+      msg[0] = msg[1] = 0;
+      msg[2] = step->value&0xFF; msg[3] = step->value>>8;
+      snpEvent(SNP_ATT_MTU_EVT,msg,4);
+      break;
+    case SNPREAD:
+      if(i == 0) break;
+      msg[0] = msg[1] = 0;
+      msg[2] = SNPChar[i-1].handle&0xFF; msg[3] = SNPChar[i-1].handle>>8;
+      msg[4] = msg[5] = 0;                                // offset
+      msg[6] = (SNPAttMTU-1)&0xFF; msg[7] = (SNPAttMTU-1)>>8;   // most the phone can take
+      SNPIndTime = BSP_Time_Get();
+      snpSend(0x55,0x87,msg,8);
+      break;
+    case SNPWRITE:
+      if(i == 0) break;
+      msg[0] = msg[1] = 0;
+      msg[2] = SNPChar[i-1].handle&0xFF; msg[3] = SNPChar[i-1].handle>>8;
+      msg[4] = 1;                                         // response needed
+      msg[5] = msg[6] = 0;                                // offset
+      if(step->value < 256){                              // numbers go big endian
+        msg[7] = step->value;
+        SNPIndTime = BSP_Time_Get();
+        snpSend(0x55,0x88,msg,8);
+      }else{
+        msg[7] = step->value>>8; msg[8] = step->value&0xFF;
+        SNPIndTime = BSP_Time_Get();
+        snpSend(0x55,0x88,msg,9);
+      }
+      break;
+    case SNPCCCD:
+      if((i == 0)||(SNPChar[i-1].cccdHandle == 0)) break;
+      SNPChar[i-1].cccd = step->value;
+      msg[0] = msg[1] = 0;
+      msg[2] = SNPChar[i-1].cccdHandle&0xFF; msg[3] = SNPChar[i-1].cccdHandle>>8;
+      msg[4] = 1;                                         // response needed
+      msg[5] = step->value&0xFF; msg[6] = step->value>>8;
+      SNPIndTime = BSP_Time_Get();
+      snpSend(0x55,0x8B,msg,7);
+      break;
+    case SNPDISCONNECT:
+      SNPConnected = 0;
+      msg[0] = msg[1] = 0;
+      msg[2] = 0x13;                                      // remote user terminated
+      snpEvent(SNP_CONN_TERM_EVT,msg,3);
+      break;
+    default:
+      SNP_InjectFault(step->action,step->value);
+      break;
+  }
+}
+// ****snpReplayable****
+// Output: 1 if the record is an indication the SNP sent on its own,
+// answers to AP requests are generated by the emulator itself
+uint32_t static snpReplayable(const uint8_t *rec){ const uint8_t *frame;
+  frame = &rec[CAPTUREHEADER];
+  if((rec[0] != CAPTURERX)||((rec[5]+(rec[6]<<8)) < 6)) return 0;
+  if((frame[0] != SOF)||(frame[3] != 0x55)) return 0;
+  if((frame[4] == 0x87)||(frame[4] == 0x88)||(frame[4] == 0x8B)) return 1;
+  if((frame[4] == 0x05)&&((frame[5]+(frame[6]<<8)) != SNP_ADV_STARTED_EVT)) return 1;
+  return 0;
+}
+// ****snpReplay****
+// play the captured indication, keeping the emulator state in step
+void static snpReplay(const uint8_t *frame, uint32_t n){ uint32_t i; uint16_t handle;
+  if(frame[4] == 0x05){
+    switch(frame[5]+(frame[6]<<8)){
+      case SNP_CONN_EST_EVT:  SNPConnected = 1; SNPAdvertising = 0; SNPAttMTU = APDEFAULTMTU; break;
+      case SNP_CONN_TERM_EVT: SNPConnected = 0; break;
+      case SNP_ATT_MTU_EVT:   SNPAttMTU = frame[9]+(frame[10]<<8); break;
+    }
+  }else{
+    if(frame[4] == 0x8B){
+      handle = frame[7]+(frame[8]<<8);
+      for(i=0; i<SNPCharCount; i++){
+        if(SNPChar[i].cccdHandle == handle){
+          SNPChar[i].cccd = frame[10]+(frame[11]<<8);
+        }
+      }
+    }
+    SNPIndTime = BSP_Time_Get();
+  }
+  snpSend(frame[3],frame[4],&frame[5],n-6);
+}
+// ****snpReplayTick****
+// play the captured indications that are due, same spacing as captured
+void static snpReplayTick(uint32_t now){ const uint8_t *rec; uint32_t n,time;
+  while(SNPReplayI+CAPTUREHEADER <= SNPReplaySize){
+    rec = &SNPReplayPt[SNPReplayI];
+    n = rec[5]+(rec[6]<<8);
+    if(snpReplayable(rec)){
+      time = rec[1]+(rec[2]<<8)+(rec[3]<<16)+(rec[4]<<24);
+      if((now-SNPAdvTime) < (time-SNPReplayBase)) return;  // not yet
+      if((SNPTxPut-SNPTxGet) >= SNPTXFRAMES-1) return;      // AP behind, try later
+      snpReplay(&rec[CAPTUREHEADER],n);
+    }
+    SNPReplayI = SNPReplayI+CAPTUREHEADER+n;
+  }
+  SNPReplayPt = 0;
+  SNPStats.scriptDone = 1;
+}
+
+// ****snpTick****
+// run the script steps that are due, between frames only
+void static snpTick(void){ uint32_t now;
+  if((SNPScriptRunning == 0)||(SNPMRDY == 0)||(SNPPowered == 0)) return;
+  now = BSP_Time_Get();
+  if(SNPReplayPt){
+    snpReplayTick(now);
+    return;
+  }
+  while((SNPScriptI < SNPScriptCount)&&((now-SNPScriptTime) >= SNPScriptPt[SNPScriptI].delay)){
+    if((SNPTxPut-SNPTxGet) >= SNPTXFRAMES-1) return; // AP behind, try later
+    SNPScriptTime = SNPScriptTime+SNPScriptPt[SNPScriptI].delay;
+    snpStep(&SNPScriptPt[SNPScriptI]);
+    SNPScriptI++;
+    if(SNPScriptI == SNPScriptCount){
+      SNPStats.scriptDone = 1;
+    }
+  }
+}
+
+//*************SNP_Init**************
+// Power up the emulated SNP, empty its GATT database
+// Inputs: none
+// Output: none
+void SNP_Init(void){ uint32_t i; uint32_t *pt;
+  pt = (uint32_t *)&SNPStats;
+  for(i=0; i<sizeof(SNPStats)/4; i++){
+    pt[i] = 0;
+  }
+  SNPBadFCS = SNPNoSOF = SNPNoResponse = SNPBusy = SNPPartial = 0;
+  SNPMRDY = 1;
+  SNPPowered = 1;
+  SNPScriptI = 0;
+  SNPScriptRunning = 0;
+  SNPReplayPt = 0;
+  SNPLinkBaud = UART1BAUD;
+  snpPowerUp();
+  SNPTxPut = SNPTxGet = 0;   // already up, no power up indication until reset
+}
+
+//*************SNP_Script**************
+// Set the phone script, replaces any script running
+// Inputs: script points to the steps, count is the number of steps
+// Output: none
+void SNP_Script(const snpstep_t *script, uint32_t count){
+  SNPScriptPt = script;
+  SNPScriptCount = count;
+  SNPScriptI = 0;
+  SNPStats.scriptDone = 0;
+  SNPScriptTime = BSP_Time_Get();
+  SNPReplayPt = 0;
+}
+
+//*************SNP_Replay**************
+// Play back the indications in a capture, replaces any script
+// connection, MTU, read, write and CCCD indications are sent to the AP
+// with the captured spacing, measured from the captured advertising start
+// answers to AP requests come from the emulator, not the capture
+// Inputs: log points to capture records, see Capture.h
+//         size number of bytes of records
+// Output: none
+void SNP_Replay(const uint8_t *log, uint32_t size){ uint32_t i,n;
+  if(size < CAPTUREHEADER) return;
+  SNPScriptCount = 0;
+  SNPStats.scriptDone = 0;
+  SNPReplaySize = size;
+  SNPReplayI = 0;
+  SNPReplayBase = log[1]+(log[2]<<8)+(log[3]<<16)+(log[4]<<24); // first record, unless
+  for(i=0; i+CAPTUREHEADER+7 <= size; i=i+CAPTUREHEADER+n){      // advertising was captured
+    n = log[i+5]+(log[i+6]<<8);
+    if((log[i] == CAPTURERX)&&(n >= 8)&&(log[i+10] == 0x55)&&(log[i+11] == 0x05)
+      &&((log[i+12]+(log[i+13]<<8)) == SNP_ADV_STARTED_EVT)){
+      SNPReplayBase = log[i+1]+(log[i+2]<<8)+(log[i+3]<<16)+(log[i+4]<<24);
+      SNPReplayI = i+CAPTUREHEADER+n;
+      break;
+    }
+  }
+  SNPReplayPt = log;
+}
+
+//*************SNP_SetNotifyHandler**************
+// Set the phone-side function that gets each notification or indication
+// the SNP accepts, so a host test can check what reached the phone
+// Inputs: handler called with the characteristic uuid, the value and its size, 0 for none
+// Output: none
+void SNP_SetNotifyHandler(void (*handler)(uint16_t uuid, const uint8_t *pt, uint32_t size)){
+  SNPNotifyHandler = handler;
+}
+
+//*************SNP_InjectFault**************
+// Inject a fault now, without a script
+// Inputs: fault SNPFAULTFCS ... SNPFAULTPARTIAL, count frames or requests affected
+// Output: none
+void SNP_InjectFault(uint8_t fault, uint16_t count){
+  SNPStats.faults++;
+  switch(fault){
+    case SNPFAULTFCS:        SNPBadFCS = count;     break;
+    case SNPFAULTNOSOF:      SNPNoSOF = count;      break;
+    case SNPFAULTNORESPONSE: SNPNoResponse = count; break;
+    case SNPFAULTBUSY:       SNPBusy = count;       break;
+    case SNPFAULTPOWERUP:    snpPowerUp();          break;
+    case SNPFAULTWEDGE:      SNPWedged = 1;         break;
+    case SNPFAULTPARTIAL:    SNPPartial = count;    break;
+  }
+}
+
+// ****snpRecvCheck****
+// queue count Get Status responses, the first one spoiled by fault,
+// have the AP read each one, the first must give first and the counts
+// must grow by fcs, nosof and timeout, the rest must come through intact
+// Output: number of checks that failed
+uint32_t static snpRecvCheck(uint8_t fault, uint32_t count, int first,
+  uint32_t fcs, uint32_t nosof, uint32_t timeout){
+  const uint8_t status[4] = {0x02,0x00,0x12,0x34}; // not advertising, some bytes to check
+  uint8_t buf[16]; uint32_t i,left,fails,fcs0,nosof0,timeout0; int r;
+  fails = 0;
+  fcs0 = fcserr; nosof0 = NoSOFErr; timeout0 = TimeOutErr;
+  if(fault){
+    SNP_InjectFault(fault,1);
+  }
+  for(i=0; i<count; i++){
+    snpSend(0x55,0x06,status,4);             // back to back, nothing read in between
+  }
+  for(i=0; i<count; i++){
+    left = SNPTxPut-SNPTxGet;
+    r = AP_RecvMessage(buf,sizeof(buf));
+    if((SNPTxPut-SNPTxGet) != left-1) fails++;  // exactly one frame off the link
+    if(i == 0){
+      if(r != first) fails++;
+    }else if((r != APOK)||(buf[3] != 0x55)||(buf[4] != 0x06)||(buf[7] != 0x12)||(buf[8] != 0x34)){
+      fails++;
+    }
+  }
+  if((fcserr-fcs0 != fcs)||(NoSOFErr-nosof0 != nosof)||(TimeOutErr-timeout0 != timeout)) fails++;
+  return fails;
+}
+
+//*************SNP_RecvTest**************
+// Self-test of the AP receive path, see SNP_Emulator.h
+// Inputs: none
+// Output: number of checks that failed, 0 if all passed
+uint32_t SNP_RecvTest(void){ uint32_t fails,fcs0,nosof0,timeout0,streak0;
+  if((SNPPowered == 0)||SNPWedged||(SNPTxPut != SNPTxGet)) return 1; // not idle
+  fcs0 = fcserr; nosof0 = NoSOFErr; timeout0 = TimeOutErr; streak0 = APFailStreak;
+  fails = snpRecvCheck(0,SNPTXFRAMES,APOK,0,0,0);             // a full queue back to back
+  fails += snpRecvCheck(SNPFAULTFCS,3,APFAIL,1,0,0);
+  fails += snpRecvCheck(SNPFAULTNOSOF,3,APFAIL,0,1,0);
+  fails += snpRecvCheck(SNPFAULTPARTIAL,3,APFAIL,0,0,1);
+  fcserr = fcs0; NoSOFErr = nosof0; TimeOutErr = timeout0; APFailStreak = streak0;
+  return fails;
+}
+
+//*************SNP_SetMRDY**************
+// MRDY from the AP, a rising edge ends the frame in progress
+// Inputs: level 0 or 1
+// Output: none
+void SNP_SetMRDY(uint32_t level){
+  if(level&&(SNPMRDY == 0)){
+    if(SNPRxCount){           // the AP sent a frame
+      snpWireTime(SNPRxCount);
+      if(SNPBaud != SNPLinkBaud){
+        SNPStats.fcsErrors++;   // garbled at the wrong rate
+      }else if(SNPPowered&&(SNPWedged == 0)) snpRequest();
+      SNPRxCount = 0;
+    }
+    if(SNPTxPos){             // the AP read a frame, drop what it did not take
+      snpWireTime(SNPTxPos);
+      SNPStats.framesOut++;
+      SNPTxGet++;
+      SNPTxPos = 0;
+    }
+    SNPHold = 1;
+  }
+  SNPMRDY = (level != 0);
+}
+
+//*************SNP_SetReset**************
+// RESET from the AP, low holds the SNP in reset, high starts it
+// Inputs: level 0 or 1
+// Output: none
+void SNP_SetReset(uint32_t level){
+  if(level == 0){
+    SNPPowered = 0;
+  }else if(SNPPowered == 0){
+    SNPPowered = 1;
+    snpPowerUp();
+  }
+}
+
+//*************SNP_ReadSRDY**************
+// SRDY to the AP, 0 means the SNP is ready to receive or has a frame
+// Inputs: none
+// Output: 0 low, 1 high
+uint32_t SNP_ReadSRDY(void){
+  snpTick();
+  if((SNPPowered == 0)||SNPWedged) return 1;
+  if(SNPMRDY == 0) return 0;        // receiving, or sending what it announced
+  if(SNPHold){
+    SNPHold = 0;                    // high once between frames
+    return 1;
+  }
+  if(SNPTxPut != SNPTxGet) return 0; // frame waiting for the AP
+  return 1;
+}
+
+//*************SNP_InChar**************
+// next byte of the frame announced by SRDY
+// Inputs: none
+// Output: byte, 0 if there is no frame (the real UART would wait forever)
+uint8_t SNP_InChar(void){ uint32_t slot;
+  if(SNPTxPut == SNPTxGet) return 0;
+  slot = SNPTxGet&(SNPTXFRAMES-1);
+  if(SNPTxPos >= SNPTxLength[slot]) return 0;
+  SNPTxPos++;
+  return snpWire(SNPTx[slot][SNPTxPos-1]);
+}
+
+//*************SNP_OutChar**************
+// next byte of a frame from the AP
+// Inputs: data byte
+// Output: none
+void SNP_OutChar(uint8_t data){
+  if(SNPRxCount < SNPRXMAX){
+    SNPRx[SNPRxCount] = data;
+    SNPRxCount++;
+  }
+}
+
+//*************SNP_OutBuffer**************
+// block of bytes of a frame from the AP
+// Inputs: pt points to the bytes, size number of bytes
+// Output: none
+void SNP_OutBuffer(const uint8_t *pt, uint32_t size){
+  while(size){
+    SNP_OutChar(*pt);
+    pt++;
+    size--;
+  }
+}
+
+//*************SNP_Read**************
+// block of bytes of the frame announced by SRDY
+// Inputs: pt points to room for size bytes, size number of bytes
+// Output: number of bytes read, less than size if the frame ended
+uint32_t SNP_Read(uint8_t *pt, uint32_t size){ uint32_t slot,count;
+  count = 0;
+  if(SNPTxPut == SNPTxGet) return 0;
+  slot = SNPTxGet&(SNPTXFRAMES-1);
+  while((count < size)&&(SNPTxPos < SNPTxLength[slot])){
+    pt[count] = snpWire(SNPTx[slot][SNPTxPos]);
+    SNPTxPos++;
+    count++;
+  }
+  return count;
+}
+
+//*************SNP_SetBaud**************
+// Move the SNP end of the link to a new rate, as a SimpleNP build
+// with a baud rate command would; the SNP goes back to UART1BAUD on reset
+// Inputs: baud bits/sec
+// Output: 1 if switched, 0 if the SNP is off or wedged
+uint32_t SNP_SetBaud(uint32_t baud){
+  if((SNPPowered == 0)||SNPWedged||(baud == 0)) return 0;
+  SNPBaud = baud;
+  return 1;
+}
+
+//*************SNP_SetLinkBaud**************
+// Rate of the AP end of the link, replaces UART1_SetBaud in AP.c
+// frames cross the link garbled while the two ends disagree
+// Inputs: baud bits/sec
+// Output: 1
+int SNP_SetLinkBaud(uint32_t baud){
+  if(baud == 0) return 0;
+  SNPLinkBaud = baud;
+  return 1;
+}
+#endif
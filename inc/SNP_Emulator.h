@@ -0,0 +1,156 @@
+// SNP_Emulator.h
+// Runs on TM4C123
+// In-process stand-in for a CC2650 running SimpleNP 2.2
+// lets AP.c, AP_Lab6.c and AP_BackgroundProcess run without the CC2650 board
+// define SNPEMULATOR in AP.h (or the C/C++ Define field) and AP.c talks to
+// these functions instead of UART1 and the MRDY, SRDY, RESET pins
+// The emulated SNP answers the subset of SNP commands this project uses:
+//   reset, get status, get version, add service, add characteristic value,
+//   add descriptor, register service, set GATT parameter, advertising,
+//   notifications, and the read/write/CCCD confirmations
+// A script plays the phone side: connect, MTU, read, write, CCCD, disconnect,
+// and injects faults (bad FCS, lost SOF, no response, busy, SNP reset, wedge)
+// A capture from Capture.c can be played back in place of a script
+// Statistics give frame counts and the AP-side latency of each exchange,
+// and the time the frames would spend on a UART at the AP baud rate
+
+#ifndef __SNP_EMULATOR_H
+#define __SNP_EMULATOR_H  1
+
+// script actions, phone side
+#define SNPCONNECT     1  // phone connects, value is the connection interval (1.25 ms units)
+#define SNPMTU         2  // phone negotiates the ATT MTU, value is the MTU
+#define SNPREAD        3  // phone reads characteristic uuid
+#define SNPWRITE       4  // phone writes value (sent big endian, 1 byte if < 256) to characteristic uuid
+#define SNPCCCD        5  // phone writes value to the CCCD of notify characteristic uuid
+#define SNPDISCONNECT  6  // phone disconnects
+// script actions, faults, value is how many frames or requests are affected
+#define SNPFAULTFCS       10  // frames to AP sent with a wrong FCS
+#define SNPFAULTNOSOF     11  // frames to AP sent without SOF
+#define SNPFAULTNORESPONSE 12 // requests from AP that get no answer
+#define SNPFAULTBUSY      13  // notifications answered with out of resources (0x87)
+#define SNPFAULTPOWERUP   14  // SNP resets on its own, database and connection lost
+#define SNPFAULTWEDGE     15  // SNP stops answering until a hardware reset
+#define SNPFAULTPARTIAL   16  // frames to AP cut off after half the payload
+
+// one step of a phone script
+typedef struct{
+  uint32_t delay;   // us after the previous step
+  uint8_t action;   // SNPCONNECT ... SNPFAULTPARTIAL
+  uint16_t uuid;    // characteristic, for SNPREAD, SNPWRITE and SNPCCCD
+  uint16_t value;   // interval, MTU, data, CCCD value or fault count
+}snpstep_t;
+
+// statistics, cleared by SNP_Init
+typedef struct{
+  uint32_t framesIn;       // frames received from the AP
+  uint32_t framesOut;      // frames sent to the AP
+  uint32_t fcsErrors;      // frames from the AP with a bad FCS
+  uint32_t notifications;  // notifications and indications accepted
+  uint32_t notifyBytes;    // data bytes in those notifications
+  uint32_t reads;          // read confirmations from the AP
+  uint32_t writes;         // write indications answered by the AP
+  uint32_t latency;        // last time from indication to AP confirmation, us
+  uint32_t latencyMax;     // longest time from indication to AP confirmation, us
+  uint32_t faults;         // faults injected
+  uint32_t scriptDone;     // 1 when the last script step or replayed record has run
+  uint32_t wireBytes;      // bytes that crossed the link, both ways
+  uint32_t wireTime;       // time those bytes take at the AP baud rate, us
+}snpstats_t;
+extern snpstats_t SNPStats;
+
+//*************SNP_Init**************
+// Power up the emulated SNP, empty its GATT database
+// the script, if any, starts when the AP starts advertising
+// Inputs: none
+// Output: none
+void SNP_Init(void);
+
+//*************SNP_Script**************
+// Set the phone script, replaces any script running
+// Inputs: script points to the steps, run in order
+//         count is the number of steps
+// Output: none
+void SNP_Script(const snpstep_t *script, uint32_t count);
+
+//*************SNP_Replay**************
+// Play back the indications in a capture, replaces any script
+// connection, MTU, read, write and CCCD indications are sent to the AP
+// with the captured spacing, measured from the captured advertising start
+// answers to AP requests come from the emulator, not the capture,
+// so the handles must match the ones the emulator hands out
+// Capture_Copy, or a dump loaded into memory, gives the records
+// Inputs: log points to capture records, see Capture.h
+//         size number of bytes of records
+// Output: none
+void SNP_Replay(const uint8_t *log, uint32_t size);
+
+//*************SNP_SetNotifyHandler**************
+// Set the phone-side function that gets each notification or indication
+// the SNP accepts, so a host test can check what reached the phone
+// Inputs: handler called with the characteristic uuid, the value and its size, 0 for none
+// Output: none
+void SNP_SetNotifyHandler(void (*handler)(uint16_t uuid, const uint8_t *pt, uint32_t size));
+
+//*************SNP_InjectFault**************
+// Inject a fault now, without a script
+// Inputs: fault SNPFAULTFCS ... SNPFAULTPARTIAL
+//         count frames or requests affected
+// Output: none
+void SNP_InjectFault(uint8_t fault, uint16_t count);
+
+//*************SNP_RecvTest**************
+// Self-test of the AP receive path, AP_RecvMessage, with frames
+// sent back to back, with a bad FCS, without SOF and cut short
+// each bad frame must be counted in fcserr, NoSOFErr or TimeOutErr,
+// must take exactly one frame off the link, and the good frame after it
+// must come through; the AP counts and fail streak are put back afterwards
+// call after AP_InitRun returns APOK, before advertising starts;
+// StreamTest.c runs it on the PC
+// Inputs: none
+// Output: number of checks that failed, 0 if all passed
+uint32_t SNP_RecvTest(void);
+
+//*************SNP_SetBaud**************
+// Move the SNP end of the link to a new rate, as a SimpleNP build
+// with a baud rate command would; AP_SetBaud calls it for the emulator
+// the SNP goes back to UART1BAUD on reset
+// Inputs: baud bits/sec
+// Output: 1 if switched, 0 if the SNP is off or wedged
+uint32_t SNP_SetBaud(uint32_t baud);
+
+// emulated pins and UART1, called through the macros below
+void SNP_SetMRDY(uint32_t level);
+void SNP_SetReset(uint32_t level);
+uint32_t SNP_ReadSRDY(void);
+uint8_t SNP_InChar(void);
+void SNP_OutChar(uint8_t data);
+void SNP_OutBuffer(const uint8_t *pt, uint32_t size);
+uint32_t SNP_Read(uint8_t *pt, uint32_t size);
+int SNP_SetLinkBaud(uint32_t baud);
+
+#ifdef SNPEMULATOR
+// redirect the GPIO.h macros and the UART1 calls in AP.c
+#undef SetMRDY
+#undef ClearMRDY
+#undef SetReset
+#undef ClearReset
+#undef ReadSRDY
+#define SetMRDY()     SNP_SetMRDY(1)
+#define ClearMRDY()   SNP_SetMRDY(0)
+#define SetReset()    SNP_SetReset(1)
+#define ClearReset()  SNP_SetReset(0)
+#define ReadSRDY()    SNP_ReadSRDY()
+#define GPIO_Init()   SNP_Init()
+#define GPIO_SRDYDisarm()     // emulated SRDY has no edge interrupt
+#define UART1_Init()
+#define UART1_InChar()  SNP_InChar()
+#define UART1_OutChar(DATA) SNP_OutChar(DATA)
+#define UART1_OutBuffer(PT,SIZE) SNP_OutBuffer(PT,SIZE)
+#define UART1_Write(PT,SIZE) SNP_OutBuffer(PT,SIZE)
+#define UART1_Read(PT,SIZE,TIMEOUT) SNP_Read(PT,SIZE)
+#define UART1_FinishOutput()
+#define UART1_SetBaud(BAUD) SNP_SetLinkBaud(BAUD)
+#endif
+
+#endif
@@ -0,0 +1,229 @@
+// StreamTest.c
+// Runs on the PC, not part of the Keil project
+// Host test of the Stream service end to end, through AP.c and the SNP emulator
+// Stream.c, Codec.c and AP.c are compiled unchanged, SNPHost.c stubs the board;
+// the emulated phone connects, enables the Stream notifications, starts the
+// stream and gets every notification the SNP accepts through SNP_SetNotifyHandler
+// gcc -O2 -Wall -Wno-unused-but-set-variable -DSNPEMULATOR -I. -I../Lab6wLab3_4C123 -o StreamTest
+//   StreamTest.c SNPHost.c SNP_Emulator.c FCS.c Capture.c Log.c Diag.c
+//   ../Lab6wLab3_4C123/Stream.c ../Lab6wLab3_4C123/Codec.c
+// StreamTest          (prints the results, exit code 0 if every check passed)
+// -Wno-unused-but-set-variable: AP.c keeps "volatile int r" for the debugger
+// 1) SNP bring-up, then SNP_RecvTest: AP_RecvMessage with frames back to back,
+//    with a bad FCS, without SOF and cut short
+// 2) TESTMS ms of samples, microphone at 1 kHz decimated to 100 Hz and the
+//    accelerometer at 10 Hz, Stream_Send every 100 ms as Task7 would run;
+//    the SNP refuses notifications for a while (out of resources), so the ring
+//    fills and samples are dropped, and one response to the AP has a bad FCS,
+//    so a frame the phone already has is sent again
+// checks, on the phone side: sequence numbers in order (a repeated one is a
+// resend and replaces the frame before), every frame decodes, the samples come
+// back in order, accelerometer values exactly and microphone values within
+// MAXSOUNDERR, the drop count in the frame header matches StreamDrops, and
+// samples received plus samples dropped equals samples offered
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "AP.h"
+#include "SNP_Emulator.h"
+#include "SNPHost.h"
+#include "Stream.h"
+#include "Codec.h"
+
+#define TESTMS 12000         // ms of samples
+#define TESTACCMS 100        // Task1 accelerometer period, ms
+#define TESTSEND 100         // ms between Stream_Send calls, Task1 wakes Task7
+#define TESTSETTLE 10        // microphone samples for ADPCM to grow from the smallest step
+#define MAXSOUNDERR 24       // largest ADPCM error allowed after that, in 10-bit counts
+
+// phone session, times in us after the previous step
+const snpstep_t Script[] = {
+  {100000, SNPCONNECT,    0,      24},     // 30 ms connection interval
+  { 10000, SNPMTU,        0,      247},
+  { 10000, SNPCCCD,       0xFFE1, 1},      // notify Stream
+  { 10000, SNPWRITE,      0xFFE2, 0x0A03}, // stream both, decimation 10
+  {2000000,SNPFAULTBUSY,  0,      30},     // 3 s of refusals at one try per 100 ms
+  {5000000,SNPFAULTFCS,   0,      1}       // the answer to one notification is spoiled
+};
+
+// samples offered to the stream, in order
+#define TESTMAX 4000
+struct{
+  uint16_t type;
+  uint16_t time;
+  uint16_t data[3];
+  uint8_t dropped;         // 1 if Stream_Put counted it in StreamDrops
+}Expected[TESTMAX];
+uint32_t ExpectedPut,ExpectedGet;
+uint32_t FrameStart;        // ExpectedGet when the last frame started, for resends
+int32_t LastSeq;            // sequence number of the last frame, -1 before the first
+uint32_t HeaderDrops;       // drop count in the last frame header
+uint32_t RecvLast;           // samples the last frame gave
+uint32_t Frames,Resends,Received,SoundCount,MaxSoundErr,Errors;
+extern uint32_t StreamDecimate;  // Stream.c, 0 right after a microphone sample is kept
+extern volatile uint32_t StreamPutI,StreamGetI; // Stream.c ring indexes
+
+// ****expect****
+// remember a sample just offered, and whether the ring had room for it
+void static expect(uint16_t type, uint16_t d0, uint16_t d1, uint16_t d2, uint32_t drops){
+  if(ExpectedPut >= TESTMAX) return;
+  Expected[ExpectedPut].type = type;
+  Expected[ExpectedPut].time = (HostTime/1000)&0xFFFF;  // streamPut read the clock last
+  Expected[ExpectedPut].data[0] = d0;
+  Expected[ExpectedPut].data[1] = d1;
+  Expected[ExpectedPut].data[2] = d2;
+  Expected[ExpectedPut].dropped = (StreamDrops != drops);
+  ExpectedPut++;
+}
+// ****next****
+// the next sample that went into the ring, 0 if there is none
+uint32_t static next(uint16_t type, uint16_t time){
+  while((ExpectedGet < ExpectedPut)&&Expected[ExpectedGet].dropped){
+    ExpectedGet++;
+  }
+  if((ExpectedGet >= ExpectedPut)||(Expected[ExpectedGet].type != type)
+    ||(Expected[ExpectedGet].time != time)){
+    if(Errors < 10) printf("  sample %u out of place\n",(unsigned)ExpectedGet);
+    Errors++;
+    return 0;
+  }
+  ExpectedGet++;
+  Received++;
+  return ExpectedGet;
+}
+// ****phoneAcc****
+// Codec_DecodeFrame callback, must match the sample exactly
+void static phoneAcc(uint16_t time, uint16_t x, uint16_t y, uint16_t z){ uint32_t k;
+  k = next(STREAMACC,time);
+  if(k&&((Expected[k-1].data[0] != x)||(Expected[k-1].data[1] != y)||(Expected[k-1].data[2] != z))){
+    if(Errors < 10) printf("  accelerometer sample %u wrong\n",(unsigned)(k-1));
+    Errors++;
+  }
+}
+// ****phoneSound****
+// Codec_DecodeFrame callback, ADPCM is lossy, so only the error is bounded
+void static phoneSound(uint16_t time, uint16_t data){ uint32_t k,err;
+  k = next(STREAMSOUND,time);
+  if(k){
+    err = abs((int)data-(int)Expected[k-1].data[0]);
+    if((SoundCount >= TESTSETTLE)&&(err > MaxSoundErr)) MaxSoundErr = err;
+    SoundCount++;
+  }
+}
+// ****phoneNotify****
+// a notification reached the phone
+void static phoneNotify(uint16_t uuid, const uint8_t *pt, uint32_t size){ int n;
+  if(uuid != 0xFFE1) return;
+  if((LastSeq >= 0)&&(pt[0] == LastSeq)){
+    ExpectedGet = FrameStart;            // resent, it replaces the one before
+    Received = Received-RecvLast;
+    Resends++;
+  }else if((LastSeq >= 0)&&(pt[0] != ((LastSeq+1)&0xFF))){
+    if(Errors < 10) printf("  frame %u follows frame %d\n",pt[0],(int)LastSeq);
+    Errors++;
+  }
+  LastSeq = pt[0];
+  FrameStart = ExpectedGet;
+  RecvLast = Received;
+  HeaderDrops = pt[1]+(pt[2]<<8);
+  n = Codec_DecodeFrame(pt,size,&phoneAcc,&phoneSound);
+  RecvLast = Received-RecvLast;
+  if(n < 0){
+    printf("  frame %u malformed\n",pt[0]);
+    Errors++;
+  }
+  Frames++;
+}
+
+// ****stream****
+// offer TESTMS ms of samples, the Bluetooth thread runs between them
+void static stream(void){ uint32_t ms,start,drops; uint16_t x,y,z,mic;
+  start = HostTime;
+  srand(1);
+  for(ms=0; ms<TESTMS; ms++){
+    if(HostTime < start+1000*ms){
+      HostTime = start+1000*ms;           // Task0 runs every 1 ms
+    }
+    mic = 412+((ms/2)%200 < 100 ? (ms/2)%100 : 100-(ms/2)%100)*2+(rand()%5); // 2.5 Hz triangle and noise
+    drops = StreamDrops;
+    Stream_PutSound(mic);
+    if(StreamControl&STREAMSOUND){
+      if(StreamDecimate == 0) expect(STREAMSOUND,mic,0,0,drops); // the one that was kept
+    }
+    if((ms%TESTACCMS) == 0){
+      x = 500+(rand()%41)-20; y = 520+(rand()%41)-20; z = 700+(rand()%41)-20;
+      drops = StreamDrops;
+      Stream_PutAcc(x,y,z);
+      if(StreamControl&STREAMACC) expect(STREAMACC,x,y,z,drops);
+    }
+    AP_BackgroundProcess();               // SRDY fell, the SNP has a frame
+    if((ms%TESTSEND) == 0){
+      Stream_Send();
+    }
+  }
+}
+
+int main(void){ int status; uint32_t dropped,i,fails;
+  Host_Init(0);
+  AP_InitStart();
+  do{
+    status = AP_InitRun();
+  }while(status == APBUSY);
+  if(status != APOK){
+    printf("SNP bring-up failed\n");
+    return 1;
+  }
+  fails = SNP_RecvTest();
+  printf("receive self-test failures=%u\n",(unsigned)fails);
+  Stream_Init();
+  if(Stream_AddService() != APOK){
+    printf("Stream_AddService failed\n");
+    return 1;
+  }
+  SNP_SetNotifyHandler(&phoneNotify);
+  SNP_Script(Script,sizeof(Script)/sizeof(snpstep_t));
+  LastSeq = -1;
+  AP_StartAdvertisement();
+  stream();
+  StreamControl = 0;                      // stop offering, let the ring drain
+  for(i=0; (i<100)&&(StreamPutI != StreamGetI); i++){
+    HostTime = HostTime+100000;
+    AP_BackgroundProcess();
+    Stream_Send();
+  }
+  dropped = 0;
+  for(i=0; i<ExpectedPut; i++){
+    dropped = dropped+Expected[i].dropped;
+  }
+  printf("offered=%u received=%u dropped=%u StreamDrops=%u header drops=%u\n",
+    (unsigned)ExpectedPut,(unsigned)Received,(unsigned)dropped,(unsigned)StreamDrops,(unsigned)HeaderDrops);
+  printf("frames=%u resends=%u largest sound error=%u\n",(unsigned)Frames,(unsigned)Resends,(unsigned)MaxSoundErr);
+  if(Frames == 0){
+    printf("  no frames reached the phone\n");
+    fails++;
+  }
+  if((StreamDrops == 0)||(dropped != StreamDrops)){
+    printf("  the busy SNP must cost samples, and each must be counted\n");
+    fails++;
+  }
+  if(Received+dropped != ExpectedPut){
+    printf("  samples lost without being counted\n");
+    fails++;
+  }
+  if(HeaderDrops != StreamDrops){
+    printf("  frame header drop count wrong\n");
+    fails++;
+  }
+  if(Resends == 0){
+    printf("  the spoiled response did not cause a resend\n");
+    fails++;
+  }
+  if(MaxSoundErr > MAXSOUNDERR){
+    printf("  microphone error too large\n");
+    fails++;
+  }
+  fails = fails+Errors;
+  printf("%s\n",fails ? "FAIL" : "PASS");
+  return fails != 0;
+}
@@ -25,16 +25,55 @@
 
 // U0Rx (VCP receive) connected to PA0
 // U0Tx (VCP transmit) connected to PA1
+// output goes through a RAM ring drained by the UART0 interrupt,
+// input is busy-wait
 #include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
 #include "UART0.h"
 #include "../inc/tm4c123gh6pm.h"
+#include "../inc/CortexM.h"
+#include "../inc/Diag.h"
 
 
 #define UART_FR_TXFF            0x00000020  // UART Transmit FIFO Full
 #define UART_FR_RXFE            0x00000010  // UART Receive FIFO Empty
+#define UART_FR_BUSY            0x00000008  // UART Transmit Busy
 #define UART_LCRH_WLEN_8        0x00000060  // 8 bit word length
 #define UART_LCRH_FEN           0x00000010  // UART Enable FIFOs
 #define UART_CTL_UARTEN         0x00000001  // UART Enable
+#define UART_IFLS_TX1_8         0x00000000  // TX FIFO <= 1/8 full
+#define UART_IM_TXIM            0x00000020  // UART Transmit Interrupt Mask
+#define NVIC_EN0_INT5           0x00000020  // Interrupt 5 enable
+
+// transmit ring, put by UART0_OutChar and UART0_Write, get by UART0_Handler
+char TxRing0[UART0TXSIZE];
+volatile uint32_t TxPut0;  // free running
+volatile uint32_t TxGet0;
+uint32_t UART0Lost;        // characters UART0_Printf had no room for
+
+// ****copySoftwareToHardware****
+// move bytes from the ring to the hardware TX FIFO until one of them is full/empty
+// called with interrupts disabled or from UART0_Handler
+void static copySoftwareToHardware(void){
+  while(((UART0_FR_R&UART_FR_TXFF) == 0)&&(TxGet0 != TxPut0)){
+    UART0_DR_R = TxRing0[TxGet0&(UART0TXSIZE-1)];
+    TxGet0++;
+  }
+  if(TxGet0 == TxPut0){
+    UART0_IM_R &= ~UART_IM_TXIM;        // nothing left, no more TX interrupts
+  }else{
+    UART0_IM_R |= UART_IM_TXIM;         // interrupt when the hardware FIFO drains
+  }
+}
+// ****txStart****
+// start or keep the interrupt-driven output going
+// also moves bytes by hand, so output makes progress with interrupts disabled
+void static txStart(void){ long sr;
+  sr = StartCritical();
+  copySoftwareToHardware();
+  EndCritical(sr);
+}
 
 
 //------------UART0_Init------------
@@ -43,6 +82,9 @@
 // Input: none
 // Output: none
 void UART0_Init(void){
+  TxPut0 = TxGet0 = 0;                  // empty ring
+  UART0Lost = 0;
+  Diag_Register(DIAGUART0LOST, &UART0Lost);
   SYSCTL_RCGCUART_R |= 0x01;            // activate UART0
   SYSCTL_RCGCGPIO_R |= 0x01;            // activate port A
   while((SYSCTL_PRGPIO_R&0x01) == 0){};
@@ -51,12 +93,25 @@ void UART0_Init(void){
   UART0_FBRD_R = 26;                    // FBRD = round(0.402778 * 64) = 26
                                         // 8 bit word length (no parity bits, one stop bit, FIFOs)
   UART0_LCRH_R = (UART_LCRH_WLEN_8|UART_LCRH_FEN);
+  UART0_IFLS_R = (UART0_IFLS_R&~0x07)|UART_IFLS_TX1_8; // TX interrupt at <= 1/8 full
+  UART0_IM_R &= ~UART_IM_TXIM;          // armed by copySoftwareToHardware when there is output
   UART0_CTL_R |= 0x301;                 // enable UART
   GPIO_PORTA_AFSEL_R |= 0x03;           // enable alt funct on PA1-0
   GPIO_PORTA_DEN_R |= 0x03;             // enable digital I/O on PA1-0
                                         // configure PA1-0 as UART
   GPIO_PORTA_PCTL_R = (GPIO_PORTA_PCTL_R&0xFFFFFF00)+0x00000011;
   GPIO_PORTA_AMSEL_R &= ~0x03;          // disable analog functionality on PA
+                                        // UART0=priority 6, below UART1 and the periodic threads
+  NVIC_PRI1_R = (NVIC_PRI1_R&0xFFFF00FF)|0x0000C000; // bits 13-15
+  NVIC_EN0_R = NVIC_EN0_INT5;           // enable interrupt 5 in NVIC
+}
+// ****UART0_Handler****
+// TX FIFO at or below 1/8 full, refill it from the ring
+void UART0_Handler(void){
+  if(UART0_RIS_R&UART_IM_TXIM){
+    UART0_ICR_R = UART_IM_TXIM;         // acknowledge TX FIFO
+    copySoftwareToHardware();
+  }
 }
 
 //------------UART0_InChar------------
@@ -69,16 +124,58 @@ char UART0_InChar(void){
 }
 //------------UART0_OutChar------------
 // Output 8-bit to serial port
+// waits only if the ring is full
 // Input: letter is an 8-bit ASCII character to be transferred
 // Output: none
-void UART0_OutChar(char data){
-  while((UART0_FR_R&UART_FR_TXFF) != 0);
-  UART0_DR_R = data;
+void UART0_OutChar(char data){ long sr;
+  while(1){
+    sr = StartCritical();
+    if((TxPut0-TxGet0) < UART0TXSIZE){
+      TxRing0[TxPut0&(UART0TXSIZE-1)] = data;
+      TxPut0++;
+      copySoftwareToHardware();
+      EndCritical(sr);
+      return;
+    }
+    copySoftwareToHardware();           // full, wait for the hardware
+    EndCritical(sr);
+  }
+}
+
+//------------UART0_Write------------
+// Put bytes in the transmit ring, as many as fit, never waits
+// one bounded copy, so it can be called from callbacks and other threads
+// Input: pt points to the bytes, text or binary
+//        size number of bytes
+// Output: number of bytes taken
+uint32_t UART0_Write(const char *pt, uint32_t size){ uint32_t put,n,first; long sr;
+  sr = StartCritical();
+  n = UART0TXSIZE-(TxPut0-TxGet0);      // room
+  if(size > n){
+    size = n;
+  }
+  put = TxPut0&(UART0TXSIZE-1);
+  first = UART0TXSIZE-put;              // bytes before the ring wraps
+  if(first > size) first = size;
+  memcpy(&TxRing0[put],pt,first);
+  memcpy(&TxRing0[0],pt+first,size-first);
+  TxPut0 += size;
+  copySoftwareToHardware();
+  EndCritical(sr);
+  return size;
 }
 
+//------------UART0_Room------------
+// Free bytes in the transmit ring
+// Input: none
+// Output: bytes UART0_Write would take now
+uint32_t UART0_Room(void){
+  return UART0TXSIZE-(TxPut0-TxGet0);
+}
 
 //------------UART0_OutString------------
 // Output String (NULL termination)
+// waits only while the ring is full
 // Input: pointer to a NULL-terminated string to be transferred
 // Output: none
 void UART0_OutString(char *pt){
@@ -88,6 +185,121 @@ void UART0_OutString(char *pt){
   }
 }
 
+//------------UART0_FinishOutput------------
+// Wait for the ring and the hardware FIFO to empty
+// Input: none
+// Output: none
+void UART0_FinishOutput(void){
+  while(TxGet0 != TxPut0){
+    txStart();
+  }
+  while(UART0_FR_R&UART_FR_BUSY){};
+}
+
+// ****fmtNumber****
+// digits of n in base 10 or 16, at least width characters, pad with pad
+// Output: number of characters written at pt
+uint32_t static fmtNumber(char *pt, uint32_t n, uint32_t base, uint32_t width, char pad, const char *digits){
+  char buf[10]; uint32_t i,count;
+  i = 0;
+  do{
+    buf[i] = digits[n%base];
+    n = n/base;
+    i++;
+  }while(n);
+  count = 0;
+  while(width > i){
+    pt[count] = pad;
+    count++; width--;
+  }
+  while(i){
+    i--;
+    pt[count] = buf[i];
+    count++;
+  }
+  return count;
+}
+
+//------------UART0_Printf------------
+// Formatted output into the transmit ring, never waits
+// formats into a UART0LINE character buffer on the stack, then one
+// UART0_Write, so the time is bounded by the length of the format
+// conversions: %u %d %x %X %c %s %%, with optional 0 flag and width (%08X)
+// the compiler checks the arguments against the format
+// Input: fmt format, the rest as in printf
+// Output: number of characters queued, the rest are counted in UART0Lost
+uint32_t UART0_Printf(const char *fmt, ...){
+  char line[UART0LINE+11]; uint32_t n,width,value; char pad; const char *s;
+  uint32_t sent;
+  va_list args;
+  va_start(args,fmt);
+  n = 0;
+  while(*fmt && (n < UART0LINE)){
+    if(*fmt != '%'){
+      line[n] = *fmt;
+      n++; fmt++;
+      continue;
+    }
+    fmt++;
+    pad = ' ';
+    if(*fmt == '0'){
+      pad = '0';
+      fmt++;
+    }
+    width = 0;
+    while((*fmt >= '0')&&(*fmt <= '9')){
+      width = 10*width+(*fmt-'0');
+      fmt++;
+    }
+    if(width > 10) width = 10;
+    switch(*fmt){
+      case 'u':
+        n += fmtNumber(&line[n],va_arg(args,uint32_t),10,width,pad,"0123456789");
+        break;
+      case 'd':
+        value = va_arg(args,int32_t);
+        if((int32_t)value < 0){
+          line[n] = '-';
+          n++;
+          value = -value;
+          if(width) width--;
+        }
+        n += fmtNumber(&line[n],value,10,width,pad,"0123456789");
+        break;
+      case 'x':
+        n += fmtNumber(&line[n],va_arg(args,uint32_t),16,width,pad,"0123456789abcdef");
+        break;
+      case 'X':
+        n += fmtNumber(&line[n],va_arg(args,uint32_t),16,width,pad,"0123456789ABCDEF");
+        break;
+      case 'c':
+        line[n] = va_arg(args,int);
+        n++;
+        break;
+      case 's':
+        s = va_arg(args,const char *);
+        while(*s && (n < UART0LINE)){
+          line[n] = *s;
+          n++; s++;
+        }
+        break;
+      case '%':
+        line[n] = '%';
+        n++;
+        break;
+      default:                          // not supported
+        fmt = "";
+        continue;
+    }
+    fmt++;
+  }
+  va_end(args);
+  if(n > UART0LINE) n = UART0LINE;
+  sent = UART0_Write(line,n);
+  UART0Lost += n-sent;
+  return sent;
+}
+
 //------------UART0_InUDec------------
 // InUDec accepts ASCII input in unsigned decimal format
 //     and converts to a 32-bit unsigned number
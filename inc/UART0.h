@@ -25,6 +25,8 @@
 
 // U0Rx (VCP receive) connected to PA0
 // U0Tx (VCP transmit) connected to PA1
+// output goes through a RAM ring drained by the UART0 interrupt, so printing
+// costs a short copy instead of 87 us per character; input is busy-wait
 
 // standard ASCII symbols
 #define CR   0x0D
@@ -34,9 +36,23 @@
 #define SP   0x20
 #define DEL  0x7F
 
+// bytes in the transmit ring, must be a power of 2
+#define UART0TXSIZE 512
+// longest line UART0_Printf formats, characters
+#define UART0LINE 80
+extern uint32_t UART0Lost;  // characters UART0_Printf had no room for
+
+// lets the compiler check UART0_Printf arguments against the format string
+#if defined(__GNUC__)||defined(__ARMCC_VERSION)
+#define UART0_FORMAT(FMT,ARGS) __attribute__((format(printf,FMT,ARGS)))
+#else
+#define UART0_FORMAT(FMT,ARGS)
+#endif
+
 //------------UART0_Init------------
 // Initialize the UART for 115,200 baud rate (assuming 80 MHz clock),
-// 8 bit word length, no parity bits, one stop bit, FIFOs enabled
+// 8 bit word length, no parity bits, one stop bit, FIFOs enabled,
+// empty transmit ring, TX interrupt at priority 6
 // Input: none
 // Output: none
 void UART0_Init(void);
@@ -49,16 +65,51 @@ char UART0_InChar(void);
 
 //------------UART0_OutChar------------
 // Output 8-bit to serial port
+// waits only if the transmit ring is full, moving bytes to the
+// hardware by hand, so it also works with interrupts disabled
 // Input: letter is an 8-bit ASCII character to be transferred
 // Output: none
 void UART0_OutChar(char data);
 
+//------------UART0_Write------------
+// Put bytes in the transmit ring, as many as fit, never waits
+// one bounded copy, so it can be called from callbacks and other threads
+// Input: pt points to the bytes, text or binary
+//        size number of bytes
+// Output: number of bytes taken
+uint32_t UART0_Write(const char *pt, uint32_t size);
+
+//------------UART0_Room------------
+// Free bytes in the transmit ring
+// Input: none
+// Output: bytes UART0_Write would take now
+uint32_t UART0_Room(void);
+
 //------------UART0_OutString------------
 // Output String (NULL termination)
+// waits only while the transmit ring is full
 // Input: pointer to a NULL-terminated string to be transferred
 // Output: none
 void UART0_OutString(char *pt);
 
+//------------UART0_FinishOutput------------
+// Wait for the ring and the hardware FIFO to empty
+// Input: none
+// Output: none
+void UART0_FinishOutput(void);
+
+//------------UART0_Printf------------
+// Formatted output into the transmit ring, never waits
+// formats at most UART0LINE characters on the stack, then one UART0_Write,
+// so the time is bounded and printing from SNP callbacks does not hold up
+// the confirmation going back to the SNP
+// conversions: %u %d %x %X %c %s %%, with optional 0 flag and width (%08X);
+// the compiler checks the arguments against the format, and anything
+// else stops the output at that point
+// Input: fmt format, the rest as in printf
+// Output: number of characters queued, the rest are counted in UART0Lost
+uint32_t UART0_Printf(const char *fmt, ...) UART0_FORMAT(1,2);
+
 //------------UART0_InUDec------------
 // InUDec accepts ASCII input in unsigned decimal format
 //     and converts to a 32-bit unsigned number
@@ -3,7 +3,8 @@
 // Use UART1 to implement bidirectional data transfer to and from another microcontroller
 // U1Rx PB0 is RxD (input to this microcontroller)
 // U1Tx PB1 is TxD (output of this microcontroller)
-// interrupts and FIFO used for receiver, busy-wait on transmit.
+// interrupts and FIFOs used for receiver and transmitter,
+// or the uDMA for both when UART1DMA is defined in UART1.h
 // Daniel Valvano
 // September 18, 2016
 
@@ -27,8 +28,11 @@
 
 
 #include <stdint.h>
+#include <string.h>
 #include "../inc/tm4c123gh6pm.h"
 #include "../inc/CortexM.h"
+#include "../inc/BSP.h"
+#include "../inc/Diag.h"
 
 #include "UART1.h"
 #define FIFOSIZE   256       // size of the FIFOs (must be power of 2)
@@ -57,15 +61,30 @@ int RxFifo_Get(uint8_t *datapt){
   RxGetI = (RxGetI+1)&(FIFOSIZE-1);         // next place to get
   return FIFOSUCCESS; 
 }
-                  
-//------------UART1_InStatus------------
-// Returns how much data available for reading
-// Input: none
-// Output: number of elements in receive FIFO
-uint32_t UART1_InStatus(void){  
- return ((RxPutI - RxGetI)&(FIFOSIZE-1));  
+uint32_t RxOverrun;    // hardware RX FIFO overruns
+uint32_t RxFramingErr; // bytes received without a valid stop bit
+uint32_t RxCoalesce;   // 1 to raise the RX FIFO trigger inside a frame
+uint32_t RxInterrupts; // RX FIFO and receive time-out interrupts
+uint32_t RxFrames;     // NPI frames seen by the receive ISR
+uint32_t RxFrameState; // 0 looking for SOF, 1 length LSB, 2 length MSB, 3 rest of frame
+uint32_t RxFrameLeft;  // bytes still to come in this frame
+// transmit FIFO, put by UART1_OutChar and UART1_Write, get by UART1_Handler
+uint32_t TxPutI;      // should be 0 to SIZE-1
+uint32_t TxGetI;      // should be 0 to SIZE-1 
+uint8_t TxFIFO[FIFOSIZE];
+void TxFifo_Init(void){
+  TxPutI = TxGetI = 0;                      // empty
+}
+int TxFifo_Put(uint8_t data){
+  if(((TxPutI+1)&(FIFOSIZE-1)) == TxGetI){
+    return FIFOFAIL; // fail if full  
+  }    
+  TxFIFO[TxPutI] = data;                    // save in FIFO
+  TxPutI = (TxPutI+1)&(FIFOSIZE-1);         // next place to put
+  return FIFOSUCCESS;
 }
 
+
 #define NVIC_EN0_INT6           0x00000040  // Interrupt 6 enable
 
 #define UART_FR_TXFE            0x00000080  // UART Transmit FIFO Empty
@@ -91,19 +110,137 @@ uint32_t UART1_InStatus(void){
 #define UART_ICR_RTIC           0x00000040  // Receive Time-Out Interrupt Clear
 #define UART_ICR_TXIC           0x00000020  // Transmit Interrupt Clear
 #define UART_ICR_RXIC           0x00000010  // Receive Interrupt Clear
+#define UART_ICR_OEIC           0x00000400  // Overrun Error Interrupt Clear
+#define UART_ICR_FEIC           0x00000080  // Framing Error Interrupt Clear
+#define UART_MIS_TXMIS          0x00000020  // UART Transmit Masked Interrupt
+
+#ifdef UART1DMA
+// uDMA channel control table, 32 primary then 32 alternate entries
+// of 4 words each: source end, destination end, control, unused
+// the uDMA controller requires it to be 1024-byte aligned
+uint32_t UDMAControl[256] __attribute__((aligned(1024)));
+#define UART1RXCH 22            // uDMA channel 22, encoding 0, is UART1 RX
+#define UART1TXCH 23            // uDMA channel 23, encoding 0, is UART1 TX
+#define RXPRI (4*UART1RXCH)     // primary entry of the RX channel
+#define RXALT (128+4*UART1RXCH) // alternate entry of the RX channel
+#define TXPRI (4*UART1TXCH)
+// RX: UART1_DR_R to bytes, 1 item per request, ping-pong
+#define RXCONTROL (0x0C000000|((DMAHALF-1)<<4)|0x03)
+// TX: bytes to UART1_DR_R, 4 items per burst, basic
+#define TXCONTROL 0xC0008001
+#define SRAMBASE 0x20000000     // the uDMA reads SRAM and peripherals, not flash
+uint8_t RxDMABuf[2*DMAHALF];  // primary fills the first half, alternate the second
+// RxDMAGet and RxDMADone count bytes since dmaInit and wrap freely,
+// the ring index is the count&(2*DMAHALF-1); both change only with interrupts disabled
+uint32_t RxDMAGet;            // bytes read
+uint32_t RxDMADone;           // bytes in the halves the uDMA has filled
+uint32_t RxDMAHalf;           // half the uDMA is filling now
+uint32_t UART1DMAOn;          // 1 while the uDMA moves the bytes, 0 after a fallback
+uint32_t UART1DMAErrors;      // uDMA bus errors, each one falls back to interrupts
+
+// ****rxDMAArm****
+// point one half of the receive ring at UART1_DR_R again
+void static rxDMAArm(uint32_t half){ uint32_t entry;
+  entry = half ? RXALT : RXPRI;
+  UDMAControl[entry] = (uint32_t)(uintptr_t)&UART1_DR_R;
+  UDMAControl[entry+1] = (uint32_t)(uintptr_t)&RxDMABuf[half*DMAHALF+DMAHALF-1];
+  UDMAControl[entry+2] = RXCONTROL;
+}
+// ****rxDMAPut****
+// bytes the uDMA has written since dmaInit, free running like RxDMAGet
+// called with interrupts disabled, so RxDMAHalf matches its control word
+uint32_t static rxDMAPut(void){ uint32_t control;
+  control = UDMAControl[(RxDMAHalf ? RXALT : RXPRI)+2];
+  if((control&0x07) == 0){   // stopped, that half is full and the ISR has not run yet
+    return RxDMADone+DMAHALF;
+  }
+  return RxDMADone+DMAHALF-1-((control>>4)&0x3FF);
+}
+// ****txDMAWait****
+// wait for a UART1_OutBuffer transfer to finish loading the TX FIFO
+void static txDMAWait(void){
+  while(UDMA_ENASET_R&(1<<UART1TXCH)){};
+}
+// ****dmaInit****
+// UART1 RX into the ping-pong ring, TX from UART1_OutBuffer
+void static dmaInit(void){
+  SYSCTL_RCGCDMA_R |= 0x01;             // activate uDMA
+  while((SYSCTL_PRDMA_R&0x01) == 0){};
+  UDMA_CFG_R = 0x01;                    // enable uDMA controller
+  UDMA_CTLBASE_R = (uint32_t)(uintptr_t)UDMAControl;
+  UDMA_CHMAP2_R &= ~0xFF000000;         // channels 22 and 23 are UART1 (encoding 0)
+  UDMA_PRIOCLR_R = (1<<UART1RXCH)|(1<<UART1TXCH);     // default priority
+  UDMA_USEBURSTCLR_R = (1<<UART1RXCH)|(1<<UART1TXCH); // single requests too
+  UDMA_REQMASKCLR_R = (1<<UART1RXCH)|(1<<UART1TXCH);  // allow UART1 requests
+  UDMA_ALTCLR_R = (1<<UART1RXCH)|(1<<UART1TXCH);      // start with primary
+  RxDMAGet = RxDMADone = 0;
+  RxDMAHalf = 0;
+  rxDMAArm(0);
+  rxDMAArm(1);
+  UDMA_ENASET_R = 1<<UART1RXCH;
+  UART1_IM_R &= ~(UART_IM_RXIM|UART_IM_RTIM); // UART1_Handler now runs when a half fills
+  UART1_DMACTL_R = UART_DMACTL_RXDMAE|UART_DMACTL_TXDMAE;
+  UART1DMAOn = 1;
+  UART1DMAErrors = 0;
+  UDMA_ERRCLR_R = 0x01;                 // uDMA error=priority 2, same as UART1
+  NVIC_PRI11_R = (NVIC_PRI11_R&0x00FFFFFF)|0x40000000; // bits 29-31
+  NVIC_EN1_R = 1<<(47-32);              // enable interrupt 47 in NVIC
+}
+// ****dmaFallback****
+// uDMA failed, move unread bytes to the software FIFO and use interrupts
+void static dmaFallback(void){ uint32_t put;
+  UDMA_ENACLR_R = (1<<UART1RXCH)|(1<<UART1TXCH);
+  UART1_DMACTL_R = 0;
+  UART1DMAOn = 0;
+  put = rxDMAPut();
+  while(RxDMAGet != put){
+    RxFifo_Put(RxDMABuf[RxDMAGet&(2*DMAHALF-1)]);
+    RxDMAGet++;
+  }
+  UART1_IM_R |= (UART_IM_RXIM|UART_IM_RTIM);
+}
+#endif
 
+uint32_t UART1Baud;   // bits/sec set by UART1_Init or UART1_SetBaud
+// ****uart1Divisor****
+// baud rate divisor for the current bus clock, in 1/64ths
+// BRD = clock/(16*baud), IBRD = int(BRD), FBRD = round(64*fraction(BRD))
+// Output: 64*BRD rounded, 0 if the rate is out of range
+uint32_t static uart1Divisor(uint32_t baud){ uint32_t clock,divisor;
+  clock = BSP_Clock_GetFreq();
+  if((baud == 0)||(baud > clock/16)) return 0;  // HSE off, at least 16 clocks a bit
+  divisor = (clock/baud)*4+(((clock%baud)*8/baud+1)>>1);
+  if((divisor>>6) > 0xFFFF) return 0;
+  return divisor;
+}
 //------------UART1_Init------------
-// Initialize the UART1 for 115,200 baud rate (assuming 80 MHz clock),
+// Initialize the UART1 for UART1BAUD bits/sec at the current bus clock,
 // 8 bit word length, no parity bits, one stop bit, FIFOs enabled
+// interrupts are left as the caller had them, UART1 interrupts
+// start once the caller enables interrupts (OS_Launch)
 // Input: none
 // Output: none
-void UART1_Init(void){
+void UART1_Init(void){ uint32_t divisor; long sr;
+  sr = StartCritical();
   SYSCTL_RCGCUART_R |= 0x02;            // activate UART1
   SYSCTL_RCGCGPIO_R |= 0x02;            // activate port B
-  RxFifo_Init();                        // initialize empty FIFO
+  RxFifo_Init();                        // initialize empty FIFOs
+  TxFifo_Init();
+  RxOverrun = RxFramingErr = 0;
+  RxFrameState = 0;
+  RxInterrupts = RxFrames = 0;
+  RxCoalesce = 1;                       // frame-based RX FIFO trigger
+  Diag_Register(DIAGRXFIFOLOST, &RxFifoLost);
+  Diag_Register(DIAGRXOVERRUN, &RxOverrun);
+  Diag_Register(DIAGRXFRAMINGERR, &RxFramingErr);
+#ifdef UART1DMA
+  Diag_Register(DIAGUART1DMAERRORS, &UART1DMAErrors);
+#endif
   UART1_CTL_R &= ~UART_CTL_UARTEN;      // disable UART
-  UART1_IBRD_R = 43;                    // IBRD = int(80,000,000 / (16 * 115200)) = int(43.402778)
-  UART1_FBRD_R = 26;                    // FBRD = round(0.402778 * 64) = 26
+  divisor = uart1Divisor(UART1BAUD);    // 80 MHz: IBRD = int(43.402778) = 43
+  UART1_IBRD_R = divisor>>6;
+  UART1_FBRD_R = divisor&0x3F;          // FBRD = round(0.402778 * 64) = 26
+  UART1Baud = UART1BAUD;
                                         // 8 bit word length (no parity bits, one stop bit, FIFOs)
   UART1_LCRH_R = (UART_LCRH_WLEN_8|UART_LCRH_FEN);
   UART1_IFLS_R &= ~0x3F;                // clear TX and RX interrupt FIFO level fields
@@ -112,6 +249,7 @@ void UART1_Init(void){
   UART1_IFLS_R += (UART_IFLS_TX1_8|UART_IFLS_RX1_8);
                                         // enable RX FIFO interrupts and RX time-out interrupt
   UART1_IM_R |= (UART_IM_RXIM|UART_IM_RTIM);
+  UART1_IM_R |= (UART_IM_OEIM|UART_IM_FEIM); // count overrun and framing errors
   UART1_CTL_R |= 0x301;                 // enable UART
   GPIO_PORTB_AFSEL_R |= 0x03;           // enable alt funct on PB1-0
   GPIO_PORTB_DEN_R |= 0x03;             // enable digital I/O on PB1-0
@@ -121,7 +259,86 @@ void UART1_Init(void){
                                         // UART1=priority 2
   NVIC_PRI1_R = (NVIC_PRI1_R&0xFF00FFFF)|0x00400000; // bits 21-23
   NVIC_EN0_R = NVIC_EN0_INT6;           // enable interrupt 6 in NVIC
-  EnableInterrupts();
+#ifdef UART1DMA
+  dmaInit();
+#endif
+  EndCritical(sr);
+}
+//------------UART1_SetBaud------------
+// Change the UART1 baud rate, divisors from the current bus clock
+// waits for the bytes already queued to go out at the old rate,
+// bytes arriving during the switch may be lost or garbled
+// Input: baud bits/sec, at most bus clock/16 (5,000,000 at 80 MHz)
+// Output: 1 if changed, 0 if the rate is out of range (rate unchanged)
+int UART1_SetBaud(uint32_t baud){ uint32_t divisor;
+  divisor = uart1Divisor(baud);
+  if(divisor == 0) return 0;
+  UART1_FinishOutput();
+  UART1_CTL_R &= ~UART_CTL_UARTEN;      // disable UART
+  UART1_IBRD_R = divisor>>6;
+  UART1_FBRD_R = divisor&0x3F;
+  UART1_LCRH_R = (UART_LCRH_WLEN_8|UART_LCRH_FEN); // write LCRH to latch the divisors
+  UART1_CTL_R |= UART_CTL_UARTEN;       // enable UART
+  UART1Baud = baud;
+  return 1;
+}
+//------------UART1_InStatus------------
+// Returns how much data available for reading
+// Input: none
+// Output: number of elements in receive FIFO
+uint32_t UART1_InStatus(void){
+#ifdef UART1DMA
+  uint32_t n; long sr;
+  if(UART1DMAOn){
+    sr = StartCritical();
+    n = rxDMAPut()-RxDMAGet;
+    EndCritical(sr);
+    return n;
+  }
+#endif
+  return ((RxPutI - RxGetI)&(FIFOSIZE-1));
+}
+// NPI frame tracking in the receive ISR, for UART1_Coalesce
+// SOF, length (2 bytes), then length+3 bytes: cmd0, cmd1, payload, FCS
+#define NPISOF 0xFE
+// ****rxParse****
+// follow the frame one received byte at a time
+void static rxParse(uint8_t data){
+  switch(RxFrameState){
+    case 0:
+      if(data == NPISOF) RxFrameState = 1;
+      break;
+    case 1:
+      RxFrameLeft = data;
+      RxFrameState = 2;
+      break;
+    case 2:
+      RxFrameLeft = RxFrameLeft+(data<<8)+3;
+      RxFrameState = 3;
+      break;
+    case 3:
+      RxFrameLeft--;
+      if(RxFrameLeft == 0){
+        RxFrames++;
+        RxFrameState = 0;
+      }
+      break;
+  }
+}
+// ****rxLevel****
+// RX FIFO trigger at the largest level the rest of the frame will reach,
+// the receive time-out picks up a tail shorter than the level
+// between frames 4 bytes, SOF through cmd0 of the shortest frame
+void static rxLevel(void){ uint32_t level;
+  if(RxFrameState == 3){
+    if(RxFrameLeft >= 12)     level = 0x18;  // 3/4 full, 12 bytes
+    else if(RxFrameLeft >= 8) level = 0x10;  // 1/2 full, 8 bytes
+    else if(RxFrameLeft >= 4) level = 0x08;  // 1/4 full, 4 bytes
+    else                      level = 0x00;  // 1/8 full, 2 bytes
+  }else{
+    level = 0x08;
+  }
+  UART1_IFLS_R = (UART1_IFLS_R&~0x38)|level;
 }
 // copy from hardware RX FIFO to software RX FIFO
 // stop when hardware RX FIFO is empty or software RX FIFO is full
@@ -130,13 +347,87 @@ void static copyHardwareToSoftware(void){
   while(((UART1_FR_R&UART_FR_RXFE) == 0) && (UART1_InStatus() < (FIFOSIZE - 1))){
     letter = UART1_DR_R;
     RxFifo_Put(letter);
+    rxParse(letter);
+  }
+  if(RxCoalesce){
+    rxLevel();
+  }
+}
+//------------UART1_Coalesce------------
+// Choose how often the receiver interrupts, when the uDMA is not used
+// off: RX FIFO 1/8 full (2 bytes) or receive time-out
+// on: inside an NPI frame the trigger follows the bytes still to come,
+// so a frame body takes one interrupt per 8 to 12 bytes
+// RxInterrupts/RxFrames gives interrupts per frame for either mode
+// UART1_Init turns it on
+// Input: on 1 for frame-based triggers, 0 for the fixed 1/8 trigger
+// Output: none
+void UART1_Coalesce(uint32_t on){
+  RxCoalesce = on;
+  RxInterrupts = RxFrames = 0;
+  if(on == 0){
+    UART1_IFLS_R = (UART1_IFLS_R&~0x38)|UART_IFLS_RX1_8;
+  }
+}
+// copy from software TX FIFO to hardware TX FIFO
+// stop when software TX FIFO is empty or hardware TX FIFO is full
+void static copySoftwareToHardware(void){
+  while(((UART1_FR_R&UART_FR_TXFF) == 0) && (TxPutI != TxGetI)){
+    UART1_DR_R = TxFIFO[TxGetI];
+    TxGetI = (TxGetI+1)&(FIFOSIZE-1);
   }
 }
+// ****txStart****
+// move what fits to the hardware, the TX interrupt sends the rest
+void static txStart(void){
+  UART1_IM_R &= ~UART_IM_TXIM;          // disable TX FIFO interrupt
+  copySoftwareToHardware();
+  if(TxPutI != TxGetI){
+    UART1_IM_R |= UART_IM_TXIM;         // enable TX FIFO interrupt
+  }
+}
+// ****ringRead****
+// copy size bytes out of a ring buffer, at most two contiguous pieces
+// Output: new get index
+uint32_t static ringRead(uint8_t *pt, const uint8_t *ring, uint32_t ringSize,
+  uint32_t get, uint32_t size){ uint32_t first;
+  first = ringSize-get;                 // bytes before the ring wraps
+  if(first > size) first = size;
+  memcpy(pt,&ring[get],first);
+  memcpy(&pt[first],ring,size-first);
+  return (get+size)&(ringSize-1);
+}
+#ifdef UART1DMA
+// ****rxDMARead****
+// copy up to size bytes out of the uDMA receive ring
+// RxDMAGet is loaded and stored with interrupts disabled,
+// so UART1_Handler and dmaFallback never see it half moved
+// Output: number of bytes copied
+uint32_t static rxDMARead(uint8_t *pt, uint32_t size){ uint32_t n; long sr;
+  sr = StartCritical();
+  n = rxDMAPut()-RxDMAGet;
+  if(n > size){
+    n = size;
+  }
+  ringRead(pt,RxDMABuf,2*DMAHALF,RxDMAGet&(2*DMAHALF-1),n);
+  RxDMAGet = RxDMAGet+n;
+  EndCritical(sr);
+  return n;
+}
+#endif
 
 // input ASCII character from UART
 // spin if RxFifo is empty
 uint8_t UART1_InChar(void){
   uint8_t letter;
+#ifdef UART1DMA
+  if(UART1DMAOn){
+    while(rxDMARead(&letter,1) == 0){
+      if(UART1DMAOn == 0) return UART1_InChar(); // fell back while waiting
+    };
+    return(letter);
+  }
+#endif
   while(RxFifo_Get(&letter) == FIFOFAIL){};
   return(letter);
 }
@@ -145,14 +436,138 @@ uint8_t UART1_InChar(void){
 // Input: letter is an 8-bit ASCII character to be transferred
 // Output: none
 void UART1_OutChar(uint8_t data){
-  while((UART1_FR_R&UART_FR_TXFF) != 0);
-  UART1_DR_R = data;
+#ifdef UART1DMA
+  txDMAWait();  // bytes go out in order
+#endif
+  while(TxFifo_Put(data) == FIFOFAIL){};
+  txStart();
+}
+//------------UART1_Write------------
+// Output a block of bytes to serial port through the software TX FIFO
+// copies contiguous pieces, waits only while the FIFO is full
+// Input: pt points to the bytes
+//        size number of bytes
+// Output: none
+void UART1_Write(const uint8_t *pt, uint32_t size){ uint32_t room;
+#ifdef UART1DMA
+  txDMAWait();  // bytes go out in order
+#endif
+  while(size){
+    room = (TxGetI-TxPutI-1)&(FIFOSIZE-1);
+    if(room > FIFOSIZE-TxPutI){
+      room = FIFOSIZE-TxPutI;           // up to the end of the ring
+    }
+    if(room > size){
+      room = size;
+    }
+    memcpy(&TxFIFO[TxPutI],pt,room);    // room is 0 while full
+    TxPutI = (TxPutI+room)&(FIFOSIZE-1);
+    pt = pt+room;
+    size = size-room;
+    txStart();
+  }
+}
+//------------UART1_Read------------
+// Input a block of bytes from serial port
+// copies contiguous pieces of the receive buffer
+// Input: pt points to room for size bytes
+//        size number of bytes wanted
+//        timeout number of times to find the buffer empty before giving up,
+//        counted again after each byte, 0 takes only what is already there
+// Output: number of bytes read, less than size on timeout
+uint32_t UART1_Read(uint8_t *pt, uint32_t size, uint32_t timeout){
+  uint32_t count,n,waits;
+  count = 0;
+  waits = 0;
+  while(count < size){
+    n = UART1_InStatus();
+    if(n == 0){
+      if(waits >= timeout) break;
+      waits++;
+      continue;
+    }
+    waits = 0;
+    if(n > size-count){
+      n = size-count;
+    }
+#ifdef UART1DMA
+    if(UART1DMAOn){
+      count = count+rxDMARead(&pt[count],n);
+      continue;
+    }
+#endif
+    RxGetI = ringRead(&pt[count],RxFIFO,FIFOSIZE,RxGetI,n);
+    count = count+n;
+  }
+  return count;
 }
-// at least one of two things has happened:
+//------------UART1_OutBuffer------------
+// Output a block of bytes to serial port
+// with the uDMA the transfer is started and this returns at once,
+// the buffer must not change until UART1_FinishOutput returns
+// the uDMA cannot read flash, const frames and strings go through the TX FIFO
+// Input: pt points to the bytes
+//        size number of bytes
+// Output: none
+void UART1_OutBuffer(const uint8_t *pt, uint32_t size){
+#ifdef UART1DMA
+  if(UART1DMAOn&&(size >= UART1DMAMIN)&&(size <= 1024)&&((uintptr_t)pt >= SRAMBASE)){
+    txDMAWait();
+    while(TxPutI != TxGetI){};          // bytes before it go first
+    UDMAControl[TXPRI] = (uint32_t)(uintptr_t)&pt[size-1];
+    UDMAControl[TXPRI+1] = (uint32_t)(uintptr_t)&UART1_DR_R;
+    UDMAControl[TXPRI+2] = TXCONTROL|((size-1)<<4);
+    UDMA_ENASET_R = 1<<UART1TXCH;
+    return;
+  }
+#endif
+  UART1_Write(pt,size);
+}
+// at least one of these things has happened:
 // hardware RX FIFO goes from 1 to 2 or more items
 // UART receiver has timed out
+// hardware TX FIFO goes from 3 to 2 or fewer items
+// overrun or framing error
+// with the uDMA, a receive half is full or a transmit block is done
 void UART1_Handler(void){
-  if(UART1_RIS_R&UART_RIS_RXRIS){       // hardware RX FIFO >= 2 items
+  if(UART1_MIS_R&UART_MIS_TXMIS){       // hardware TX FIFO <= 2 items
+    UART1_ICR_R = UART_ICR_TXIC;        // acknowledge TX FIFO
+    // copy from software TX FIFO to hardware TX FIFO
+    copySoftwareToHardware();
+    if(TxPutI == TxGetI){               // software TX FIFO is empty
+      UART1_IM_R &= ~UART_IM_TXIM;      // disable TX FIFO interrupt
+    }
+  }
+  if(UART1_RIS_R&UART_RIS_OERIS){       // hardware RX FIFO overflowed
+    UART1_ICR_R = UART_ICR_OEIC;
+    RxOverrun++;
+  }
+  if(UART1_RIS_R&UART_RIS_FERIS){       // missing stop bit
+    UART1_ICR_R = UART_ICR_FEIC;
+    RxFramingErr++;
+  }
+#ifdef UART1DMA
+  if(UDMA_CHIS_R&(1<<UART1RXCH)){
+    UDMA_CHIS_R = 1<<UART1RXCH;         // acknowledge
+    RxDMADone = RxDMADone+DMAHALF;      // that half is full
+    if(RxDMADone-RxDMAGet > DMAHALF){
+      // the uDMA now refills the other half over unread bytes, a whole lap
+      // or more if the reader is that far behind; skip to the oldest intact byte
+      RxFifoLost += RxDMADone-DMAHALF-RxDMAGet;
+      RxDMAGet = RxDMADone-DMAHALF;
+    }
+    rxDMAArm(RxDMAHalf);                // refill it after the other half
+    RxDMAHalf = RxDMAHalf^1;
+  }
+  if(UDMA_CHIS_R&(1<<UART1TXCH)){
+    UDMA_CHIS_R = 1<<UART1TXCH;         // acknowledge, txDMAWait polls the enable
+  }
+  if(UART1DMAOn) return;                // the FIFO belongs to the uDMA
+#endif
+  if(UART1_RIS_R&(UART_RIS_RXRIS|UART_RIS_RTRIS)){
+    RxInterrupts++;
+  }
+  if(UART1_RIS_R&UART_RIS_RXRIS){       // hardware RX FIFO at the trigger level
     UART1_ICR_R = UART_ICR_RXIC;        // acknowledge RX FIFO
     // copy from hardware RX FIFO to software RX FIFO
     copyHardwareToSoftware();
@@ -163,6 +578,17 @@ void UART1_Handler(void){
     copyHardwareToSoftware();
   }
 }
+#ifdef UART1DMA
+// uDMA bus error, executed on interrupt 47
+// UART1 is the only uDMA user, so go back to UART1 interrupts
+void UDMAERR_Handler(void){
+  UDMA_ERRCLR_R = 0x01;                 // acknowledge
+  UART1DMAErrors++;
+  if(UART1DMAOn){
+    dmaFallback();
+  }
+}
+#endif
 
 //------------UART1_OutString------------
 // Output String (NULL termination)
@@ -181,6 +607,10 @@ void UART1_OutString(uint8_t *pt){
 // Input: none
 // Output: none
 void UART1_FinishOutput(void){
+#ifdef UART1DMA
+  txDMAWait();
+#endif
+  while(TxPutI != TxGetI){};            // software TX FIFO empty
   // Wait for entire tx message to be sent
   // UART Transmit FIFO Empty =1, when Tx done
   while((UART1_FR_R&UART_FR_TXFE) == 0);
@@ -3,7 +3,8 @@
 // Use UART1 to implement bidirectional data transfer to and from another microcontroller
 // U1Rx PB0 is RxD (input to this microcontroller)
 // U1Tx PB1 is TxD (output of this microcontroller)
-// interrupts and FIFO used for receiver, busy-wait on transmit.
+// interrupts and FIFOs used for receiver and transmitter,
+// or the uDMA for both when UART1DMA is defined below
 // Daniel Valvano
 // September 18, 2016
 
@@ -32,13 +33,53 @@
 #define SP   0x20
 #define DEL  0x7F
 
+// if you define UART1DMA then the uDMA receives into a ping-pong ring buffer
+// and UART1_OutBuffer sends blocks without the CPU; a uDMA error falls back
+// to the interrupt-driven receiver and busy-wait transmitter
+#define UART1DMA 1
+#define DMAHALF 64        // bytes in each half of the receive ring, power of 2
+#define UART1DMAMIN 8     // shorter blocks are cheaper to send byte by byte
+extern uint32_t UART1DMAOn;     // 1 while the uDMA moves the bytes
+extern uint32_t UART1DMAErrors; // uDMA bus errors, each one falls back to interrupts
+extern uint32_t RxFifoLost;     // bytes lost because the receive buffer was full
+extern uint32_t RxOverrun;      // hardware RX FIFO overruns
+extern uint32_t RxFramingErr;   // bytes received without a valid stop bit
+extern uint32_t RxInterrupts;   // RX FIFO and receive time-out interrupts, without the uDMA
+extern uint32_t RxFrames;       // NPI frames seen by the receive ISR, without the uDMA
+
+// baud rate set by UART1_Init, SimpleNP 2.2 runs its NPI UART at 115,200
+#define UART1BAUD 115200
+extern uint32_t UART1Baud;      // bits/sec now, set by UART1_Init or UART1_SetBaud
+
 //------------UART1_Init------------
-// Initialize the UART1 for 115,200 baud rate (assuming 80 MHz clock),
+// Initialize the UART1 for UART1BAUD bits/sec, divisors computed from
+// BSP_Clock_GetFreq, so call it after the clock is set,
 // 8 bit word length, no parity bits, one stop bit, FIFOs enabled
 // Input: none
 // Output: none
 void UART1_Init(void);
 
+//------------UART1_SetBaud------------
+// Change the UART1 baud rate, divisors from the current bus clock
+// waits for the bytes already queued to go out at the old rate,
+// bytes arriving during the switch may be lost or garbled,
+// so both ends must agree on when to switch, see AP_SetBaud
+// Input: baud bits/sec, at most bus clock/16 (5,000,000 at 80 MHz)
+// Output: 1 if changed, 0 if the rate is out of range (rate unchanged)
+int UART1_SetBaud(uint32_t baud);
+
+//------------UART1_Coalesce------------
+// Choose how often the receiver interrupts, when the uDMA is not used
+// off: RX FIFO 1/8 full (2 bytes) or receive time-out, as before
+// on: the receive ISR follows each NPI frame using its length field,
+// inside a frame the trigger is the largest FIFO level the rest of the
+// frame will reach, and the receive time-out picks up the tail;
+// UART1_Init turns it on
+// RxInterrupts/RxFrames gives interrupts per frame for either mode
+// Input: on 1 for frame-based triggers, 0 for the fixed 1/8 trigger
+// Output: none
+void UART1_Coalesce(uint32_t on);
+
 //------------UART1_InChar------------
 // Wait for new serial port input
 // Input: none
@@ -51,6 +92,41 @@ uint8_t UART1_InChar(void);
 // Output: none
 void UART1_OutChar(uint8_t data);
 
+//------------UART1_OutBuffer------------
+// Output a block of bytes to serial port
+// with the uDMA the transfer is started and this returns at once,
+// the buffer must not change until UART1_FinishOutput returns;
+// blocks in flash (const) are sent through the TX FIFO, the uDMA cannot read flash
+// Input: pt points to the bytes
+//        size number of bytes
+// Output: none
+void UART1_OutBuffer(const uint8_t *pt, uint32_t size);
+
+//------------UART1_Write------------
+// Output a block of bytes to serial port through the software TX FIFO
+// copies contiguous pieces, waits only while the FIFO is full,
+// the TX interrupt sends the bytes
+// Input: pt points to the bytes
+//        size number of bytes
+// Output: none
+void UART1_Write(const uint8_t *pt, uint32_t size);
+
+//------------UART1_Read------------
+// Input a block of bytes from serial port
+// copies contiguous pieces of the receive buffer
+// Input: pt points to room for size bytes
+//        size number of bytes wanted
+//        timeout number of times to find the buffer empty before giving up,
+//        counted again after each byte, 0 takes only what is already there
+// Output: number of bytes read, less than size on timeout
+uint32_t UART1_Read(uint8_t *pt, uint32_t size, uint32_t timeout);
+
+//------------UART1_InStatus------------
+// Returns how much data available for reading
+// Input: none
+// Output: number of bytes received and not yet read
+uint32_t UART1_InStatus(void);
+
 //------------UART1_OutString------------
 // Output String (NULL termination)
 // Input: pointer to a NULL-terminated string to be transferred
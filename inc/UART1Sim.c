@@ -0,0 +1,269 @@
+// UART1Sim.c
+// Runs on the PC, not part of the Keil project
+// Host simulation of the UART1 receiver, to test UART1_Coalesce
+// UART1.c is compiled in unchanged, its registers replaced by a model of
+// the 16-byte RX FIFO, the FIFO trigger levels and the receive time-out;
+// UART1_Handler runs as soon as an enabled interrupt is raised
+// gcc -O2 -Wall -Wextra -Wno-old-style-declaration -o UART1Sim UART1Sim.c
+// -Wno-old-style-declaration: the repo writes "void static" for file-local functions
+// the uDMA addresses in UART1.c are cast through uintptr_t; on the PC they are
+// cut to 32 bits, which does not matter, the model never runs the uDMA
+// UART1Sim            (prints the results, exit code 0 if every check passed)
+// NPI frames with 0 to 64 payload bytes are received three ways:
+//   gaps:        an idle line after each frame, one frame per SRDY handshake
+//   back to back: no idle time between frames, so FIFO levels and frame ends disagree
+//   split:       the SNP pauses part way through each frame
+// with the fixed 1/8 trigger (UART1_Coalesce(0)) and with coalescing on
+// checks: every byte arrives in order, RxFrames counts each frame once,
+// no overrun, and the last byte of each frame reaches the software FIFO
+// no later than the receive time-out, so no tail is left behind
+// the uDMA is switched off after UART1_Init, as after a uDMA error,
+// since this interrupt path is the one coalescing applies to
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "tm4c123gh6pm.h"
+
+// ****register model****
+#define SIMFIFO 16        // hardware RX FIFO
+#define SIMTIMEOUT 4      // receive time-out, 32 bit times rounded up to whole characters
+uint8_t SimFifo[SIMFIFO];
+uint32_t SimCount,SimGet;  // bytes in the hardware RX FIFO, next one to read
+uint32_t SimRT;            // receive time-out raised
+uint32_t SimOE;            // overrun raised
+uint32_t SimICR;           // last value written to UART1_ICR_R
+uint32_t SimDR;            // last byte read from UART1_DR_R
+uint32_t SimReg[40];       // registers the model does not need to follow
+const uint32_t SimLevel[8] = {2,4,8,12,14,14,14,14}; // IFLS RX field to bytes
+
+// ****simDR****
+// UART1_DR_R, reading takes the oldest byte out of the RX FIFO
+uint32_t *simDR(void){
+  if(SimCount){
+    SimDR = SimFifo[SimGet];
+    SimGet = (SimGet+1)%SIMFIFO;
+    SimCount--;
+  }
+  return &SimDR;
+}
+// ****simFR****
+// UART1_FR_R, TX FIFO never full, RX FIFO empty flag
+uint32_t simFR(void){
+  return SimCount ? 0 : UART_FR_RXFE;
+}
+// ****simRIS****
+// UART1_RIS_R, RX at the trigger level, receive time-out, overrun
+uint32_t simRIS(void){ uint32_t ris;
+  ris = 0;
+  if(SimCount >= SimLevel[(SimReg[0]>>3)&0x07]) ris |= UART_RIS_RXRIS;
+  if(SimRT) ris |= UART_RIS_RTRIS;
+  if(SimOE) ris |= UART_RIS_OERIS;
+  return ris;
+}
+#undef UART1_CTL_R
+#define UART1_CTL_R       SimReg[2]
+#undef UART1_IBRD_R
+#define UART1_IBRD_R      SimReg[3]
+#undef UART1_FBRD_R
+#define UART1_FBRD_R      SimReg[4]
+#undef UART1_LCRH_R
+#define UART1_LCRH_R      SimReg[5]
+#undef UART1_DMACTL_R
+#define UART1_DMACTL_R    SimReg[6]
+#undef SYSCTL_RCGCUART_R
+#define SYSCTL_RCGCUART_R SimReg[7]
+#undef SYSCTL_RCGCGPIO_R
+#define SYSCTL_RCGCGPIO_R SimReg[8]
+#undef SYSCTL_RCGCDMA_R
+#define SYSCTL_RCGCDMA_R  SimReg[9]
+#undef SYSCTL_PRDMA_R
+#define SYSCTL_PRDMA_R    (SimReg[10]|0x01)
+#undef GPIO_PORTB_AFSEL_R
+#define GPIO_PORTB_AFSEL_R SimReg[11]
+#undef GPIO_PORTB_DEN_R
+#define GPIO_PORTB_DEN_R  SimReg[12]
+#undef GPIO_PORTB_PCTL_R
+#define GPIO_PORTB_PCTL_R SimReg[13]
+#undef GPIO_PORTB_AMSEL_R
+#define GPIO_PORTB_AMSEL_R SimReg[14]
+#undef NVIC_PRI1_R
+#define NVIC_PRI1_R       SimReg[15]
+#undef NVIC_EN0_R
+#define NVIC_EN0_R        SimReg[16]
+#undef NVIC_PRI11_R
+#define NVIC_PRI11_R      SimReg[17]
+#undef NVIC_EN1_R
+#define NVIC_EN1_R        SimReg[18]
+#undef UDMA_CFG_R
+#define UDMA_CFG_R        SimReg[19]
+#undef UDMA_CTLBASE_R
+#define UDMA_CTLBASE_R    SimReg[20]
+#undef UDMA_CHMAP2_R
+#define UDMA_CHMAP2_R     SimReg[21]
+#undef UDMA_PRIOCLR_R
+#define UDMA_PRIOCLR_R    SimReg[22]
+#undef UDMA_USEBURSTCLR_R
+#define UDMA_USEBURSTCLR_R SimReg[23]
+#undef UDMA_REQMASKCLR_R
+#define UDMA_REQMASKCLR_R SimReg[24]
+#undef UDMA_ALTCLR_R
+#define UDMA_ALTCLR_R     SimReg[25]
+#undef UDMA_ENASET_R
+#define UDMA_ENASET_R     SimReg[26]
+#undef UDMA_ENACLR_R
+#define UDMA_ENACLR_R     SimReg[27]
+#undef UDMA_CHIS_R
+#define UDMA_CHIS_R       SimReg[28]
+#undef UDMA_ERRCLR_R
+#define UDMA_ERRCLR_R     SimReg[29]
+#undef UART1_IFLS_R
+#undef UART1_IM_R
+#undef UART1_DR_R
+#undef UART1_FR_R
+#undef UART1_RIS_R
+#undef UART1_MIS_R
+#undef UART1_ICR_R
+#define UART1_IFLS_R      SimReg[0]
+#define UART1_IM_R        SimReg[1]
+#define UART1_DR_R        (*simDR())
+#define UART1_FR_R        (simFR())
+#define UART1_RIS_R       (simRIS())
+#define UART1_MIS_R       (simRIS()&UART1_IM_R)
+#define UART1_ICR_R       SimICR
+
+// stubs for CortexM.c, BSP.c and Diag.c
+long StartCritical(void){ return 0; }
+void EndCritical(long sr){ (void)sr; }
+void EnableInterrupts(void){}
+void DisableInterrupts(void){}
+uint32_t BSP_Clock_GetFreq(void){ return 80000000; }
+void Diag_Register(uint32_t id, volatile uint32_t *counter){ (void)id; (void)counter; }
+
+#include "UART1.c"
+
+// ****simulation****
+#define SIMFRAMES 650      // 10 frames of each payload size 0 to 64
+#define SIMBYTES (SIMFRAMES*70)
+uint8_t Sent[SIMBYTES];    // bytes on the line, in order
+uint32_t SentTime[SIMBYTES]; // character time each one arrived
+uint32_t FrameEnd[SIMFRAMES]; // index of the last byte of each frame
+uint32_t SentCount,GotCount,Frames;
+uint32_t Now;              // character times since the start
+uint32_t Idle;             // character times since the last byte
+uint32_t Errors;
+uint32_t TailMax;          // longest wait of a frame's last byte, character times
+uint32_t NextEnd;          // frame whose last byte is awaited
+
+// ****simDrain****
+// the application reads the software FIFO, checking order and timing
+void static simDrain(void){ uint8_t data;
+  while(RxFifo_Get(&data)){
+    if((GotCount >= SentCount)||(data != Sent[GotCount])){
+      if(Errors < 10) printf("  byte %u wrong\n",(unsigned)GotCount);
+      Errors++;
+    }
+    if((NextEnd < Frames)&&(GotCount == FrameEnd[NextEnd])){
+      if(Now-SentTime[GotCount] > TailMax) TailMax = Now-SentTime[GotCount];
+      NextEnd++;
+    }
+    GotCount++;
+  }
+}
+// ****simInterrupt****
+// run UART1_Handler while an enabled interrupt is raised
+void static simInterrupt(void){
+  while(UART1_MIS_R&(UART_MIS_RXMIS|UART_MIS_RTMIS|UART_MIS_OEMIS)){
+    SimICR = 0;
+    UART1_Handler();
+    if(SimICR&UART_ICR_RTIC) SimRT = 0;
+    if(SimICR&UART_ICR_OEIC) SimOE = 0;
+  }
+  simDrain();
+}
+// ****simByte****
+// one character time with a byte arriving
+void static simByte(uint8_t data){
+  Now++;
+  Idle = 0;
+  Sent[SentCount] = data;
+  SentTime[SentCount] = Now;
+  SentCount++;
+  if(SimCount == SIMFIFO){
+    SimOE = 1;                       // byte lost
+    Errors++;
+  }else{
+    SimFifo[(SimGet+SimCount)%SIMFIFO] = data;
+    SimCount++;
+  }
+  simInterrupt();
+}
+// ****simIdle****
+// character times with the line idle
+void static simIdle(uint32_t n){
+  while(n){
+    Now++;
+    Idle++;
+    if(SimCount&&(Idle == SIMTIMEOUT)) SimRT = 1;
+    simInterrupt();
+    n--;
+  }
+}
+// ****simFrame****
+// one NPI frame, pause idle characters after the first half of the payload
+void static simFrame(uint32_t size, uint32_t pause){ uint32_t i;
+  simByte(0xFE);                     // SOF
+  simByte(size&0xFF);
+  simByte(size>>8);
+  simByte(0x55);
+  simByte(0x05);
+  for(i=0; i<size; i++){
+    if(pause&&(i == size/2)) simIdle(pause);
+    simByte(rand());                 // SOF values in the payload too
+  }
+  FrameEnd[Frames] = SentCount;      // the FCS is the last byte
+  Frames++;
+  simByte(rand());                   // FCS
+}
+
+// ****run****
+// receive SIMFRAMES frames, gap idle characters after each, pause inside
+// Output: interrupts per frame
+double static run(uint32_t coalesce, uint32_t gap, uint32_t pause){ uint32_t i;
+  UART1_Init();
+  UART1DMAOn = 0;                    // interrupt receiver, as after a uDMA error
+  UART1_IM_R |= (UART_IM_RXIM|UART_IM_RTIM);
+  UART1_Coalesce(coalesce);
+  SimCount = SimGet = SimRT = SimOE = 0;
+  SentCount = GotCount = Frames = NextEnd = 0;
+  Now = Idle = TailMax = 0;
+  srand(1);
+  for(i=0; i<SIMFRAMES; i++){
+    simFrame(i%65,pause);
+    simIdle(gap);
+  }
+  simIdle(2*SIMTIMEOUT);             // the last tail
+  if((GotCount != SentCount)||(RxFrames != Frames)||RxOverrun||(TailMax > SIMTIMEOUT)){
+    printf("  %u of %u bytes, %u of %u frames, %u overruns, tail %u\n",(unsigned)GotCount,
+      (unsigned)SentCount,(unsigned)RxFrames,(unsigned)Frames,(unsigned)RxOverrun,(unsigned)TailMax);
+    Errors++;
+  }
+  return (double)RxInterrupts/Frames;
+}
+
+int main(void){ double off,on;
+  const struct{ const char *name; uint32_t gap,pause; }Case[3] = {
+    {"gaps",         10, 0},
+    {"back to back", 0,  0},
+    {"split",        10, 6}};
+  uint32_t i;
+  Errors = 0;
+  for(i=0; i<3; i++){
+    off = run(0,Case[i].gap,Case[i].pause);
+    on = run(1,Case[i].gap,Case[i].pause);
+    printf("%-13s interrupts/frame 1/8 trigger %.2f, coalesced %.2f, longest tail %u characters\n",
+      Case[i].name,off,on,(unsigned)TailMax);
+  }
+  printf("%u failures\n",(unsigned)Errors);
+  return Errors != 0;
+}